@@ -639,6 +639,8 @@ namespace mongo {
             ss << f.fieldName() << "_";
             if( f.isNumber() )
                 ss << f.numberInt();
+            else if( f.type() == String )
+                ss << f.valuestr();
         }
         return ss.str();
     }
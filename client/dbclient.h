@@ -44,7 +44,12 @@ namespace mongo {
 
         /** if there is a cursor, ignore the normal cursor timeout behavior and never time it out
          */
-        Option_NoCursorTimeout = 1 << 4
+        Option_NoCursorTimeout = 1 << 4,
+
+        /** use with Option_CursorTailable.  rather than returning no data at once when the cursor
+            reaches the end, a getMore waits on the server a little while for more to be inserted.
+        */
+        Option_AwaitData = 1 << 5
     };
 
     enum UpdateOptions {
@@ -185,6 +190,9 @@ namespace mongo {
 		/** if true, safe to call next() */
         bool more();
 
+        /** if true, next() can be called without another round trip to the server */
+        bool moreInCurrentBatch() const { return pos < nReturned; }
+
         /** next
 		   @return next object in the result cursor.
            on an error at the remote server, you will get back:
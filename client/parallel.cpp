@@ -7,6 +7,8 @@
 #include "../db/dbmessage.h"
 #include "../s/util.h"
 
+#include <boost/bind.hpp>
+
 namespace mongo {
     
     // --------  ClusteredCursor -----------
@@ -33,6 +35,13 @@ namespace mongo {
     }
     
     auto_ptr<DBClientCursor> ClusteredCursor::query( const string& server , int num , BSONObj extra ){
+        ScopedDbConnection conn( server );
+        auto_ptr<DBClientCursor> cursor = query( conn , num , extra );
+        conn.done();
+        return cursor;
+    }
+
+    auto_ptr<DBClientCursor> ClusteredCursor::query( ScopedDbConnection& conn , int num , BSONObj extra ){
         uassert( "cursor already done" , ! _done );
         
         BSONObj q = _query;
@@ -40,15 +49,13 @@ namespace mongo {
             q = concatQuery( q , extra );
         }
 
-        ScopedDbConnection conn( server );
         checkShardVersion( conn.conn() , _ns );
 
-        log(5) << "ClusteredCursor::query  server:" << server << " ns:" << _ns << " query:" << q << " num:" << num << " _fields:" << _fields << " options: " << _options << endl;
+        log(5) << "ClusteredCursor::query  server:" << conn->getServerAddress() << " ns:" << _ns << " query:" << q << " num:" << num << " _fields:" << _fields << " options: " << _options << endl;
         auto_ptr<DBClientCursor> cursor = conn->query( _ns.c_str() , q , num , 0 , ( _fields.isEmpty() ? 0 : &_fields ) , _options );
         if ( cursor->hasResultFlag( QueryResult::ResultFlag_ShardConfigStale ) )
             throw StaleConfigException( _ns , "ClusteredCursor::query" );
 
-        conn.done();
         return cursor;
     }
 
@@ -79,36 +86,138 @@ namespace mongo {
         // TODO: should do some simplification here if possibl ideally
     }
 
+
+    // --------  ServerCursorPrefetcher -----------
+
+    ServerCursorPrefetcher::ServerCursorPrefetcher( ClusteredCursor * cursor , const ServerAndQuery& sq )
+        : _cursor( cursor ) , _sq( sq ) , _bufBytes( 0 ) , _done( false ) , _stop( false ) , _stale( false ){
+        _thr = new boost::thread( boost::bind( &ServerCursorPrefetcher::run , this ) );
+    }
+
+    ServerCursorPrefetcher::~ServerCursorPrefetcher(){
+        {
+            boostlock lk( _m );
+            _stop = true;
+            _changed.notify_all();
+        }
+        // at most waits out the round trip in flight
+        _thr->join();
+        delete _thr;
+    }
+
+    void ServerCursorPrefetcher::run(){
+        try {
+            _fetch();
+        }
+        catch ( StaleConfigException& e ){
+            boostlock lk( _m );
+            _stale = true;
+            _error = e.what();
+        }
+        catch ( std::exception& e ){
+            boostlock lk( _m );
+            _error = e.what();
+        }
+        
+        boostlock lk( _m );
+        _done = true;
+        _changed.notify_all();
+    }
+
+    void ServerCursorPrefetcher::_fetch(){
+        ScopedDbConnection conn( _sq._server );
+        auto_ptr<DBClientCursor> cursor = _cursor->query( conn , 0 , _sq._extra );
+
+        while ( true ){
+            {
+                boostlock lk( _m );
+                while ( ! _stop && _bufBytes >= PrefetchBytes )
+                    _changed.wait( lk );
+                if ( _stop )
+                    break;
+            }
+
+            // may be a getMore round trip
+            if ( ! cursor->more() )
+                break;
+
+            // hand the whole batch over at once, the caller only waits on the network
+            deque<BSONObj> batch;
+            int bytes = 0;
+            do {
+                BSONObj o = cursor->next().getOwned();
+                bytes += o.objsize();
+                batch.push_back( o );
+            } while ( cursor->moreInCurrentBatch() );
+
+            boostlock lk( _m );
+            _buf.insert( _buf.end() , batch.begin() , batch.end() );
+            _bufBytes += bytes;
+            _changed.notify_all();
+        }
+
+        cursor.reset(); // kills the server side cursor if we stopped early
+        conn.done();
+    }
+
+    bool ServerCursorPrefetcher::more(){
+        boostlock lk( _m );
+        while ( _buf.empty() && ! _done )
+            _changed.wait( lk );
+        
+        if ( ! _buf.empty() )
+            return true;
+        
+        if ( _stale )
+            throw StaleConfigException( _cursor->_ns , _error );
+        uassert( "error querying " + _sq._server + ": " + _error , _error.empty() );
+        return false;
+    }
+
+    BSONObj ServerCursorPrefetcher::next(){
+        uassert( "no more items" , more() );
+        
+        boostlock lk( _m );
+        BSONObj o = _buf.front();
+        _buf.pop_front();
+        _bufBytes -= o.objsize();
+        _changed.notify_all();
+        return o;
+    }
     
     // --------  SerialServerClusteredCursor -----------
     
     SerialServerClusteredCursor::SerialServerClusteredCursor( set<ServerAndQuery> servers , QueryMessage& q , int sortOrder) : ClusteredCursor( q ){
-        for ( set<ServerAndQuery>::iterator i = servers.begin(); i!=servers.end(); i++ )
-            _servers.push_back( *i );
+        vector<ServerAndQuery> v( servers.begin() , servers.end() );
         
         if ( sortOrder > 0 )
-            sort( _servers.begin() , _servers.end() );
+            sort( v.begin() , v.end() );
         else if ( sortOrder < 0 )
-            sort( _servers.rbegin() , _servers.rend() );
+            sort( v.rbegin() , v.rend() );
         
+        // all servers are queried at once, results are still returned one server after another
+        for ( unsigned i=0; i<v.size(); i++ )
+            _servers.push_back( shared_ptr<ServerCursorPrefetcher>( new ServerCursorPrefetcher( this , v[i] ) ) );
+
+        // wait for the first batches so a stale config surfaces here, as it always has
+        for ( unsigned i=0; i<_servers.size(); i++ )
+            _servers[i]->more();
+
         _serverIndex = 0;
     }
     
     bool SerialServerClusteredCursor::more(){
-        if ( _current.get() && _current->more() )
-            return true;
-        
-        if ( _serverIndex >= _servers.size() )
-            return false;
-        
-        ServerAndQuery& sq = _servers[_serverIndex++];
-        _current = query( sq._server , 0 , sq._extra );
-        return _current->more();
+        while ( _serverIndex < _servers.size() ){
+            if ( _servers[_serverIndex]->more() )
+                return true;
+            _servers[_serverIndex++].reset();
+        }
+        return false;
     }
     
     BSONObj SerialServerClusteredCursor::next(){
         uassert( "no more items" , more() );
-        return _current->next();
+        return _servers[_serverIndex]->next();
     }
 
     // --------  ParallelSortClusteredCursor -----------
@@ -130,80 +239,41 @@ namespace mongo {
 
     void ParallelSortClusteredCursor::_init(){
         _numServers = _servers.size();
-        _cursors = new auto_ptr<DBClientCursor>[_numServers];
-        _nexts = new BSONObj[_numServers];
-            
-        // TODO: parellize
-        int num = 0;
-        for ( set<ServerAndQuery>::iterator i = _servers.begin(); i!=_servers.end(); i++ ){
-            const ServerAndQuery& sq = *i;
-            _cursors[num++] = query( sq._server , 0 , sq._extra );
-        }
             
+        for ( set<ServerAndQuery>::iterator i = _servers.begin(); i!=_servers.end(); i++ )
+            _cursors.push_back( shared_ptr<ServerCursorPrefetcher>( new ServerCursorPrefetcher( this , *i ) ) );
+
+        for ( int i=0; i<_numServers; i++ )
+            advance( i );
     }
     
     ParallelSortClusteredCursor::~ParallelSortClusteredCursor(){
-        delete [] _cursors;
-        delete [] _nexts;
     }
 
     bool ParallelSortClusteredCursor::more(){
-        for ( int i=0; i<_numServers; i++ ){
-            if ( ! _nexts[i].isEmpty() )
-                return true;
-
-            if ( _cursors[i].get() && _cursors[i]->more() )
-                return true;
-        }
-        return false;
+        return ! _heap.empty();
     }
         
     BSONObj ParallelSortClusteredCursor::next(){
-        advance();
-            
-        BSONObj best = BSONObj();
-        int bestFrom = -1;
-            
-        for ( int i=0; i<_numServers; i++){
-            if ( _nexts[i].isEmpty() )
-                continue;
-
-            if ( best.isEmpty() ){
-                best = _nexts[i];
-                bestFrom = i;
-                continue;
-            }
-                
-            int comp = best.woSortOrder( _nexts[i] , _sortKey );
-            if ( comp < 0 )
-                continue;
-                
-            best = _nexts[i];
-            bestFrom = i;
-        }
-            
-        uassert( "no more elements" , ! best.isEmpty() );
-        _nexts[bestFrom] = BSONObj();
-            
-        return best;
-    }
+        uassert( "no more elements" , ! _heap.empty() );
 
-    void ParallelSortClusteredCursor::advance(){
-        for ( int i=0; i<_numServers; i++ ){
+        pop_heap( _heap.begin() , _heap.end() , HeapCmp( _sortKey ) );
+        pair<BSONObj,int> best = _heap.back();
+        _heap.pop_back();
 
-            if ( ! _nexts[i].isEmpty() ){
-                // already have a good object there
-                continue;
-            }
-                
-            if ( ! _cursors[i]->more() ){
-                // cursor is dead, oh well
-                continue;
-            }
+        advance( best.second );
+        return best.first;
+    }
 
-            _nexts[i] = _cursors[i]->next();
+    void ParallelSortClusteredCursor::advance( int i ){
+        if ( ! _cursors[i]->more() ){
+            // cursor is dead, oh well
+            _cursors[i].reset();
+            return;
         }
-            
+
+        _heap.push_back( make_pair( _cursors[i]->next() , i ) );
+        push_heap( _heap.begin() , _heap.end() , HeapCmp( _sortKey ) );
     }
 
     // -----------------
@@ -223,13 +293,16 @@ namespace mongo {
         return _ok;
     }
 
-    void Future::commandThread(){
-        assert( _grab );
-        shared_ptr<CommandResult> res = *_grab;
-        _grab = 0;
-        
-        ScopedDbConnection conn( res->_server );
-        res->_ok = conn->runCommand( res->_db , res->_cmd , res->_res );
+    void Future::commandThread( shared_ptr<CommandResult> res ){
+        try {
+            ScopedDbConnection conn( res->_server );
+            res->_ok = conn->runCommand( res->_db , res->_cmd , res->_res );
+            conn.done();
+        }
+        catch ( std::exception& e ){
+            res->_ok = false;
+            res->_res = BSON( "errmsg" << e.what() );
+        }
         res->_done = true;
     }
 
@@ -237,17 +310,10 @@ namespace mongo {
         shared_ptr<Future::CommandResult> res;
         res.reset( new Future::CommandResult( server , db , cmd ) );
         
-        _grab = &res;
-        
-        boost::thread thr( Future::commandThread );
-
-        while ( _grab )
-            sleepmicros(2);
+        boost::thread thr( boost::bind( Future::commandThread , res ) );
 
         return res;
     }
-
-    shared_ptr<Future::CommandResult> * Future::_grab;
     
     
 }
@@ -21,6 +21,7 @@
 
 #include "../stdafx.h"
 #include "dbclient.h"
+#include "connpool.h"
 #include "../db/dbmessage.h"
 
 namespace mongo {
@@ -43,6 +44,9 @@ namespace mongo {
     protected:
         auto_ptr<DBClientCursor> query( const string& server , int num = 0 , BSONObj extraFilter = BSONObj() );
 
+        /* runs on a connection the caller holds until it is through with the cursor */
+        auto_ptr<DBClientCursor> query( ScopedDbConnection& conn , int num , BSONObj extraFilter );
+
         static BSONObj _concatFilter( const BSONObj& filter , const BSONObj& extraFilter );
         
         string _ns;
@@ -51,6 +55,8 @@ namespace mongo {
         BSONObj _fields;
 
         bool _done;
+
+        friend class ServerCursorPrefetcher;
     };
 
 
@@ -80,6 +86,43 @@ namespace mongo {
     };
 
 
+    /**
+     * runs one server's part of a ClusteredCursor on its own thread, so every server is
+     * queried at once.  keeps reading batches ahead while the caller consumes what has
+     * already arrived, up to PrefetchBytes buffered.
+     */
+    class ServerCursorPrefetcher : boost::noncopyable {
+    public:
+        ServerCursorPrefetcher( ClusteredCursor * cursor , const ServerAndQuery& sq );
+        ~ServerCursorPrefetcher();
+
+        /* blocks until an object has arrived or the server is exhausted.
+           rethrows anything the server side hit */
+        bool more();
+        BSONObj next();
+
+        const ServerAndQuery& serverAndQuery() const { return _sq; }
+
+        enum { PrefetchBytes = 1024 * 1024 };
+    private:
+        void run();
+        void _fetch();
+
+        ClusteredCursor * _cursor;
+        ServerAndQuery _sq;
+
+        boost::mutex _m;
+        boost::condition _changed;
+        deque<BSONObj> _buf;
+        int _bufBytes;
+        bool _done;
+        bool _stop;
+        bool _stale;
+        string _error;
+
+        boost::thread * _thr;
+    };
+
     /**
      * runs a query in serial across any number of servers
      * returns all results from 1 server, then the next, etc...
@@ -90,10 +133,8 @@ namespace mongo {
         virtual bool more();
         virtual BSONObj next();
     private:
-        vector<ServerAndQuery> _servers;
+        vector< shared_ptr<ServerCursorPrefetcher> > _servers;
         unsigned _serverIndex;
-        
-        auto_ptr<DBClientCursor> _current;
     };
 
 
@@ -112,14 +153,27 @@ namespace mongo {
     private:
         void _init();
         
-        void advance();
+        /* pulls the next object from server i onto the heap */
+        void advance( int i );
+
+        /* orders _heap so its front is the next object to return */
+        struct HeapCmp {
+            HeapCmp( const BSONObj& sortKey ) : _sortKey( sortKey ){}
+            bool operator()( const pair<BSONObj,int>& l , const pair<BSONObj,int>& r ) const {
+                int comp = l.first.woSortOrder( r.first , _sortKey );
+                if ( comp )
+                    return comp > 0;
+                return l.second > r.second;
+            }
+            BSONObj _sortKey;
+        };
 
         int _numServers;
         set<ServerAndQuery> _servers;
         BSONObj _sortKey;
 
-        auto_ptr<DBClientCursor> * _cursors;
-        BSONObj * _nexts;
+        vector< shared_ptr<ServerCursorPrefetcher> > _cursors;
+        vector< pair<BSONObj,int> > _heap;
     };
 
     /**
@@ -169,12 +223,10 @@ namespace mongo {
             friend class Future;
         };
         
-        static void commandThread();
+        static void commandThread( shared_ptr<CommandResult> res );
         
+        /* returns as soon as the command is sent off; many can be in flight at once */
         static shared_ptr<CommandResult> spawnCommand( const string& server , const string& db , const BSONObj& cmd );
-
-    private:
-        static shared_ptr<CommandResult> * _grab;
     };
 
     
@@ -24,6 +24,7 @@
 #include "db.h"
 #include "client.h"
 #include "curop.h"
+#include "../s/d_logic.h"
  
 namespace mongo {
 
@@ -39,6 +40,7 @@ namespace mongo {
       _god(0)
     { 
         ai = new AuthenticationInfo(); 
+        sharded = 0;
 
         boostlock bl(clientsMutex);
         clients.insert(this);
@@ -48,6 +50,8 @@ namespace mongo {
         delete _curOp;
         delete ai; 
         ai = 0;
+        delete sharded;
+        sharded = 0;
         _god = 0;
         if ( !_shutdown ) {
             cout << "ERROR: Client::shutdown not called!" << endl;
@@ -32,6 +32,7 @@
 namespace mongo { 
 
     class AuthenticationInfo;
+    class ShardedConnectionInfo;
     class Database;
     struct CurOp;
 
@@ -58,6 +59,7 @@ namespace mongo {
         bool _god;
     public:
         AuthenticationInfo *ai;
+        ShardedConnectionInfo *sharded; // 0 until the connection enters sharded mode, see s/d_logic.h
         Top top;
 
         CurOp* curop() { return _curOp; }
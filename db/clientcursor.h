@@ -51,6 +51,7 @@ namespace mongo {
         DiskLoc _lastLoc;                        // use getter and setter not this (important)
         unsigned _idleAgeMillis;                 // how long has the cursor been around, relative to server idle time
         bool _noTimeout;                       // if true, never time out cursor
+        bool _awaitData;                       // tailable; getMore waits a bit for inserts at the end
         bool _doingDeletes;
 
         static CCById clientCursorsById;
@@ -67,7 +68,7 @@ namespace mongo {
         int pos;                                 // # objects into the cursor so far 
         BSONObj query;
 
-        ClientCursor() : _idleAgeMillis(0), _noTimeout(false), _doingDeletes(false), pos(0) {
+        ClientCursor() : _idleAgeMillis(0), _noTimeout(false), _awaitData(false), _doingDeletes(false), pos(0) {
             recursive_boostlock lock(ccmutex);
             cursorid = allocCursorId_inlock();
             clientCursorsById.insert( make_pair(cursorid, this) );
@@ -148,6 +149,14 @@ namespace mongo {
             _noTimeout = true;
         }
 
+        void awaitData() {
+            _awaitData = true;
+        }
+
+        bool isAwaitData() const {
+            return _awaitData;
+        }
+
         void setDoingDeletes( bool doingDeletes ){
             _doingDeletes = doingDeletes;
         }
@@ -26,6 +26,7 @@
 #include "db.h"
 #include "instance.h"
 #include "repl.h"
+#include "../s/d_logic.h"
 
 namespace mongo {
 
@@ -38,6 +39,7 @@ namespace mongo {
         void copy(const char *from_ns, const char *to_ns, bool isindex, bool logForRepl,
                   bool masterSameProcess, bool slaveOk, Query q = Query());
         void replayOpLog( DBClientCursor *c, const BSONObj &query );
+        void copyChunk( const char *ns, bool logForRepl );
     public:
         Cloner() { }
 
@@ -47,7 +49,10 @@ namespace mongo {
                          for example repairDatabase need not use it.
         */
         bool go(const char *masterHost, string& errmsg, const string& fromdb, bool logForRepl, bool slaveOk, bool useReplAuth, bool snapshot);
-        bool startCloneCollection( const char *fromhost, const char *ns, const BSONObj &query, string& errmsg, bool logForRepl, bool copyIndexes, int logSizeMb, long long &cursorId );
+        /* bulk - the source is a shard migrating a chunk to us (movechunk.start), which has already
+                  started logging changes and hands out the documents with movechunk.getbatch
+        */
+        bool startCloneCollection( const char *fromhost, const char *ns, const BSONObj &query, string& errmsg, bool logForRepl, bool copyIndexes, int logSizeMb, long long &cursorId, bool bulk = false );
         bool finishCloneCollection( const char *fromhost, const char *ns, const BSONObj &query, long long cursorId, string &errmsg );
     };
 
@@ -279,10 +284,15 @@ namespace mongo {
         return true;
     }
 
-    bool Cloner::startCloneCollection( const char *fromhost, const char *ns, const BSONObj &query, string &errmsg, bool logForRepl, bool copyIndexes, int logSizeMb, long long &cursorId ) {
+    bool Cloner::startCloneCollection( const char *fromhost, const char *ns, const BSONObj &query, string &errmsg, bool logForRepl, bool copyIndexes, int logSizeMb, long long &cursorId, bool bulk ) {
         char db[256];
         nsToClient( ns, db );
 
+        if ( rangeDeletePending( ns ) ) {
+            errmsg = "still deleting a range of " + string( ns ) + " that was moved off this shard, try again later";
+            return false;
+        }
+
         NamespaceDetails *nsd = nsdetails( ns );
         if ( nsd ){
             /** note: its ok to clone into a collection, but only if the range you're copying 
@@ -304,14 +314,16 @@ namespace mongo {
             conn = c;
 
             // Start temporary op log
-            BSONObjBuilder cmdSpec;
-            cmdSpec << "logCollection" << ns << "start" << 1;
-            if ( logSizeMb != INT_MIN )
-                cmdSpec << "logSizeMb" << logSizeMb;
-            BSONObj info;
-            if ( !conn->runCommand( db, cmdSpec.done(), info ) ) {
-                errmsg = "logCollection failed: " + (string)info;
-                return false;
+            if ( !bulk ) {
+                BSONObjBuilder cmdSpec;
+                cmdSpec << "logCollection" << ns << "start" << 1;
+                if ( logSizeMb != INT_MIN )
+                    cmdSpec << "logSizeMb" << logSizeMb;
+                BSONObj info;
+                if ( !conn->runCommand( db, cmdSpec.done(), info ) ) {
+                    errmsg = "logCollection failed: " + (string)info;
+                    return false;
+                }
             }
         }
         
@@ -321,7 +333,10 @@ namespace mongo {
                 return false;
         }
 
-        copy( ns, ns, false, logForRepl, false, false, query );
+        if ( bulk )
+            copyChunk( ns, logForRepl );
+        else
+            copy( ns, ns, false, logForRepl, false, false, query );
 
         if ( copyIndexes ) {
             string indexNs = string( db ) + ".system.indexes";
@@ -346,6 +361,47 @@ namespace mongo {
         return true;
     }
     
+    /* pulls the documents of a chunk from the shard migrating it, a few MB at a time,
+       and inserts each batch under a single hold of the lock
+    */
+    void Cloner::copyChunk( const char *ns, bool logForRepl ) {
+        long long n = 0;
+        Timer t;
+        while ( 1 ) {
+            BSONObj res;
+            {
+                dbtemprelease r;
+                if ( !conn->runCommand( "admin", BSON( "movechunk.getbatch" << ns ), res ) ) {
+                    stringstream ss;
+                    ss << "movechunk.getbatch failed: " << res;
+                    uassert( ss.str(), false );
+                }
+            }
+
+            BSONObjIterator i( res.getObjectField( "objects" ) );
+            int inBatch = 0;
+            while ( i.more() ) {
+                BSONElement o = i.next();
+                if ( o.eoo() )
+                    break;
+                BSONObj js = o.embeddedObject();
+                inBatch++;
+                try {
+                    theDataFileMgr.insert( ns, js );
+                    if ( logForRepl )
+                        logOp( "i", ns, js );
+                }
+                catch( UserException& e ) {
+                    log() << "warning: exception cloning object in " << ns << ' ' << e.what() << " obj:" << js.toString() << '\n';
+                }
+            }
+            if ( inBatch == 0 )
+                break;
+            n += inBatch;
+        }
+        log() << "copied " << n << " objects of " << ns << " in " << t.millis() << "ms" << endl;
+    }
+
     void Cloner::replayOpLog( DBClientCursor *c, const BSONObj &query ) {
         JSMatcher matcher( query );
         while( 1 ) {
@@ -512,7 +568,7 @@ namespace mongo {
             
             Cloner c;
             long long cursorId;
-            bool res = c.startCloneCollection( fromhost.c_str(), collection.c_str(), query, errmsg, !fromRepl, copyIndexes, logSizeMb, cursorId );
+            bool res = c.startCloneCollection( fromhost.c_str(), collection.c_str(), query, errmsg, !fromRepl, copyIndexes, logSizeMb, cursorId, cmdObj["bulk"].trueValue() );
             
             if ( res ) {
                 BSONObjBuilder b;
@@ -13,6 +13,8 @@
 
 #pragma once
 
+#include "../util/message.h"
+
 #if BOOST_VERSION >= 103500
 #include <boost/thread/shared_mutex.hpp>
 #undef assert
@@ -78,6 +80,8 @@ namespace mongo {
             massert("internal error: locks are not upgradeable", s == 0 );
             _state.set(1);
             _m.lock(); 
+            // responses still going out may point into the datafiles
+            responsePins.waitForNone();
             _minfo.entered();
         }
         void unlock() { 
@@ -161,9 +161,12 @@ namespace mongo {
     /* we create one thread for each connection from an app server database.
        app server will open a pool of threads.
     */
+    WrappingInt connNumber;
+
     void connThread()
     {
         Client::initThread("conn");
+        unsigned connId = connNumber.atomicIncrement();
 
         /* todo: move to Client object */
         LastError *le = new LastError();
@@ -189,8 +192,11 @@ namespace mongo {
 
                 lastError.startRequest( m , le );
 
+                // the request is logged now, before it runs
+                DiagLogRecordHolder diag( _diaglog.level ? _diaglog.start( connId, m ) : 0 );
+
                 DbResponse dbresponse;
-                if ( !assembleResponse( m, dbresponse, dbMsgPort.farEnd.sa ) ) {
+                if ( !assembleResponse( m, dbresponse, dbMsgPort.farEnd.sa, &dbMsgPort ) ) {
                     out() << curTimeMillis() % 10000 << "   end msg " << dbMsgPort.farEnd.toString() << endl;
                     /* todo: we may not wish to allow this, even on localhost: very low priv accounts could stop us. */
                     if ( dbMsgPort.farEnd.isLocalHost() ) {
@@ -204,6 +210,8 @@ namespace mongo {
                     }
                 }
 
+                _diaglog.finish( diag.release(), m, dbresponse.response );
+
                 if ( dbresponse.response )
                     dbMsgPort.reply(m, *dbresponse.response, dbresponse.responseTo);
             }
@@ -871,6 +871,72 @@ namespace mongo {
         }
     } cmdMedianKey;
 
+    /* one pass over the index: a key every maxChunkSize/2 bytes' worth of objects (by the
+       collection's average object size), or none if the range isn't over maxChunkSize
+    */
+    class CmdSplitVector : public Command {
+    public:
+        CmdSplitVector() : Command( "splitVector" ) {}
+        virtual bool slaveOk() { return true; }
+        virtual void help( stringstream &help ) const {
+            help << " example: { splitVector:\"blog.posts\", keyPattern:{x:1}, min:{x:10}, max:{x:55}, maxChunkSize:<bytes> }\n"
+                "NOTE: This command may take awhile to run";
+        }
+        bool run(const char *dbname, BSONObj& jsobj, string& errmsg, BSONObjBuilder& result, bool fromRepl ){
+            const char *ns = jsobj.getStringField( "splitVector" );
+            BSONObj min = jsobj.getObjectField( "min" );
+            BSONObj max = jsobj.getObjectField( "max" );
+            BSONObj keyPattern = jsobj.getObjectField( "keyPattern" );
+            long long maxChunkSize = (long long)jsobj["maxChunkSize"].number();
+            if ( maxChunkSize <= 0 ) {
+                errmsg = "need a positive maxChunkSize";
+                return false;
+            }
+
+            IndexDetails *id = cmdIndexDetailsForRange( ns, errmsg, min, max, keyPattern );
+            if ( id == 0 )
+                return false;
+
+            NamespaceDetails *d = nsdetails(ns);
+            long long avgObjSize = d->nrecords ? d->datasize / d->nrecords : 0;
+            if ( avgObjSize <= 0 )
+                avgObjSize = 1;
+            long long keysPerChunk = maxChunkSize / avgObjSize / 2;
+            if ( keysPerChunk < 1 )
+                keysPerChunk = 1;
+
+            Timer t;
+            vector<BSONObj> splitKeys;
+            long long num = 0;
+            BSONObj last; // the range's first key, then the last split key
+            BtreeCursor c( d, d->idxNo(*id), *id, min, max, false, 1 );
+            for( ; c.ok(); c.advance(), ++num ) {
+                if ( num == 0 )
+                    last = c.currKey().getOwned();
+                if ( num < keysPerChunk * (long long)( splitKeys.size() + 1 ) )
+                    continue;
+                // splitting on the same value twice (or on the first one) would make an empty chunk
+                BSONObj k = c.currKey();
+                if ( k.woCompare( last ) == 0 )
+                    continue;
+                splitKeys.push_back( c.prettyKey( k ).getOwned() );
+                last = k.getOwned();
+            }
+            int ms = t.millis();
+            if ( ms > 100 ) {
+                out() << "Finding split keys for index: " << keyPattern << " between " << min << " and " << max << " took " << ms << "ms." << endl;
+            }
+
+            if ( num * avgObjSize < maxChunkSize )
+                splitKeys.clear();
+
+            result.append( "splitKeys" , splitKeys );
+            result.append( "numObjects" , (double)num );
+            result.append( "avgObjSize" , (double)avgObjSize );
+            return true;
+        }
+    } cmdSplitVector;
+
     class CmdDatasize : public Command {
     public:
         CmdDatasize() : Command( "datasize" ) {}
@@ -962,6 +1028,29 @@ namespace mongo {
         }
     } cmdCollectionStatis;
 
+    class CmdPlanCacheStats : public Command {
+    public:
+        CmdPlanCacheStats() : Command( "planCacheStats" ) {}
+        virtual bool readOnly() { return true; }
+        virtual bool slaveOk() { return true; }
+        virtual void help( stringstream &help ) const {
+            help << "list the query optimizer's recorded plans for a collection, with their hit rates and running averages"
+                "\nexample: { planCacheStats:\"blog.posts\" }";
+        }
+        bool run(const char *dbname, BSONObj& jsobj, string& errmsg, BSONObjBuilder& result, bool fromRepl ){
+            string ns = cc().database()->name + '.' + jsobj.firstElement().valuestr();
+            if ( !nsdetails( ns.c_str() ) ) {
+                errmsg = "ns not found";
+                return false;
+            }
+            result.append( "ns", ns.c_str() );
+            NamespaceDetailsTransient& nsd = NamespaceDetailsTransient::_get( ns.c_str() );
+            boostlock lk(nsd._qcMutex);
+            nsd.appendQueryCacheStats( result );
+            return true;
+        }
+    } cmdPlanCacheStats;
+
     class CmdBuildInfo : public Command {
     public:
         CmdBuildInfo() : Command( "buildinfo" ) {}
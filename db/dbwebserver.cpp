@@ -104,13 +104,11 @@ namespace mongo {
         }
     }
 
-    bool _bold;
     string bold(bool x) {
-        _bold = x;
         return x ? "<b>" : "";
     }
-    string bold() {
-        return _bold ? "</b>" : "";
+    string unbold(bool x) {
+        return x ? "</b>" : "";
     }
 
     class DbWebServer : public MiniWebServer {
@@ -122,7 +120,8 @@ namespace mongo {
                 ss << "curclient: " << cc().database()->name;
                 ss << '\n';
             }
-            ss << bold(ClientCursor::byLocSize()>10000) << "Cursors byLoc.size(): " << ClientCursor::byLocSize() << bold() << '\n';
+            bool manyCursors = ClientCursor::byLocSize() > 10000;
+            ss << bold(manyCursors) << "Cursors byLoc.size(): " << ClientCursor::byLocSize() << unbold(manyCursors) << '\n';
             ss << "\n<b>replication</b>\n";
             ss << "master: " << master << '\n';
             ss << "slave:  " << slave << '\n';
@@ -203,6 +202,7 @@ namespace mongo {
             if ( from.localhost() )
                 return true;
             
+            DBDirectClient db;
             if ( db.findOne( "admin.system.users" , BSONObj() ).isEmpty() )
                 return true;
             
@@ -323,25 +323,43 @@ namespace mongo {
             }            
         }
 
-        void handleRESTRequest( const char *rq, // the full request
-                                string url,
-                                string& responseMsg,
-                                int& responseCode,
-                                vector<string>& headers // if completely empty, content-type: text/html will be added
-                              ) {
+        virtual void connectionThreadInit() {
+            Client::initThread("websvr");
+        }
+
+        virtual void connectionThreadDone() {
+            cc().shutdown();
+        }
+
+        /* REST queries are streamed out a row at a time; everything else is small */
+        virtual bool doStreamingRequest( const char *rq, string url, HttpResponseStream& out, const SockAddr &from ) {
+            if ( url.size() <= 1 || parseMethod( rq ) != "GET" )
+                return false;
+            vector<string> headers;
+            if ( ! allowed( rq , headers, from ) )
+                return false; // doRequest() answers with the 401
+
+            string fullns, action;
+            map<string,string> params;
+            if ( ! parseRESTURL( url , fullns , action , params ) )
+                return false;
+
+            headers.push_back( (string)"x-action: " + action );
+            headers.push_back( (string)"x-ns: " + fullns );
+            headers.push_back( "Content-Type: text/plain;charset=utf-8" );
+            handleRESTQuery( fullns , action , params , headers , out );
+            return true;
+        }
 
+        /* /db/coll/action?params -> fullns, action, params.  false if malformed */
+        bool parseRESTURL( string url , string& fullns , string& action , map<string,string>& params ) {
             string::size_type first = url.find( "/" , 1 );
-            if ( first == string::npos ) {
-                responseCode = 400;
-                return;
-            }
+            if ( first == string::npos )
+                return false;
 
-            string method = parseMethod( rq );
             string dbname = url.substr( 1 , first - 1 );
             string coll = url.substr( first + 1 );
-            string action = "";
 
-            map<string,string> params;
             if ( coll.find( "?" ) != string::npos ) {
                 parseParams( params , coll.substr( coll.find( "?" ) + 1 ) );
                 coll = coll.substr( 0 , coll.find( "?" ) );
@@ -361,7 +379,24 @@ namespace mongo {
                 if ( coll[i] == '/' )
                     coll[i] = '.';
 
-            string fullns = dbname + "." + coll;
+            fullns = dbname + "." + coll;
+            return true;
+        }
+
+        void handleRESTRequest( const char *rq, // the full request
+                                string url,
+                                string& responseMsg,
+                                int& responseCode,
+                                vector<string>& headers // if completely empty, content-type: text/html will be added
+                              ) {
+
+            string method = parseMethod( rq );
+            string fullns, action;
+            map<string,string> params;
+            if ( ! parseRESTURL( url , fullns , action , params ) ) {
+                responseCode = 400;
+                return;
+            }
 
             headers.push_back( (string)"x-action: " + action );
             headers.push_back( (string)"x-ns: " + fullns );
@@ -369,11 +404,7 @@ namespace mongo {
 
             stringstream ss;
 
-            if ( method == "GET" ) {
-                responseCode = 200;
-                handleRESTQuery( fullns , action , params , responseCode , ss  );
-            }
-            else if ( method == "POST" ) {
+            if ( method == "POST" ) {
                 responseCode = 201;
                 handlePost( fullns , body( rq ) , params , responseCode , ss  );
             }
@@ -387,11 +418,40 @@ namespace mongo {
             responseMsg = ss.str();
         }
 
-        void handleRESTQuery( string ns , string action , map<string,string> & params , int & responseCode , stringstream & out ) {
+        /* "a,-b" -> { a : 1 , b : -1 }.  leading signs are only honored if signs is true */
+        BSONObj _fieldList( const string& list , bool signs ) {
+            BSONObjBuilder b;
+            string::size_type pos = 0;
+            while ( pos < list.size() ) {
+                string::size_type comma = list.find( ',' , pos );
+                if ( comma == string::npos )
+                    comma = list.size();
+                string f = list.substr( pos , comma - pos );
+                pos = comma + 1;
+                int dir = 1;
+                if ( signs && f.size() && ( f[0] == '-' || f[0] == '+' ) ) {
+                    dir = f[0] == '-' ? -1 : 1;
+                    f = f.substr( 1 );
+                }
+                if ( f.size() )
+                    b.append( f.c_str() , dir );
+            }
+            return b.obj();
+        }
+
+        /* GET /db/coll/?filter_a=1&sort=a,-b&fields=a,b&skip=10&limit=100
+
+           limit is the page size, and is handed to the query as its batch size, so the
+           server never produces more than one page.  if there is more, the response has
+           a "cursor" id; GET /db/coll/?cursor=<id>&limit=100 returns the next page.
+           cursors not continued time out on the server like any other.
+        */
+        void handleRESTQuery( string ns , string action , map<string,string> & params , vector<string>& headers , HttpResponseStream & out ) {
             Timer t;
 
             int skip = _getOption( params["skip"] , 0 );
             int num = _getOption( params["limit"] , _getOption( params["count" ] , 1000 ) ); // count is old, limit is new
+            long long cursorId = params["cursor"].size() ? strtoll( params["cursor"].c_str() , 0 , 10 ) : 0;
 
             int one = 0;
             if ( params["one"].size() > 0 && tolower( params["one"][0] ) == 't' ) {
@@ -405,7 +465,7 @@ namespace mongo {
                 if ( ! i->first.find( "filter_" ) == 0 )
                     continue;
 
-                const char * field = i->first.substr( 7 ).c_str();
+                string field = i->first.substr( 7 );
                 const char * val = i->second.c_str();
 
                 char * temp;
@@ -413,32 +473,61 @@ namespace mongo {
                 // TODO: this is how i guess if something is a number.  pretty lame right now
                 double number = strtod( val , &temp );
                 if ( temp != val )
-                    queryBuilder.append( field , number );
+                    queryBuilder.append( field.c_str() , number );
                 else
-                    queryBuilder.append( field , val );
+                    queryBuilder.append( field.c_str() , val );
             }
 
             BSONObj query = queryBuilder.obj();
-
-            auto_ptr<DBClientCursor> cursor = db.query( ns.c_str() , query, num , skip );
+            BSONObj fields = _fieldList( params["fields"] , false );
+            BSONObj sort = _fieldList( params["sort"] , true );
+
+            DBDirectClient db;
+            auto_ptr<DBClientCursor> cursor;
+            if ( cursorId ) {
+                if ( ! _restCursors.take( cursorId , ns ) ) {
+                    out.start( 404 , headers );
+                    out << "{ \"ok\" : false , \"err\" : \"unknown cursor\" }\n";
+                    return;
+                }
+                cursor = db.getMore( ns , cursorId , num );
+            }
+            else {
+                Query q( query );
+                if ( ! sort.isEmpty() )
+                    q.sort( sort );
+                // a negative count asks for a single batch, so no cursor is left open for ?one=
+                cursor = db.query( ns.c_str() , q , one ? -1 : num , skip , fields.isEmpty() ? 0 : &fields );
+            }
+            if ( ! cursor.get() ) {
+                out.start( 500 , headers );
+                out << "{ \"ok\" : false }\n";
+                return;
+            }
 
             if ( one ) {
-                if ( cursor->more() ) {
+                // not decoupled, so a cursor continued with ?one= is killed when we're done with it
+                if ( cursor->moreInCurrentBatch() ) {
+                    out.start( 200 , headers );
                     BSONObj obj = cursor->next();
                     out << obj.jsonString() << "\n";
                 }
                 else {
-                    responseCode = 404;
+                    out.start( 404 , headers );
                 }
                 return;
             }
 
+            // the page is sent; whatever remains is for a later ?cursor= request
+            cursor->decouple();
+
+            out.start( 200 , headers );
             out << "{\n";
             out << "  \"offset\" : " << skip << ",\n";
             out << "  \"rows\": [\n";
 
             int howMany = 0;
-            while ( cursor->more() ) {
+            while ( cursor->moreInCurrentBatch() && ! out.failed() ) {
                 if ( howMany++ )
                     out << " ,\n";
                 BSONObj obj = cursor->next();
@@ -448,6 +537,10 @@ namespace mongo {
             out << "\n  ],\n\n";
 
             out << "  \"total_rows\" : " << howMany << " ,\n";
+            if ( ! cursor->isDead() ) {
+                _restCursors.add( cursor->getCursorId() , ns );
+                out << "  \"cursor\" : " << cursor->getCursorId() << " ,\n";
+            }
             out << "  \"query\" : " << query.jsonString() << " ,\n";
             out << "  \"millis\" : " << t.millis() << "\n";
             out << "}\n";
@@ -457,6 +550,7 @@ namespace mongo {
         void handlePost( string ns, const char *body, map<string,string> & params, int & responseCode, stringstream & out ) {
             try {
                 BSONObj obj = fromjson( body );
+                DBDirectClient db;
                 db.insert( ns.c_str(), obj );
             } catch ( ... ) {
                 responseCode = 400; // Bad Request.  Seems reasonable for now.
@@ -475,10 +569,49 @@ namespace mongo {
         }
 
     private:
-        static DBDirectClient db;
+        /* the cursors REST queries have handed out.  ?cursor= only continues one of these, and
+           only on the namespace it was opened on, so a client can't page through cursors that
+           belong to someone else.
+        */
+        class RESTCursors {
+        public:
+            void add( long long id , const string& ns ) {
+                boostlock lk( _m );
+                time_t now = time(0);
+                // the server times out cursors idle for 10 minutes, so we can forget them then too
+                for ( map<long long,Entry>::iterator i = _cursors.begin(); i != _cursors.end(); ) {
+                    if ( now - i->second.lastUsed > 600 )
+                        _cursors.erase( i++ );
+                    else
+                        i++;
+                }
+                Entry& e = _cursors[id];
+                e.ns = ns;
+                e.lastUsed = now;
+            }
+            /* @return false if id isn't ours or was opened on another ns.  it's added back if
+               the getMore leaves it open
+            */
+            bool take( long long id , const string& ns ) {
+                boostlock lk( _m );
+                map<long long,Entry>::iterator i = _cursors.find( id );
+                if ( i == _cursors.end() || i->second.ns != ns )
+                    return false;
+                _cursors.erase( i );
+                return true;
+            }
+        private:
+            struct Entry {
+                string ns;
+                time_t lastUsed;
+            };
+            boost::mutex _m;
+            map<long long,Entry> _cursors;
+        };
+        static RESTCursors _restCursors;
     };
 
-    DBDirectClient DbWebServer::db;
+    DbWebServer::RESTCursors DbWebServer::_restCursors;
 
     void webServerThread() {
         boost::thread thr(statsThread);
@@ -0,0 +1,134 @@
+// diaglog.h : capture of client requests, for diagnostics and replay
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../stdafx.h"
+#include "../util/message.h"
+
+namespace mongo {
+
+    /* diaglog file format
+
+       DiagLogHeader
+       DiagLogRecord, type Request, followed by the request message exactly as received (MsgData)
+       DiagLogRecord, type Response, on its own: timing and reply details for the last
+                      request on the same connection
+       ...
+
+       a request is logged as it arrives, before it runs, so one that takes the server
+       down is still in the log; it just never gets its response record.  records from
+       different connections interleave, within a connection they are in order.
+    */
+
+#pragma pack(1)
+    struct DiagLogHeader {
+        char magic[8];          // "mdiaglog"
+        int version;
+
+        void init() {
+            memcpy( magic , "mdiaglog" , 8 );
+            version = 2;
+        }
+        bool valid() const {
+            return memcmp( magic , "mdiaglog" , 8 ) == 0 && version == 2;
+        }
+    };
+
+    struct DiagLogRecord {
+        enum Type { Request = 1 , Response = 2 };
+
+        int len;                          // of the whole record, this header included
+        int type;
+        unsigned connId;                  // server side connection number
+        unsigned long long startMicros;   // when the request came in, curTimeMicros64()
+        int micros;                       // time to handle it; -1 in a request record
+        int responseLen;                  // bytes sent back, 0 if there was no reply
+        long long cursorId;               // from the reply to a query or getmore, so a replay can map ids
+
+        MsgData * msg() { return (MsgData *) ( this + 1 ); }
+    };
+#pragma pack()
+
+    /* owns a record from DiagLog::start() until it's handed to finish(), so it's freed if
+       handling the request throws in between
+    */
+    class DiagLogRecordHolder : boost::noncopyable {
+    public:
+        DiagLogRecordHolder( DiagLogRecord * r ) : _r( r ) { }
+        ~DiagLogRecordHolder() { free( _r ); }
+        DiagLogRecord * release() { DiagLogRecord * r = _r; _r = 0; return r; }
+    private:
+        DiagLogRecord * _r;
+    };
+
+    /* requests are logged by connection threads into a fixed ring of slots without taking
+       any lock; a background thread writes them out.  if the ring is full the connection
+       thread waits for a slot, so the log is complete but a slow disk will slow clients.
+    */
+    class DiagLog {
+    public:
+        /* 0 = off; 1 = writes, 2 = reads, 3 = both
+           7 = log a few reads, and all writes.
+        */
+        int level;
+
+        DiagLog();
+
+        void init();
+
+        /**
+         * @return old
+         */
+        int setLevel( int newLevel );
+
+        /* waits for what has been logged so far to be written, then flushes the file */
+        void flush();
+
+        bool isOpen() const { return _f != 0; }
+
+        /* logs the request, if this level logs it, and returns its response record; 0 if
+           not logged.  pass that to finish() once the response is known.  malloc'd, and
+           finish() takes ownership.
+        */
+        DiagLogRecord * start( unsigned connId , Message& m );
+        void finish( DiagLogRecord * r , Message& request , Message * response );
+
+        enum { Slots = 4096 }; // power of 2, so slot numbers stay consistent when the counter wraps
+
+    private:
+        void push( DiagLogRecord * r );
+        void flusher();
+        bool writeSome();
+
+        struct Slot {
+            volatile unsigned seq;        // the ticket this slot is waiting for
+            DiagLogRecord * volatile r;
+        };
+
+        ofstream * _f;
+        boost::mutex _fileMutex;          // between the flusher and flush(), never held by connections
+        Slot _slots[Slots];
+        WrappingInt _head;                // next ticket to hand out
+        unsigned _tail;                   // next ticket to write, flusher only
+        WrappingInt _stalls;              // times a connection found the ring full
+    };
+
+    extern DiagLog _diaglog;
+
+} // namespace mongo
@@ -68,6 +68,164 @@ namespace mongo {
 
     DiagLog _diaglog;
 
+    DiagLog::DiagLog() : level(0) , _f(0) , _tail(0) {
+        for ( unsigned i = 0; i < Slots; i++ ) {
+            _slots[i].seq = i;
+            _slots[i].r = 0;
+        }
+    }
+
+    void DiagLog::init() {
+        if ( ! _f && level ){
+            log() << "diagLogging = " << level << endl;
+            stringstream ss;
+            ss << "diaglog." << hex << time(0);
+            string name = ss.str();
+            ofstream * f = new ofstream(name.c_str(), ios::out | ios::binary);
+            if ( ! f->good() ) {
+                problem() << "couldn't open log stream" << endl;
+                throw 1717;
+            }
+            DiagLogHeader h;
+            h.init();
+            f->write( (char *) &h , sizeof( h ) );
+            _f = f;
+            boost::thread t( boost::bind( &DiagLog::flusher , this ) );
+        }
+    }
+
+    int DiagLog::setLevel( int newLevel ){
+        int old = level;
+        level = newLevel;
+        init();
+        return old;
+    }
+
+    DiagLogRecord * DiagLog::start( unsigned connId , Message& m ) {
+        if ( ! _f )
+            return 0;
+
+        bool write;
+        int op = m.data->operation();
+        if ( op == dbQuery ) {
+            /* $cmd queries are "commands" and usually best treated as write operations */
+            write = strstr( m.data->_data + 4 , ".$cmd" ) != 0;
+        }
+        else if ( op == dbGetMore || op == dbKillCursors ) {
+            write = false;
+        }
+        else if ( op == dbInsert || op == dbUpdate || op == dbDelete ) {
+            write = true;
+        }
+        else {
+            return 0;
+        }
+
+        if ( write ) {
+            if ( ! ( level & 1 ) )
+                return 0;
+        }
+        else {
+            if ( ! ( level & 2 ) )
+                return 0;
+            bool log = (level & 4) == 0;
+            OCCASIONALLY log = true;
+            if ( ! log )
+                return 0;
+        }
+
+        int len = sizeof( DiagLogRecord ) + m.data->len;
+        DiagLogRecord * r = (DiagLogRecord *) malloc( len );
+        r->len = len;
+        r->type = DiagLogRecord::Request;
+        r->connId = connId;
+        r->startMicros = curTimeMicros64();
+        r->micros = -1;
+        r->responseLen = 0;
+        r->cursorId = 0;
+        memcpy( r->msg() , m.data , m.data->len );
+
+        // copied before the push, the flusher frees r once it's written
+        DiagLogRecord * response = (DiagLogRecord *) malloc( sizeof( DiagLogRecord ) );
+        *response = *r;
+        response->len = sizeof( DiagLogRecord );
+        response->type = DiagLogRecord::Response;
+
+        push( r );
+        return response;
+    }
+
+    void DiagLog::finish( DiagLogRecord * r , Message& request , Message * response ) {
+        if ( ! r )
+            return;
+        r->micros = (int) ( curTimeMicros64() - r->startMicros );
+        if ( response && response->data ) {
+            r->responseLen = response->data->len;
+            int op = request.data->operation();
+            if ( ( op == dbQuery || op == dbGetMore ) && response->data->len >= (int) sizeof( QueryResult ) )
+                r->cursorId = ( (QueryResult *) response->data )->cursorId;
+        }
+        push( r );
+    }
+
+    void DiagLog::push( DiagLogRecord * r ) {
+        unsigned ticket = _head.atomicIncrement();
+        Slot& s = _slots[ ticket & ( Slots - 1 ) ];
+        if ( s.seq != ticket ) {
+            // the flusher hasn't written out what was here last time round
+            _stalls.atomicIncrement();
+            while ( s.seq != ticket )
+                sleepmillis( 1 );
+        }
+        memoryBarrier(); // record contents before the pointer
+        s.r = r;
+    }
+
+    bool DiagLog::writeSome() {
+        boostlock lk( _fileMutex );
+        bool wrote = false;
+        while ( 1 ) {
+            Slot& s = _slots[ _tail & ( Slots - 1 ) ];
+            DiagLogRecord * r = s.r;
+            if ( ! r )
+                break;
+            _f->write( (char *) r , r->len );
+            free( r );
+            s.r = 0;
+            memoryBarrier();
+            s.seq = _tail + Slots;
+            _tail++;
+            wrote = true;
+        }
+        return wrote;
+    }
+
+    void DiagLog::flusher() {
+        bool dirty = false;
+        while ( 1 ) {
+            if ( writeSome() ) {
+                dirty = true;
+                continue;
+            }
+            if ( dirty ) {
+                boostlock lk( _fileMutex );
+                _f->flush();
+                dirty = false;
+            }
+            sleepmillis( 10 );
+        }
+    }
+
+    void DiagLog::flush() {
+        if ( ! _f )
+            return;
+        writeSome();
+        boostlock lk( _fileMutex );
+        _f->flush();
+        if ( (unsigned) _stalls )
+            log() << "diagLogging: connections waited " << (unsigned) _stalls << " times for the log to catch up" << endl;
+    }
+
     int opIdMem = 100000000;
 
     bool useCursors = true;
@@ -75,7 +233,7 @@ namespace mongo {
     
     void closeAllSockets();
     void flushOpLog( stringstream &ss ) {
-        if( _diaglog.f && _diaglog.f->is_open() ) {
+        if( _diaglog.isOpen() ) {
             ss << "flushing op log and files\n";
             _diaglog.flush();
         }
@@ -146,17 +304,6 @@ namespace mongo {
             if (q.fields.get() && q.fields->errmsg)
                 uassert(q.fields->errmsg, false);
 
-            /* note these are logged BEFORE authentication -- which is sort of ok */
-            if ( _diaglog.level && logit ) {
-                if ( strstr(q.ns, ".$cmd") ) {
-                    /* $cmd queries are "commands" and usually best treated as write operations */
-                    OPWRITE;
-                }
-                else {
-                    OPREAD;
-                }
-            }
-
             setClient( q.ns, dbpath, &lock );
             Client& client = cc();
             client.top.setRead();
@@ -213,7 +360,7 @@ namespace mongo {
     bool commandIsReadOnly(BSONObj& _cmdobj);
 
     // Returns false when request includes 'end'
-    bool assembleResponse( Message &m, DbResponse &dbresponse, const sockaddr_in &client ) {
+    bool assembleResponse( Message &m, DbResponse &dbresponse, const sockaddr_in &client, MessagingPort *port ) {
 
         bool writeLock = true;
 
@@ -291,7 +438,6 @@ namespace mongo {
         }
         else if ( op == dbGetMore ) {
             // does its own authorization processing.
-            OPREAD;
             DEV log = true;
             ss << "getmore ";
             if ( ! receivedGetMore(dbresponse, m, ss) )
@@ -325,7 +471,6 @@ namespace mongo {
                 uassert_nothrow("unauthorized");
             }
             else if ( op == dbInsert ) {
-                OPWRITE;
                 try {
                     ss << "insert ";
                     receivedInsert(m, ss);
@@ -337,7 +482,6 @@ namespace mongo {
                 }
             }
             else if ( op == dbUpdate ) {
-                OPWRITE;
                 try {
                     ss << "update ";
                     receivedUpdate(m, ss);
@@ -349,7 +493,6 @@ namespace mongo {
                 }
             }
             else if ( op == dbDelete ) {
-                OPWRITE;
                 try {
                     ss << "remove ";
                     receivedDelete(m, ss);
@@ -361,7 +504,6 @@ namespace mongo {
                 }
             }
             else if ( op == dbKillCursors ) {
-                OPREAD;
                 try {
                     logThreshold = 10;
                     ss << "killcursors ";
@@ -379,6 +521,26 @@ namespace mongo {
                 assert(false);
             }
         }
+
+        if ( dbresponse.response && dbresponse.response->hasPieces() ) {
+            /* the response points into the datafiles, which a writer can change as soon as we
+               unlock.  give the socket what it will take now without blocking and pin the rest:
+               it goes out after we unlock, and is only copied, outside the lock, if a writer
+               turns up first.  see ResponsePins.  only a read lock pins: where boost has no
+               shared_mutex every lock is exclusive and writers don't look at pins.
+            */
+            if ( port ) {
+                port->sayWithoutBlocking( *dbresponse.response, dbresponse.responseTo );
+                if ( dbMutex.getState() < 0 )
+                    dbresponse.response->pin();
+                else
+                    dbresponse.response->copyUnsent();
+            }
+            else {
+                dbresponse.response->consolidate();
+            }
+        }
+
         ms = t.millis();
         log = log || (logLevel >= 2 && ++ctr % 512 == 0);
         DEV log = true;
@@ -395,6 +557,9 @@ namespace mongo {
                 }
                 else {
                     string old_ns = cc().ns();
+                    // our own pin would keep us from getting the write lock
+                    if ( dbresponse.response )
+                        dbresponse.response->copyUnsent();
                     lk.releaseAndWriteLock();
                     resetClient(old_ns.c_str());
                     profile(ss.str().c_str()+20/*skip ts*/, ms);
@@ -512,17 +677,6 @@ namespace mongo {
             if (q.fields.get() && q.fields->errmsg)
                 uassert(q.fields->errmsg, false);
 
-            /* note these are logged BEFORE authentication -- which is sort of ok */
-            if ( _diaglog.level && logit ) {
-                if ( strstr(q.ns, ".$cmd") ) {
-                    /* $cmd queries are "commands" and usually best treated as write operations */
-                    OPWRITE;
-                }
-                else {
-                    OPREAD;
-                }
-            }
-
             setClient( q.ns );
             Client& client = cc();
             client.top.setRead();
@@ -578,6 +732,9 @@ namespace mongo {
     
     QueryResult* emptyMoreResult(long long);
 
+    /* longest a getMore on an Option_AwaitData cursor waits for new data before returning empty */
+    const int AwaitDataMillis = 2000;
+
     bool receivedGetMore(DbResponse& dbresponse, /*AbstractMessagingPort& dbMsgPort, */Message& m, stringstream& ss) {
         bool ok = true;
         DbMessage d(m);
@@ -590,17 +747,39 @@ namespace mongo {
         ss << " cid:" << cursorid;
         ss << " ntoreturn:" << ntoreturn;
         QueryResult* msgdata;
+        Message *resp = new Message();
         try {
             AuthenticationInfo *ai = currentClient.get()->ai;
             uassert("unauthorized", ai->isAuthorized(cc().database()->name.c_str()));
-            msgdata = getMore(ns, ntoreturn, cursorid, ss);
+            msgdata = getMore(ns, ntoreturn, cursorid, ss, resp);
+
+            /* an Option_AwaitData cursor at the end of its capped collection: rather than have
+               the client poll, wait here (unlocked) for an insert, then try again.
+            */
+            Timer t;
+            while ( msgdata->nReturned == 0 && msgdata->cursorId ) {
+                int left = AwaitDataMillis - t.millis();
+                ClientCursor *c = ClientCursor::find( cursorid , false );
+                if ( left <= 0 || c == 0 || ! c->isAwaitData() )
+                    break;
+                unsigned long long ticket = cappedInsertNotifier.prepare( ns );
+                free( msgdata );
+                msgdata = 0;
+                {
+                    dbtemprelease unlock;
+                    cappedInsertNotifier.wait( ns , ticket , left );
+                }
+                stringstream ignore;
+                resp->reset();
+                msgdata = getMore(ns, ntoreturn, cursorid, ignore, resp);
+            }
         }
         catch ( AssertionException& e ) {
             ss << " exception " + e.toString();
+            resp->reset();
             msgdata = emptyMoreResult(cursorid);
             ok = false;
         }
-        Message *resp = new Message();
         resp->setData(msgdata, true);
         ss << " bytes:" << resp->data->dataLen();
         ss << " nreturned:" << msgdata->nReturned;
@@ -24,61 +24,12 @@
 #include "security.h"
 #include "cmdline.h"
 #include "client.h"
+#include "diaglog.h"
 
 namespace mongo {
 
     extern string dbExecCommand;
 
-#define OPWRITE if( _diaglog.level & 1 ) _diaglog.write((char *) m.data, m.data->len);
-#define OPREAD if( _diaglog.level & 2 ) _diaglog.readop((char *) m.data, m.data->len);
-
-    struct DiagLog {
-        ofstream *f;
-        /* 0 = off; 1 = writes, 2 = reads, 3 = both
-           7 = log a few reads, and all writes.
-        */
-        int level;
-        DiagLog() : f(0) , level(0) { }
-        void init() {
-            if ( ! f && level ){
-                log() << "diagLogging = " << level << endl;
-                stringstream ss;
-                ss << "diaglog." << hex << time(0);
-                string name = ss.str();
-                f = new ofstream(name.c_str(), ios::out | ios::binary);
-                if ( ! f->good() ) {
-                    problem() << "couldn't open log stream" << endl;
-                    throw 1717;
-                }
-            }
-        }
-        /**
-         * @return old
-         */
-        int setLevel( int newLevel ){
-            int old = level;
-            level = newLevel;
-            init();
-            return old;
-        }
-        void flush() {
-            if ( level ) f->flush();
-        }
-        void write(char *data,int len) {
-            if ( level & 1 ) f->write(data,len);
-        }
-        void readop(char *data, int len) {
-            if ( level & 2 ) {
-                bool log = (level & 4) == 0;
-                OCCASIONALLY log = true;
-                if ( log )
-                    f->write(data,len);
-            }
-        }
-    };
-
-    extern DiagLog _diaglog;
-
     /* we defer response until we unlock.  don't want a blocked socket to
        keep things locked.
     */
@@ -97,7 +48,10 @@ namespace mongo {
 
     static SockAddr unknownAddress( "0.0.0.0", 0 );
     
-    bool assembleResponse( Message &m, DbResponse &dbresponse, const sockaddr_in &client = unknownAddress.sa );
+    /* port, if given, is where the response will go.  a response that refers to records in place
+       (see Message::appendPiece) is started on it while we still hold the lock.
+    */
+    bool assembleResponse( Message &m, DbResponse &dbresponse, const sockaddr_in &client = unknownAddress.sa, MessagingPort *port = 0 );
 
     void getDatabaseNames( vector< string > &names );
 
@@ -412,6 +412,67 @@ namespace mongo {
         return totalSize;
     }
 
+    /* FNV-1a */
+    inline unsigned long long hashBytes( unsigned long long h , const void * p , int len ) {
+        const unsigned char * c = (const unsigned char *) p;
+        for ( int i = 0; i < len; i++ ) {
+            h ^= c[i];
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    long long BSONElement::hash64() const {
+        unsigned long long h = 14695981039346656037ULL;
+        int t = eoo() ? 5 : canonicalType(); // missing hashes like null
+        h = hashBytes( h , &t , sizeof( t ) );
+        switch ( type() ) {
+        case EOO:
+        case Undefined:
+        case jstNULL:
+        case MinKey:
+        case MaxKey:
+            break;
+        case NumberDouble:
+        case NumberInt:
+        case NumberLong: {
+            double d = number();
+            if ( d == 0 )
+                d = 0; // -0.0 == 0.0
+            h = hashBytes( h , &d , sizeof( d ) );
+            break;
+        }
+        case String:
+        case Symbol:
+            h = hashBytes( h , valuestr() , valuestrsize() - 1 );
+            break;
+        case Object:
+        case Array: {
+            // field by field, so objects that compare equal ( { a : 5 } and { a : 5.0 } ) hash alike
+            BSONObjIterator i( embeddedObject() );
+            while ( i.more() ) {
+                BSONElement e = i.next();
+                if ( e.eoo() )
+                    break;
+                h = hashBytes( h , e.fieldName() , strlen( e.fieldName() ) + 1 );
+                long long sub = e.hash64();
+                h = hashBytes( h , &sub , sizeof( sub ) );
+            }
+            break;
+        }
+        default:
+            h = hashBytes( h , value() , valuesize() );
+        }
+
+        // FNV leaves the high bits poorly mixed for short values, and chunks split on them
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return (long long) h;
+    }
+
     int BSONElement::getGtLtOp( int def ) const {
         const char *fn = fieldName();
         if ( fn[0] == '$' && fn[1] ) {
@@ -445,6 +506,10 @@ namespace mongo {
                 return BSONObj::opREGEX;
             else if ( fn[1] == 'o' && fn[2] == 'p' && fn[3] == 't' && fn[4] == 'i' && fn[5] == 'o' && fn[6] == 'n' && fn[7] == 's' && fn[8] == 0 )
                 return BSONObj::opOPTIONS;
+            else if ( fn[1] == 'h' && strcmp( fn + 2 , "ashed" ) == 0 )
+                return BSONObj::opHASHED;
+            else if ( fn[1] == 'r' && strcmp( fn + 2 , "anges" ) == 0 )
+                return BSONObj::opRANGES;
         }
         return def;
     }
@@ -549,6 +549,12 @@ namespace mongo {
             return match && canonicalType() == r.canonicalType();
         }
 
+        /** 64 bit hash of the value, for hashed indexes and shard keys.
+            values that are equal by valuesEqual() hash the same, e.g. 5, 5.0 and NumberLong(5).
+            a missing (eoo) element hashes like null.
+        */
+        long long hash64() const;
+
         /** Returns true if elements are equal. */
         bool operator==(const BSONElement& r) const {
             if ( strcmp(fieldName(), r.fieldName()) != 0 )
@@ -976,10 +982,18 @@ namespace mongo {
             opMOD = 0x0E,
             opTYPE = 0x0F,
             opREGEX = 0x10,
-            opOPTIONS = 0x11
+            opOPTIONS = 0x11,
+            opHASHED = 0x12, // { x : { $hashed : [ min , max ] } } - hash of x in [min,max).  or [ [ min , max ] , ... ], in any of them
+            opRANGES = 0x13  // { x : { $ranges : [ [ min , max ] , ... ] } } - x in any of the [min,max)
         };        
     };
     ostream& operator<<( ostream &s, const BSONObj &o );
+
+    /** { x : "hashed" } - an index or shard key on the hash64() of x rather than its value */
+    inline bool isHashedKeyPattern( const BSONObj& pattern ) {
+        BSONElement e = pattern.firstElement();
+        return e.type() == String && strcmp( e.valuestr() , "hashed" ) == 0;
+    }
     ostream& operator<<( ostream &s, const BSONElement &e );
 
     struct BSONArray: BSONObj {
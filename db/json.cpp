@@ -21,149 +21,8 @@
 #include "../util/builder.h"
 #include "../util/base64.h"
 
-using namespace boost::spirit;
-
 namespace mongo {
 
-    struct ObjectBuilder {
-        BSONObjBuilder *back() {
-            return builders.back().get();
-        }
-        // Storage for field names of elements within builders.back().
-        const char *fieldName() {
-            return fieldNames.back().c_str();
-        }
-        bool empty() const {
-            return builders.size() == 0;
-        }
-        void init() {
-            boost::shared_ptr< BSONObjBuilder > b( new BSONObjBuilder() );
-            builders.push_back( b );
-            fieldNames.push_back( "" );
-            indexes.push_back( 0 );
-        }
-        void pushObject( const char *fieldName ) {
-            boost::shared_ptr< BSONObjBuilder > b( new BSONObjBuilder( builders.back()->subobjStart( fieldName ) ) );
-            builders.push_back( b );
-            fieldNames.push_back( "" );
-            indexes.push_back( 0 );
-        }
-        void pushArray( const char *fieldName ) {
-            boost::shared_ptr< BSONObjBuilder > b( new BSONObjBuilder( builders.back()->subarrayStart( fieldName ) ) );
-            builders.push_back( b );
-            fieldNames.push_back( "" );
-            indexes.push_back( 0 );
-        }
-        BSONObj pop() {
-            BSONObj ret;
-            if ( back()->owned() )
-                ret = back()->obj();
-            else
-                ret = back()->done();
-            builders.pop_back();
-            fieldNames.pop_back();
-            indexes.pop_back();
-            return ret;
-        }
-        void nameFromIndex() {
-            fieldNames.back() = BSONObjBuilder::numStr( indexes.back() );
-        }
-        string popString() {
-            string ret = ss.str();
-            ss.str( "" );
-            return ret;
-        }
-        // Cannot use auto_ptr because its copy constructor takes a non const reference.
-        vector< boost::shared_ptr< BSONObjBuilder > > builders;
-        vector< string > fieldNames;
-        vector< int > indexes;
-        stringstream ss;
-        string ns;
-        OID oid;
-        string binData;
-        BinDataType binDataType;
-        string regex;
-        string regexOptions;
-        Date_t date;
-    };
-
-    struct objectStart {
-        objectStart( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char &c ) const {
-            if ( b.empty() )
-                b.init();
-            else
-                b.pushObject( b.fieldName() );
-        }
-        ObjectBuilder &b;
-    };
-
-    struct arrayStart {
-        arrayStart( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char &c ) const {
-            b.pushArray( b.fieldName() );
-            b.nameFromIndex();
-        }
-        ObjectBuilder &b;
-    };
-
-    struct arrayNext {
-        arrayNext( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char &c ) const {
-            ++b.indexes.back();
-            b.nameFromIndex();
-        }
-        ObjectBuilder &b;
-    };
-
-    struct ch {
-        ch( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char c ) const {
-            b.ss << c;
-        }
-        ObjectBuilder &b;
-    };
-
-    struct chE {
-        chE( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char c ) const {
-            char o = '\0';
-            switch ( c ) {
-            case '\"':
-                o = '\"';
-                break;
-            case '\'':
-                o = '\'';
-                break;
-            case '\\':
-                o = '\\';
-                break;
-            case '/':
-                o = '/';
-                break;
-            case 'b':
-                o = '\b';
-                break;
-            case 'f':
-                o = '\f';
-                break;
-            case 'n':
-                o = '\n';
-                break;
-            case 'r':
-                o = '\r';
-                break;
-            case 't':
-                o = '\t';
-                break;
-            default:
-                assert( false );
-            }
-            b.ss << o;
-        }
-        ObjectBuilder &b;
-    };
-
     namespace hex {
         int val( char c ) {
             if ( '0' <= c && c <= '9' )
@@ -178,134 +37,10 @@ namespace mongo {
         char val( const char *c ) {
             return ( val( c[ 0 ] ) << 4 ) | val( c[ 1 ] );
         }
-    } // namespace hex
-
-    struct chU {
-        chU( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            unsigned char first = hex::val( start );
-            unsigned char second = hex::val( start + 2 );
-            if ( first == 0 && second < 0x80 )
-                b.ss << second;
-            else if ( first < 0x08 ) {
-                b.ss << char( 0xc0 | ( ( first << 2 ) | ( second >> 6 ) ) );
-                b.ss << char( 0x80 | ( ~0xc0 & second ) );
-            } else {
-                b.ss << char( 0xe0 | ( first >> 4 ) );
-                b.ss << char( 0x80 | ( ~0xc0 & ( ( first << 2 ) | ( second >> 6 ) ) ) );
-                b.ss << char( 0x80 | ( ~0xc0 & second ) );
-            }
-        }
-        ObjectBuilder &b;
-    };
-
-    struct chClear {
-        chClear( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char c ) const {
-            b.popString();
-        }
-        ObjectBuilder &b;
-    };
-
-    struct fieldNameEnd {
-        fieldNameEnd( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            string name = b.popString();
-            massert( "Invalid use of reserved field name",
-                     name != "$oid" &&
-                     name != "$binary" &&
-                     name != "$type" &&
-                     name != "$date" &&
-                     name != "$regex" &&
-                     name != "$options" );
-            b.fieldNames.back() = name;
-        }
-        ObjectBuilder &b;
-    };
-
-    struct unquotedFieldNameEnd {
-        unquotedFieldNameEnd( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            string name( start, end );
-            b.fieldNames.back() = name;
-        }
-        ObjectBuilder &b;
-    };
-
-    struct stringEnd {
-        stringEnd( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            b.back()->append( b.fieldName(), b.popString() );
-        }
-        ObjectBuilder &b;
-    };
-
-    struct numberValue {
-        numberValue( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( double d ) const {
-            b.back()->append( b.fieldName(), d );
-        }
-        ObjectBuilder &b;
-    };
-
-    struct intValue {
-        intValue( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( long long num ) const {
-            if (num >= numeric_limits<int>::min() && num <= numeric_limits<int>::max())
-                b.back()->append( b.fieldName(), (int)num );
-            else
-                b.back()->append( b.fieldName(), num );
-        }
-        ObjectBuilder &b;
-    };
-
-    struct subobjectEnd {
-        subobjectEnd( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            b.pop();
-        }
-        ObjectBuilder &b;
-    };
-
-    struct arrayEnd {
-        arrayEnd( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            b.pop();
-        }
-        ObjectBuilder &b;
-    };
-
-    struct trueValue {
-        trueValue( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            b.back()->appendBool( b.fieldName(), true );
-        }
-        ObjectBuilder &b;
-    };
-
-    struct falseValue {
-        falseValue( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            b.back()->appendBool( b.fieldName(), false );
-        }
-        ObjectBuilder &b;
-    };
-
-    struct nullValue {
-        nullValue( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            b.back()->appendNull( b.fieldName() );
+        bool is( char c ) {
+            return ( '0' <= c && c <= '9' ) || ( 'a' <= c && c <= 'f' ) || ( 'A' <= c && c <= 'F' );
         }
-        ObjectBuilder &b;
-    };
-
-    struct dbrefNS {
-        dbrefNS( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            b.ns = b.popString();
-        }
-        ObjectBuilder &b;
-    };
+    } // namespace hex
 
 // NOTE s must be 24 characters.
     OID stringToOid( const char *s ) {
@@ -316,243 +51,500 @@ namespace mongo {
         return oid;
     }
 
-    struct oidValue {
-        oidValue( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            b.oid = stringToOid( start );
-        }
-        ObjectBuilder &b;
-    };
-
-    struct dbrefEnd {
-        dbrefEnd( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            b.back()->appendDBRef( b.fieldName(), b.ns.c_str(), b.oid );
-        }
-        ObjectBuilder &b;
-    };
-
-    struct oidEnd {
-        oidEnd( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            b.back()->appendOID( b.fieldName(), &b.oid );
-        }
-        ObjectBuilder &b;
-    };
+    inline bool isSpace( char c ) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    }
+    inline bool isDigit( char c ) {
+        return '0' <= c && c <= '9';
+    }
+    inline bool isAlpha( char c ) {
+        return ( 'a' <= c && c <= 'z' ) || ( 'A' <= c && c <= 'Z' );
+    }
+    inline bool isBase64( char c ) {
+        return isAlpha( c ) || isDigit( c ) || c == '+' || c == '/';
+    }
 
-    struct binDataBinary {
-        binDataBinary( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            massert( "Badly formatted bindata", ( end - start ) % 4 == 0 );
-            string encoded( start, end );
-            b.binData = base64::decode( encoded );
+    /* Recursive descent parser for the language fromjson() accepts.  Values are appended
+       straight to the builder of the object they belong to, so nothing is built twice.
+
+       Whitespace may appear between any two tokens, but not inside strings, numbers,
+       unquoted field names or keywords.  The extended forms written as objects
+       ( { "$oid" : ... } etc ) are recognized by their first field name; if the rest
+       doesn't fit the form, the object is reparsed as an ordinary one, where the
+       reserved field names are an error.  That's the only backtracking.
+    */
+    class JParse {
+    public:
+        JParse( const char *str ) : _p( str ) {}
+
+        BSONObj parse() {
+            BSONObjBuilder b;
+            skip();
+            if ( *_p != '{' )
+                fail();
+            object( b );
+            skip();
+            if ( *_p )
+                fail();
+            return b.obj();
+        }
+
+    private:
+        void fail() {
+            int len = strlen( _p );
+            if ( len > 10 )
+                len = 10;
+            stringstream ss;
+            ss << "Failure parsing JSON string near: " << string( _p, len );
+            massert( ss.str(), false );
         }
-        ObjectBuilder &b;
-    };
 
-    struct binDataType {
-        binDataType( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            b.binDataType = BinDataType( hex::val( start ) );
+        void skip() {
+            while ( isSpace( *_p ) )
+                ++_p;
+        }
+
+        bool accept( char c ) {
+            skip();
+            if ( *_p != c )
+                return false;
+            ++_p;
+            return true;
+        }
+
+        void expect( char c ) {
+            if ( !accept( c ) )
+                fail();
+        }
+
+        // lit is matched as a whole, after any whitespace
+        bool acceptLiteral( const char *lit ) {
+            skip();
+            const char *p = _p;
+            for ( ; *lit; ++lit, ++p )
+                if ( *p != *lit )
+                    return false;
+            _p = p;
+            return true;
+        }
+
+        /* object, starting at its '{' */
+        void object( BSONObjBuilder &b ) {
+            ++_p;
+            if ( accept( '}' ) )
+                return;
+            string name;
+            do {
+                fieldName( name );
+                expect( ':' );
+                value( b, name.c_str() );
+            } while ( accept( ',' ) );
+            expect( '}' );
+        }
+
+        /* array, starting at its '[' */
+        void array( BSONObjBuilder &b ) {
+            ++_p;
+            if ( accept( ']' ) )
+                return;
+            int i = 0;
+            do {
+                value( b, BSONObjBuilder::numStr( i++ ).c_str() );
+            } while ( accept( ',' ) );
+            expect( ']' );
+        }
+
+        void fieldName( string &name ) {
+            skip();
+            if ( *_p == '"' || *_p == '\'' ) {
+                if ( !quoted( *_p, name ) )
+                    fail();
+                massert( "Invalid use of reserved field name",
+                         name != "$oid" &&
+                         name != "$binary" &&
+                         name != "$type" &&
+                         name != "$date" &&
+                         name != "$regex" &&
+                         name != "$options" );
+                return;
+            }
+            // We allow a subset of valid js identifier names here.
+            const char *start = _p;
+            if ( !( isAlpha( *_p ) || *_p == '$' || *_p == '_' ) )
+                fail();
+            ++_p;
+            while ( isAlpha( *_p ) || isDigit( *_p ) || *_p == '$' || *_p == '_' )
+                ++_p;
+            name.assign( start, _p - start );
+        }
+
+        void value( BSONObjBuilder &b, const char *name ) {
+            skip();
+            switch ( *_p ) {
+            case '{': {
+                if ( extendedObject( b, name ) )
+                    return;
+                BSONObjBuilder sub( b.subobjStart( name ) );
+                object( sub );
+                sub.done();
+                return;
+            }
+            case '[': {
+                BSONObjBuilder sub( b.subarrayStart( name ) );
+                array( sub );
+                sub.done();
+                return;
+            }
+            case '"':
+            case '\'':
+                if ( !quoted( *_p, _str ) )
+                    fail();
+                b.append( name, _str.c_str() );
+                return;
+            case '/':
+                regex( b, name );
+                return;
+            case 'O':
+                if ( !( acceptLiteral( "ObjectId" ) && accept( '(' ) && quotedOid() && accept( ')' ) ) )
+                    fail();
+                b.appendOID( name, &_oid );
+                return;
+            case 'D':
+                if ( acceptLiteral( "Dbref" ) ) {
+                    if ( !( accept( '(' ) && quoted( '"', _ns ) && accept( ',' ) && quotedOid() && accept( ')' ) ) )
+                        fail();
+                    b.appendDBRef( name, _ns.c_str(), _oid );
+                    return;
+                }
+                if ( !( acceptLiteral( "Date" ) && accept( '(' ) && date() && accept( ')' ) ) )
+                    fail();
+                b.appendDate( name, _date );
+                return;
+            case 't':
+                if ( !keyword( "true" ) )
+                    fail();
+                b.appendBool( name, true );
+                return;
+            case 'f':
+                if ( !keyword( "false" ) )
+                    fail();
+                b.appendBool( name, false );
+                return;
+            case 'n':
+                if ( !keyword( "null" ) )
+                    fail();
+                b.appendNull( name );
+                return;
+            default:
+                number( b, name );
+            }
         }
-        ObjectBuilder &b;
-    };
 
-    struct binDataEnd {
-        binDataEnd( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            b.back()->appendBinData( b.fieldName(), b.binData.length(),
-                                     b.binDataType, b.binData.data() );
-        }
-        ObjectBuilder &b;
-    };
+        bool keyword( const char *k ) {
+            int len = strlen( k );
+            if ( strncmp( _p, k, len ) != 0 )
+                return false;
+            _p += len;
+            return true;
+        }
+
+        /* { "$oid" : ... } and friends.  leaves _p alone and returns false if the object
+           at _p isn't one of them */
+        bool extendedObject( BSONObjBuilder &b, const char *name ) {
+            const char *start = _p;
+            ++_p;
+            if ( acceptLiteral( "\"$oid\"" ) ) {
+                if ( accept( ':' ) && quotedOid() && accept( '}' ) ) {
+                    b.appendOID( name, &_oid );
+                    return true;
+                }
+            }
+            else if ( acceptLiteral( "\"$ref\"" ) ) {
+                if ( accept( ':' ) && quoted( '"', _ns ) && accept( ',' ) && acceptLiteral( "\"$id\"" ) &&
+                     accept( ':' ) && quotedOid() && accept( '}' ) ) {
+                    b.appendDBRef( name, _ns.c_str(), _oid );
+                    return true;
+                }
+            }
+            else if ( acceptLiteral( "\"$binary\"" ) ) {
+                if ( accept( ':' ) && binData() && accept( ',' ) && acceptLiteral( "\"$type\"" ) &&
+                     accept( ':' ) && binDataType() && accept( '}' ) ) {
+                    b.appendBinData( name, _binData.length(), _binDataType, _binData.data() );
+                    return true;
+                }
+            }
+            else if ( acceptLiteral( "\"$date\"" ) ) {
+                if ( accept( ':' ) && date() && accept( '}' ) ) {
+                    b.appendDate( name, _date );
+                    return true;
+                }
+            }
+            else if ( acceptLiteral( "\"$regex\"" ) ) {
+                if ( accept( ':' ) && quoted( '"', _str ) && accept( ',' ) && acceptLiteral( "\"$options\"" ) &&
+                     accept( ':' ) && regexOptionsStr() && accept( '}' ) ) {
+                    b.appendRegex( name, _str.c_str(), _options.c_str() );
+                    return true;
+                }
+            }
+            _p = start;
+            return false;
+        }
+
+        bool quotedOid() {
+            skip();
+            if ( *_p != '"' )
+                return false;
+            for ( int i = 1; i <= 24; ++i )
+                if ( !hex::is( _p[ i ] ) )
+                    return false;
+            if ( _p[ 25 ] != '"' )
+                return false;
+            _oid = stringToOid( _p + 1 );
+            _p += 26;
+            return true;
+        }
+
+        bool binData() {
+            skip();
+            if ( *_p != '"' )
+                return false;
+            const char *start = ++_p;
+            while ( isBase64( *_p ) )
+                ++_p;
+            while ( *_p == '=' )
+                ++_p;
+            if ( *_p != '"' )
+                return false;
+            massert( "Badly formatted bindata", ( _p - start ) % 4 == 0 );
+            _binData = base64::decode( string( start, _p - start ) );
+            ++_p;
+            return true;
+        }
+
+        bool binDataType() {
+            skip();
+            if ( _p[ 0 ] != '"' || !hex::is( _p[ 1 ] ) || !hex::is( _p[ 2 ] ) || _p[ 3 ] != '"' )
+                return false;
+            _binDataType = BinDataType( hex::val( _p + 1 ) );
+            _p += 4;
+            return true;
+        }
+
+        // TODO: this will need to be signed at some point
+        bool date() {
+            skip();
+            if ( !isDigit( *_p ) )
+                return false;
+            unsigned long long d = 0;
+            while ( isDigit( *_p ) ) {
+                unsigned digit = *_p - '0';
+                if ( d > ( numeric_limits< unsigned long long >::max() - digit ) / 10 )
+                    return false;
+                d = d * 10 + digit;
+                ++_p;
+            }
+            _date = d;
+            return true;
+        }
+
+        bool regexOptionsStr() {
+            skip();
+            if ( *_p != '"' )
+                return false;
+            const char *start = ++_p;
+            while ( isAlpha( *_p ) )
+                ++_p;
+            if ( *_p != '"' )
+                return false;
+            _options.assign( start, _p - start );
+            ++_p;
+            return true;
+        }
+
+        /* /regex/options */
+        void regex( BSONObjBuilder &b, const char *name ) {
+            if ( !quoted( '/', _str ) )
+                fail();
+            const char *start = _p;
+            while ( *_p == 'i' || *_p == 'g' || *_p == 'm' )
+                ++_p;
+            _options.assign( start, _p - start );
+            b.appendRegex( name, _str.c_str(), _options.c_str() );
+        }
+
+        /* a string between quote characters, after any whitespace.  quote is one
+           of " ' or /, and is the one character that may be escaped besides the usual JSON
+           escapes (for / that's \" as well, / being a usual one).
+        */
+        bool quoted( char quote, string &out ) {
+            skip();
+            if ( *_p != quote )
+                return false;
+            const char *p = _p + 1;
+            // the common case, nothing to unescape
+            const char *q = p;
+            while ( *q != quote && *q != '\\' && (unsigned char)*q >= 0x20 )
+                ++q;
+            if ( *q == quote ) {
+                out.assign( p, q - p );
+                _p = q + 1;
+                return true;
+            }
 
-    struct dateValue {
-        dateValue( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( Date_t v ) const {
-            b.date = v;
+            out.assign( p, q - p );
+            p = q;
+            while ( *p != quote ) {
+                if ( (unsigned char)*p < 0x20 )
+                    return false; // control character, or the end of the input
+                if ( *p != '\\' ) {
+                    out += *p++;
+                    continue;
+                }
+                ++p;
+                char c = *p++;
+                switch ( c ) {
+                case '\\':
+                case '/':
+                    out += c;
+                    break;
+                case 'b':
+                    out += '\b';
+                    break;
+                case 'f':
+                    out += '\f';
+                    break;
+                case 'n':
+                    out += '\n';
+                    break;
+                case 'r':
+                    out += '\r';
+                    break;
+                case 't':
+                    out += '\t';
+                    break;
+                case 'u':
+                    for ( int i = 0; i < 4; ++i )
+                        if ( !hex::is( p[ i ] ) )
+                            return false;
+                    appendUtf8( out, p );
+                    p += 4;
+                    break;
+                default:
+                    if ( c == ( quote == '\'' ? '\'' : '"' ) ) {
+                        out += c;
+                        break;
+                    }
+                    return false;
+                }
+            }
+            _p = p + 1;
+            return true;
         }
-        ObjectBuilder &b;
-    };
 
-    struct dateEnd {
-        dateEnd( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            b.back()->appendDate( b.fieldName(), b.date );
+        /* \uXXXX, from the 4 hex digits at u */
+        static void appendUtf8( string &out, const char *u ) {
+            unsigned char first = hex::val( u );
+            unsigned char second = hex::val( u + 2 );
+            if ( first == 0 && second < 0x80 )
+                out += second;
+            else if ( first < 0x08 ) {
+                out += char( 0xc0 | ( ( first << 2 ) | ( second >> 6 ) ) );
+                out += char( 0x80 | ( ~0xc0 & second ) );
+            } else {
+                out += char( 0xe0 | ( first >> 4 ) );
+                out += char( 0x80 | ( ~0xc0 & ( ( first << 2 ) | ( second >> 6 ) ) ) );
+                out += char( 0x80 | ( ~0xc0 & second ) );
+            }
         }
-        ObjectBuilder &b;
-    };
 
-    struct regexValue {
-        regexValue( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            b.regex = b.popString();
-        }
-        ObjectBuilder &b;
-    };
+        /* a double if there's a '.' or an exponent, otherwise an int, or a long long if it
+           won't fit.  numbers with nonsignificant zero prefixes, which aren't allowed in
+           JSON, are accepted.
+        */
+        void number( BSONObjBuilder &b, const char *name ) {
+            const char *p = _p;
+            if ( *p == '+' || *p == '-' )
+                ++p;
+            const char *digits = p;
+            while ( isDigit( *p ) )
+                ++p;
+            bool gotNumber = p != digits;
+            bool real = false;
+            if ( *p == '.' ) {
+                const char *frac = ++p;
+                while ( isDigit( *p ) )
+                    ++p;
+                real = gotNumber || p != frac;
+            }
+            else {
+                real = gotNumber && ( *p == 'e' || *p == 'E' );
+            }
+            if ( real && ( *p == 'e' || *p == 'E' ) ) {
+                const char *e = p + 1;
+                if ( *e == '+' || *e == '-' )
+                    ++e;
+                if ( isDigit( *e ) ) {
+                    while ( isDigit( *e ) )
+                        ++e;
+                    p = e;
+                }
+                else {
+                    real = false;
+                }
+            }
+            if ( real ) {
+                b.append( name, strtod( _p, 0 ) );
+                _p = p;
+                return;
+            }
 
-    struct regexOptions {
-        regexOptions( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            b.regexOptions = string( start, end );
+            long long n;
+            if ( !integer( n ) )
+                fail();
+            if ( n >= numeric_limits< int >::min() && n <= numeric_limits< int >::max() )
+                b.append( name, (int)n );
+            else
+                b.append( name, n );
+        }
+
+        /* at most 19 digits, as with a long long */
+        bool integer( long long &n ) {
+            const char *p = _p;
+            bool neg = false;
+            if ( *p == '+' || *p == '-' )
+                neg = *p++ == '-';
+            if ( !isDigit( *p ) )
+                return false;
+            unsigned long long limit = neg ? 1ULL + numeric_limits< long long >::max() : numeric_limits< long long >::max();
+            unsigned long long u = 0;
+            for ( int i = 0; i < numeric_limits< long long >::digits10 + 1 && isDigit( *p ); ++i, ++p ) {
+                unsigned digit = *p - '0';
+                if ( u > ( limit - digit ) / 10 )
+                    return false;
+                u = u * 10 + digit;
+            }
+            n = neg ? -(long long)( u - 1 ) - 1 : (long long)u;
+            _p = p;
+            return true;
         }
-        ObjectBuilder &b;
-    };
 
-    struct regexEnd {
-        regexEnd( ObjectBuilder &_b ) : b( _b ) {}
-        void operator() ( const char *start, const char *end ) const {
-            b.back()->appendRegex( b.fieldName(), b.regex.c_str(),
-                                   b.regexOptions.c_str() );
-        }
-        ObjectBuilder &b;
-    };
+        const char *_p;
 
-// One gotcha with this parsing library is probably best ilustrated with an
-// example.  Say we have a production like this:
-// z = ( ch_p( 'a' )[ foo ] >> ch_p( 'b' ) ) | ( ch_p( 'a' )[ foo ] >> ch_p( 'c' ) );
-// On input "ac", action foo() will be called twice -- once as the parser tries
-// to match "ab", again as the parser successfully matches "ac".  Sometimes
-// the grammar can be modified to eliminate these situations.  Here, for example:
-// z = ch_p( 'a' )[ foo ] >> ( ch_p( 'b' ) | ch_p( 'c' ) );
-// However, this is not always possible.  In my implementation I've tried to
-// stick to the following pattern: store fields fed to action callbacks
-// temporarily as ObjectBuilder members, then append to a BSONObjBuilder once
-// the parser has completely matched a nonterminal and won't backtrack.  It's
-// worth noting here that this parser follows a short-circuit convention.  So,
-// in the original z example on line 3, if the input was "ab", foo() would only
-// be called once.
-    struct JsonGrammar : public grammar< JsonGrammar > {
-public:
-        JsonGrammar( ObjectBuilder &_b ) : b( _b ) {}
-
-        template < typename ScannerT >
-        struct definition {
-            definition( JsonGrammar const &self ) {
-                object = ch_p( '{' )[ objectStart( self.b ) ] >> !members >> '}';
-                members = list_p((fieldName >> ':' >> value) , ',');
-                fieldName =
-                    str[ fieldNameEnd( self.b ) ] |
-                    singleQuoteStr[ fieldNameEnd( self.b ) ] |
-                    unquotedFieldName[ unquotedFieldNameEnd( self.b ) ];
-                array = ch_p( '[' )[ arrayStart( self.b ) ] >> !elements >> ']';
-                elements = list_p(value, ch_p(',')[arrayNext( self.b )]);
-                value =
-                    oid[ oidEnd( self.b ) ] |
-                    dbref[ dbrefEnd( self.b ) ] |
-                    bindata[ binDataEnd( self.b ) ] |
-                    date[ dateEnd( self.b ) ] |
-                    regex[ regexEnd( self.b ) ] |
-                    str[ stringEnd( self.b ) ] |
-                    singleQuoteStr[ stringEnd( self.b ) ] |
-                    number |
-                    integer |
-                    object[ subobjectEnd( self.b ) ] |
-                    array[ arrayEnd( self.b ) ] |
-                    lexeme_d[ str_p( "true" ) ][ trueValue( self.b ) ] |
-                    lexeme_d[ str_p( "false" ) ][ falseValue( self.b ) ] |
-                    lexeme_d[ str_p( "null" ) ][ nullValue( self.b ) ];
-                // NOTE lexeme_d and rules don't mix well, so we have this mess.
-                // NOTE We use range_p rather than cntrl_p, because the latter is locale dependent.
-                str = lexeme_d[ ch_p( '"' )[ chClear( self.b ) ] >>
-                                *( ( ch_p( '\\' ) >>
-                                     ( ch_p( '"' )[ chE( self.b ) ] |
-                                       ch_p( '\\' )[ chE( self.b ) ] |
-                                       ch_p( '/' )[ chE( self.b ) ] |
-                                       ch_p( 'b' )[ chE( self.b ) ] |
-                                       ch_p( 'f' )[ chE( self.b ) ] |
-                                       ch_p( 'n' )[ chE( self.b ) ] |
-                                       ch_p( 'r' )[ chE( self.b ) ] |
-                                       ch_p( 't' )[ chE( self.b ) ] |
-                                       ( ch_p( 'u' ) >> ( repeat_p( 4 )[ xdigit_p ][ chU( self.b ) ] ) ) ) ) |
-                                   ( ~range_p( 0x00, 0x1f ) & ~ch_p( '"' ) & ( ~ch_p( '\\' ) )[ ch( self.b ) ] ) ) >> '"' ];
-
-                singleQuoteStr = lexeme_d[ ch_p( '\'' )[ chClear( self.b ) ] >>
-                                *( ( ch_p( '\\' ) >>
-                                     ( ch_p( '\'' )[ chE( self.b ) ] |
-                                       ch_p( '\\' )[ chE( self.b ) ] |
-                                       ch_p( '/' )[ chE( self.b ) ] |
-                                       ch_p( 'b' )[ chE( self.b ) ] |
-                                       ch_p( 'f' )[ chE( self.b ) ] |
-                                       ch_p( 'n' )[ chE( self.b ) ] |
-                                       ch_p( 'r' )[ chE( self.b ) ] |
-                                       ch_p( 't' )[ chE( self.b ) ] |
-                                       ( ch_p( 'u' ) >> ( repeat_p( 4 )[ xdigit_p ][ chU( self.b ) ] ) ) ) ) |
-                                   ( ~range_p( 0x00, 0x1f ) & ~ch_p( '\'' ) & ( ~ch_p( '\\' ) )[ ch( self.b ) ] ) ) >> '\'' ];
-
-                // real_p accepts numbers with nonsignificant zero prefixes, which
-                // aren't allowed in JSON.  Oh well.
-                number = strict_real_p[ numberValue( self.b ) ];
-
-                static int_parser<long long, 10,  1, numeric_limits<long long>::digits10 + 1> long_long_p;
-                integer = long_long_p[ intValue(self.b) ];
-
-                // We allow a subset of valid js identifier names here.
-                unquotedFieldName = lexeme_d[ ( alpha_p | ch_p( '$' ) | ch_p( '_' ) ) >> *( ( alnum_p | ch_p( '$' ) | ch_p( '_'  )) ) ];
-
-                dbref = dbrefS | dbrefT;
-                dbrefS = ch_p( '{' ) >> "\"$ref\"" >> ':' >>
-                         str[ dbrefNS( self.b ) ] >> ',' >> "\"$id\"" >> ':' >> quotedOid >> '}';
-                dbrefT = str_p( "Dbref" ) >> '(' >> str[ dbrefNS( self.b ) ] >> ',' >>
-                         quotedOid >> ')';
-
-                oid = oidS | oidT;
-                oidS = ch_p( '{' ) >> "\"$oid\"" >> ':' >> quotedOid >> '}';
-                oidT = str_p( "ObjectId" ) >> '(' >> quotedOid >> ')';
-
-                quotedOid = lexeme_d[ '"' >> ( repeat_p( 24 )[ xdigit_p ] )[ oidValue( self.b ) ] >> '"' ];
-
-                bindata = ch_p( '{' ) >> "\"$binary\"" >> ':' >>
-                          lexeme_d[ '"' >> ( *( range_p( 'A', 'Z' ) | range_p( 'a', 'z' ) | range_p( '0', '9' ) | ch_p( '+' ) | ch_p( '/' ) ) >> *ch_p( '=' ) )[ binDataBinary( self.b ) ] >> '"' ] >> ',' >> "\"$type\"" >> ':' >>
-                          lexeme_d[ '"' >> ( repeat_p( 2 )[ xdigit_p ] )[ binDataType( self.b ) ] >> '"' ] >> '}';
-
-                // TODO: this will need to use a signed parser at some point
-                date = dateS | dateT;
-                dateS = ch_p( '{' ) >> "\"$date\"" >> ':' >> uint_parser< Date_t >()[ dateValue( self.b ) ] >> '}';
-                dateT = str_p( "Date" ) >> '(' >> uint_parser< Date_t >()[ dateValue( self.b ) ] >> ')';
-
-                regex = regexS | regexT;
-                regexS = ch_p( '{' ) >> "\"$regex\"" >> ':' >> str[ regexValue( self.b ) ] >> ',' >> "\"$options\"" >> ':' >> lexeme_d[ '"' >> ( *( alpha_p ) )[ regexOptions( self.b ) ] >> '"' ] >> '}';
-                // FIXME Obviously it would be nice to unify this with str.
-                regexT = lexeme_d[ ch_p( '/' )[ chClear( self.b ) ] >>
-                                   *( ( ch_p( '\\' ) >>
-                                        ( ch_p( '"' )[ chE( self.b ) ] |
-                                          ch_p( '\\' )[ chE( self.b ) ] |
-                                          ch_p( '/' )[ chE( self.b ) ] |
-                                          ch_p( 'b' )[ chE( self.b ) ] |
-                                          ch_p( 'f' )[ chE( self.b ) ] |
-                                          ch_p( 'n' )[ chE( self.b ) ] |
-                                          ch_p( 'r' )[ chE( self.b ) ] |
-                                          ch_p( 't' )[ chE( self.b ) ] |
-                                          ( ch_p( 'u' ) >> ( repeat_p( 4 )[ xdigit_p ][ chU( self.b ) ] ) ) ) ) |
-                                      ( ~range_p( 0x00, 0x1f ) & ~ch_p( '/' ) & ( ~ch_p( '\\' ) )[ ch( self.b ) ] ) ) >> str_p( "/" )[ regexValue( self.b ) ]
-                                   >> ( *( ch_p( 'i' ) | ch_p( 'g' ) | ch_p( 'm' ) ) )[ regexOptions( self.b ) ] ];
-            }
-            rule< ScannerT > object, members, array, elements, value, str, number, integer,
-            dbref, dbrefS, dbrefT, oid, oidS, oidT, bindata, date, dateS, dateT,
-            regex, regexS, regexT, quotedOid, fieldName, unquotedFieldName, singleQuoteStr;
-            const rule< ScannerT > &start() const {
-                return object;
-            }
-        };
-        ObjectBuilder &b;
+        // scratch for values, reused so each one doesn't allocate
+        string _str;
+        string _ns;
+        string _options;
+        string _binData;
+        BinDataType _binDataType;
+        OID _oid;
+        Date_t _date;
     };
 
     BSONObj fromjson( const char *str ) {
         if ( ! strlen(str) )
             return BSONObj();
-        ObjectBuilder b;
-        JsonGrammar parser( b );
-        parse_info<> result = parse( str, parser, space_p );
-        if ( !result.full ) {
-            int len = strlen( result.stop );
-            if ( len > 10 )
-                len = 10;
-            stringstream ss;
-            ss << "Failure parsing JSON string near: " << string( result.stop, len );
-            massert( ss.str(), false );
-        }
-        return b.pop();
+        JParse parser( str );
+        return parser.parse();
     }
 
     BSONObj fromjson( const string &str ) {
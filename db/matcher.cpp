@@ -37,6 +37,7 @@ namespace mongo {
         Where() {
             jsScope = 0;
             func = 0;
+            needObj = false;
         }
         ~Where() {
 
@@ -53,10 +54,15 @@ namespace mongo {
         auto_ptr<Scope> scope;
         ScriptingFunction func;
         BSONObj *jsScope;
+        bool needObj; // the code refers to the 'obj' global, not just 'this'
         
+        /* the compiled function is cached by the (pooled) scope keyed on its source, so the
+           same $where text coming in again reuses it rather than compiling again.
+        */
         void setFunc(const char *code) {
             massert( "scope has to be created first!" , scope.get() );
             func = scope->createFunction( code );
+            needObj = strstr( code , "obj" ) != 0;
         }
         
     };
@@ -88,8 +94,13 @@ namespace {
 
 namespace mongo {
     
+    /* a hashed index's keys can't answer anything about the values, so match on the record only */
+    static BSONObj matchableKeyPattern( const BSONObj &indexKeyPattern ) {
+        return isHashedKeyPattern( indexKeyPattern ) ? BSONObj() : indexKeyPattern;
+    }
+
     KeyValJSMatcher::KeyValJSMatcher(const BSONObj &jsobj, const BSONObj &indexKeyPattern) :
-        _keyMatcher(jsobj.filterFieldsUndotted(indexKeyPattern, true), indexKeyPattern),
+        _keyMatcher(jsobj.filterFieldsUndotted(matchableKeyPattern(indexKeyPattern), true), matchableKeyPattern(indexKeyPattern)),
         _recordMatcher(jsobj) {
         _needRecord = ! ( 
                          _recordMatcher.keyMatch() && 
@@ -115,7 +126,7 @@ namespace mongo {
     /* _jsobj          - the query pattern
     */
     JSMatcher::JSMatcher(const BSONObj &_jsobj, const BSONObj &constrainIndexKey) :
-        where(0), jsobj(_jsobj), haveSize(), all(), hasArray(0), nRegex(0){
+        where(0), jsobj(_jsobj), haveSize(), all(), hasArray(0), nRegex(0), _compiled(false){
 
         BSONObjIterator i(jsobj);
         while ( i.moreWithEOO() ) {
@@ -140,8 +151,15 @@ namespace mongo {
                     const char *code = e.valuestr();
                     where->setFunc(code);
                 }
+
+                // the scope is pooled, so an earlier query may have left an obj behind.  if we
+                // won't set it per document, clear it now so a reference we didn't spot fails
+                // rather than seeing someone else's object
+                if ( ! where->needObj )
+                    where->scope->execSetup( "obj = undefined;" , "clear obj" );
                 
                 where->scope->execSetup( "_mongo.readOnly = true;" , "make read only" );
+                where->scope->setBoolean( "fullObject" , true ); // this is a hack b/c fullObject used to be relevant
 
                 continue;
             }
@@ -214,6 +232,8 @@ namespace mongo {
                             break;
                         case BSONObj::opMOD:
                         case BSONObj::opTYPE:
+                        case BSONObj::opHASHED:
+                        case BSONObj::opRANGES:
                             basics.push_back( BasicMatcher( e , op ) );
                             break;
                         case BSONObj::opSIZE:{
@@ -272,6 +292,68 @@ namespace mongo {
         }
         
         constrainIndexKey_ = constrainIndexKey;
+        compile();
+    }
+
+    /* cheap, likely to fail predicates first */
+    static int selectivityRank( int op ) {
+        switch ( op ) {
+        case BSONObj::Equality:
+            return 0;
+        case BSONObj::opIN:
+            return 1;
+        case BSONObj::LT:
+        case BSONObj::LTE:
+        case BSONObj::GT:
+        case BSONObj::GTE:
+            return 2;
+        case BSONObj::NE:
+        case BSONObj::NIN:
+            return 4;
+        default:
+            return 3;
+        }
+    }
+
+    struct SelectivityLess {
+        SelectivityLess( const vector<BasicMatcher>& basics ) : _basics( basics ) {}
+        bool operator()( int l, int r ) const {
+            return selectivityRank( _basics[l].compareOp ) < selectivityRank( _basics[r].compareOp );
+        }
+        const vector<BasicMatcher>& _basics;
+    };
+
+    JSMatcher::FieldPredicates& JSMatcher::fieldPredicates( const char *fieldName ) {
+        const char *p = strchr( fieldName, '.' );
+        string name = p ? string( fieldName, p - fieldName ) : string( fieldName );
+        for ( unsigned i = 0; i < _fields.size(); i++ )
+            if ( _fields[i].name == name )
+                return _fields[i];
+        _fields.push_back( FieldPredicates() );
+        _fields.back().name = name;
+        return _fields.back();
+    }
+
+    void JSMatcher::compile() {
+        // index keys have empty field names, those go the long way
+        _compiled = constrainIndexKey_.isEmpty();
+        if ( !_compiled )
+            return;
+
+        for ( unsigned i = 0; i < basics.size(); i++ ) {
+            if ( basics[i].compareOp == BSONObj::opALL )
+                _slowBasics.push_back( i );
+            else
+                fieldPredicates( basics[i].toMatch.fieldName() ).basics.push_back( i );
+        }
+        for ( int r = 0; r < nRegex; r++ ) {
+            if ( strchr( regexs[r].fieldName, '.' ) )
+                _slowRegexs.push_back( r );
+            else
+                fieldPredicates( regexs[r].fieldName ).regexs.push_back( r );
+        }
+        for ( unsigned i = 0; i < _fields.size(); i++ )
+            stable_sort( _fields[i].basics.begin(), _fields[i].basics.end(), SelectivityLess( basics ) );
     }
 
     inline int JSMatcher::valuesMatch(const BSONElement& l, const BSONElement& r, int op, const BasicMatcher& bm) {
@@ -310,22 +392,56 @@ namespace mongo {
             return bm.type == l.type();
         }
 
-        /* check LT, GTE, ... */
-        if ( l.canonicalType() != r.canonicalType() )
+        if ( op == BSONObj::opHASHED ){
+            long long h = l.hash64();
+            for ( unsigned i = 0; i < bm.ranges.size(); i++ ){
+                const BSONElement& min = bm.ranges[i].first;
+                const BSONElement& max = bm.ranges[i].second;
+                if ( ( min.type() == MinKey || min.numberLong() <= h ) &&
+                     ( max.type() == MaxKey || h < max.numberLong() ) )
+                    return true;
+            }
+            return false;
+        }
+
+        if ( op == BSONObj::opRANGES ){
+            for ( unsigned i = 0; i < bm.ranges.size(); i++ )
+                if ( bm.ranges[i].first.woCompare( l , false ) <= 0 && l.woCompare( bm.ranges[i].second , false ) < 0 )
+                    return true;
             return false;
-        int c = compareElementValues(l, r);
+        }
+
+        /* check LT, GTE, ... */
+        int c;
+        if ( l.type() == NumberInt && r.type() == NumberInt ) {
+            // the common cases, without going through compareElementValues
+            int a = l.numberInt();
+            int b = r.numberInt();
+            c = a < b ? -1 : ( a == b ? 0 : 1 );
+        }
+        else if ( l.type() == String && r.type() == String ) {
+            c = strcmp( l.valuestr(), r.valuestr() );
+        }
+        else {
+            if ( l.canonicalType() != r.canonicalType() )
+                return false;
+            c = compareElementValues(l, r);
+        }
         if ( c < -1 ) c = -1;
         if ( c > 1 ) c = 1;
         int z = 1 << (c+1);
         return (op & z);
     }
 
-    int JSMatcher::matchesNe(const char *fieldName, const BSONElement &toMatch, const BSONObj &obj, const BasicMatcher& bm ) {
-        int ret = matchesDotted( fieldName, toMatch, obj, BSONObj::Equality, bm );
+    inline int neResult( int equalityResult, const BasicMatcher& bm ) {
         if ( bm.toMatch.type() != jstNULL )
-            return ( ret <= 0 ) ? 1 : 0;
+            return ( equalityResult <= 0 ) ? 1 : 0;
         else
-            return -ret;
+            return -equalityResult;
+    }
+
+    int JSMatcher::matchesNe(const char *fieldName, const BSONElement &toMatch, const BSONObj &obj, const BasicMatcher& bm ) {
+        return neResult( matchesDotted( fieldName, toMatch, obj, BSONObj::Equality, bm ), bm );
     }
 
     int retMissing( const BasicMatcher &bm ) {
@@ -426,6 +542,31 @@ namespace mongo {
             }
         }
 
+        return matchesValue( e, toMatch, compareOp, bm, indexed );
+    }
+
+    int JSMatcher::matchesTop(const char *fieldName, const BSONElement& top, const BSONElement& toMatch, int compareOp, const BasicMatcher& bm) {
+        if ( compareOp == BSONObj::NE )
+            return neResult( matchesTop( fieldName, top, toMatch, BSONObj::Equality, bm ), bm );
+        if ( compareOp == BSONObj::NIN ) {
+            for( set<BSONElement,element_lt>::const_iterator i = bm.myset->begin(); i != bm.myset->end(); ++i ) {
+                int ret = matchesTop( fieldName, top, *i, BSONObj::NE, bm );
+                if ( ret != 1 )
+                    return ret;
+            }
+            return 1;
+        }
+
+        const char *p = strchr(fieldName, '.');
+        if ( p ) {
+            if ( top.type() != Object && top.type() != Array )
+                return retMissing( bm );
+            return matchesDotted(p+1, toMatch, top.embeddedObject(), compareOp, bm, top.type() == Array);
+        }
+        return matchesValue( top, toMatch, compareOp, bm, false );
+    }
+
+    int JSMatcher::matchesValue(const BSONElement& e, const BSONElement& toMatch, int compareOp, const BasicMatcher& bm, bool indexed) {
         if ( compareOp == BSONObj::opEXISTS ) {
             return ( e.eoo() ^ toMatch.boolean() ) ? 1 : -1;
         } else if ( ( e.type() != Array || indexed || compareOp == BSONObj::opSIZE ) &&
@@ -469,49 +610,138 @@ namespace mongo {
         return rm.re->PartialMatch(p);
     }
 
-    /* See if an object matches the query.
-    */
-    bool JSMatcher::matches(const BSONObj& jsobj ) {
-        /* assuming there is usually only one thing to match.  if more this
-        could be slow sometimes. */
-
-        // check normal non-regex cases:
-        for ( unsigned i = 0; i < basics.size(); i++ ) {
-            BasicMatcher& bm = basics[i];
-            BSONElement& m = bm.toMatch;
-            // -1=mismatch. 0=missing element. 1=match
-            int cmp = matchesDotted(m.fieldName(), m, jsobj, bm.compareOp, bm );
-            if ( cmp < 0 )
-                return false;
-            if ( cmp == 0 ) {
-                /* missing is ok iff we were looking for null */
-                if ( m.type() == jstNULL || m.type() == Undefined ) {
-                    if ( bm.compareOp == BSONObj::NE ) {
-                        return false;
-                    }
-                } else {
+    /* -1=mismatch. 0=missing element. 1=match */
+    inline bool basicMatches( int cmp, const BasicMatcher& bm ) {
+        if ( cmp < 0 )
+            return false;
+        if ( cmp == 0 ) {
+            /* missing is ok iff we were looking for null */
+            if ( bm.toMatch.type() == jstNULL || bm.toMatch.type() == Undefined ) {
+                if ( bm.compareOp == BSONObj::NE ) {
                     return false;
                 }
+            } else {
+                return false;
             }
         }
+        return true;
+    }
 
-        for ( int r = 0; r < nRegex; r++ ) {
-            RegexMatcher& rm = regexs[r];
-            BSONElementSet s;
-            if ( !constrainIndexKey_.isEmpty() ) {
-                BSONElement e = jsobj.getFieldUsingIndexNames(rm.fieldName, constrainIndexKey_);
-                if ( !e.eoo() )
-                    s.insert( e );
-            } else {
-                jsobj.getFieldsDotted( rm.fieldName, s );
-            }
+    bool JSMatcher::regexMatchesObj( RegexMatcher& rm, const BSONObj& jsobj ) {
+        BSONElementSet s;
+        if ( !constrainIndexKey_.isEmpty() ) {
+            BSONElement e = jsobj.getFieldUsingIndexNames(rm.fieldName, constrainIndexKey_);
+            if ( !e.eoo() )
+                s.insert( e );
+        } else {
+            jsobj.getFieldsDotted( rm.fieldName, s );
+        }
+        for( BSONElementSet::const_iterator i = s.begin(); i != s.end(); ++i )
+            if ( regexMatches(rm, *i) )
+                return true;
+        return false;
+    }
+
+    bool JSMatcher::matchesField( const FieldPredicates& fp, const BSONElement& top ) {
+        for ( unsigned i = 0; i < fp.basics.size(); i++ ) {
+            BasicMatcher& bm = basics[ fp.basics[i] ];
+            if ( !basicMatches( matchesTop( bm.toMatch.fieldName(), top, bm.toMatch, bm.compareOp, bm ), bm ) )
+                return false;
+        }
+        for ( unsigned i = 0; i < fp.regexs.size(); i++ ) {
+            RegexMatcher& rm = regexs[ fp.regexs[i] ];
             bool match = false;
-            for( BSONElementSet::const_iterator i = s.begin(); i != s.end(); ++i )
-                if ( regexMatches(rm, *i) )
-                    match = true;
+            if ( top.type() == Array ) {
+                BSONObjIterator ai( top.embeddedObject() );
+                while ( !match && ai.more() )
+                    match = regexMatches( rm, ai.next() );
+            }
+            else if ( !top.eoo() ) {
+                match = regexMatches( rm, top );
+            }
             if ( !match )
                 return false;
         }
+        return true;
+    }
+
+    /* one walk over obj, checking each field's predicates as it goes by and stopping as
+       soon as one fails or every field in the pattern has been seen.
+    */
+    bool JSMatcher::matchesSinglePass( const BSONObj& obj ) {
+        unsigned nFields = _fields.size();
+        unsigned left = nFields;
+
+        // on the stack, so a matcher can be shared or reentered
+        char seenBuf[ 32 ];
+        vector<char> seenBig;
+        char *seen = seenBuf;
+        if ( nFields > sizeof( seenBuf ) ) {
+            seenBig.resize( nFields );
+            seen = &seenBig[0];
+        }
+        memset( seen, 0, nFields );
+
+        BSONObjIterator i( obj );
+        while ( left && i.moreWithEOO() ) {
+            BSONElement e = i.next();
+            if ( e.eoo() )
+                break;
+            const char *name = e.fieldName();
+            for ( unsigned k = 0; k < nFields; k++ ) {
+                const FieldPredicates& fp = _fields[k];
+                if ( seen[k] || fp.name[0] != name[0] || strcmp( fp.name.c_str(), name ) != 0 )
+                    continue;
+                seen[k] = 1;
+                left--;
+                if ( !matchesField( fp, e ) )
+                    return false;
+                break;
+            }
+        }
+
+        if ( left ) {
+            BSONElement missing;
+            for ( unsigned k = 0; k < nFields; k++ )
+                if ( !seen[k] && !matchesField( _fields[k], missing ) )
+                    return false;
+        }
+
+        for ( unsigned i = 0; i < _slowBasics.size(); i++ ) {
+            BasicMatcher& bm = basics[ _slowBasics[i] ];
+            if ( !basicMatches( matchesDotted( bm.toMatch.fieldName(), bm.toMatch, obj, bm.compareOp, bm ), bm ) )
+                return false;
+        }
+        for ( unsigned i = 0; i < _slowRegexs.size(); i++ )
+            if ( !regexMatchesObj( regexs[ _slowRegexs[i] ], obj ) )
+                return false;
+
+        return true;
+    }
+
+    /* See if an object matches the query.
+       Everything that can be checked without javascript is checked first; the $where
+       function only runs for objects that pass all of it.
+    */
+    bool JSMatcher::matches(const BSONObj& jsobj ) {
+        if ( _compiled ) {
+            if ( !matchesSinglePass( jsobj ) )
+                return false;
+        }
+        else {
+            // check normal non-regex cases:
+            for ( unsigned i = 0; i < basics.size(); i++ ) {
+                BasicMatcher& bm = basics[i];
+                BSONElement& m = bm.toMatch;
+                int cmp = matchesDotted(m.fieldName(), m, jsobj, bm.compareOp, bm );
+                if ( !basicMatches( cmp, bm ) )
+                    return false;
+            }
+
+            for ( int r = 0; r < nRegex; r++ )
+                if ( !regexMatchesObj( regexs[r], jsobj ) )
+                    return false;
+        }
         
         if ( where ) {
             if ( where->func == 0 ) {
@@ -523,8 +753,9 @@ namespace mongo {
                 where->scope->init( where->jsScope );
             }
             where->scope->setThis( const_cast< BSONObj * >( &jsobj ) );
-            where->scope->setObject( "obj", const_cast< BSONObj & >( jsobj ) );
-            where->scope->setBoolean( "fullObject" , true ); // this is a hack b/c fullObject used to be relevant
+            // each of these wraps its own copy of the object, skip the one the code can't see
+            if ( where->needObj )
+                where->scope->setObject( "obj", const_cast< BSONObj & >( jsobj ) );
             
             int err = where->scope->invoke( where->func , BSONObj() , 1000 * 60 , false );
             where->scope->setThis( 0 );
@@ -68,6 +68,29 @@ namespace mongo {
             else if ( _op == BSONObj::opTYPE ){
                 type = (BSONType)(_e.embeddedObject().firstElement().numberInt());
             }
+            else if ( _op == BSONObj::opHASHED || _op == BSONObj::opRANGES ){
+                BSONElement list = _e.embeddedObject().firstElement();
+                uassert( "$hashed and $ranges need an array of [ min , max )" , list.type() == Array );
+                BSONObj o = list.embeddedObject();
+                if ( _op == BSONObj::opHASHED && o.firstElement().type() != Array ){
+                    addRange( o );
+                }
+                else {
+                    BSONObjIterator i( o );
+                    while ( i.more() ){
+                        BSONElement r = i.next();
+                        uassert( "$hashed and $ranges need an array of [ min , max )" , r.type() == Array );
+                        addRange( r.embeddedObject() );
+                    }
+                }
+            }
+        }
+
+        void addRange( const BSONObj& o ){
+            BSONElement min = o["0"];
+            BSONElement max = o["1"];
+            uassert( "$hashed and $ranges need an array of [ min , max )" , ! min.eoo() && ! max.eoo() );
+            ranges.push_back( make_pair( min , max ) );
         }
         
         
@@ -90,6 +113,7 @@ namespace mongo {
         int mod;
         int modm;
         BSONType type;
+        vector< pair<BSONElement,BSONElement> > ranges; // [min,max).  for $hashed MinKey/MaxKey or a NumberLong from a hashed index
     };
 
 // SQL where clause equivalent
@@ -121,6 +145,17 @@ namespace mongo {
             const char *fieldName,
             const BSONElement &toMatch, const BSONObj &obj,
             const BasicMatcher&bm);
+
+        /* like matchesDotted, but given obj's element for the first part of fieldName
+           (eoo if obj doesn't have it) rather than obj itself */
+        int matchesTop(
+            const char *fieldName,
+            const BSONElement& top, const BSONElement& toMatch,
+            int compareOp, const BasicMatcher& bm);
+
+        int matchesValue(
+            const BSONElement& e, const BSONElement& toMatch,
+            int compareOp, const BasicMatcher& bm, bool indexed);
         
     public:
         static int opDirection(int op) {
@@ -146,6 +181,21 @@ namespace mongo {
 
         int valuesMatch(const BSONElement& l, const BSONElement& r, int op, const BasicMatcher& bm);
 
+        /* the predicates that look at one top level field of an object */
+        struct FieldPredicates {
+            string name;            // the part of the field name before any '.'
+            vector<int> basics;     // into basics, most selective first
+            vector<int> regexs;     // into regexs, undotted field names only
+        };
+
+        /* groups the pattern by top level field so matches() can check an object in one
+           walk over it, rather than looking every predicate up from the start */
+        void compile();
+        FieldPredicates& fieldPredicates( const char *fieldName );
+        bool matchesSinglePass( const BSONObj& obj );
+        bool matchesField( const FieldPredicates& fp, const BSONElement& top );
+        bool regexMatchesObj( RegexMatcher& rm, const BSONObj& obj );
+
         Where *where;                    // set if query uses $where
         BSONObj jsobj;                  // the query pattern.  e.g., { name: "joe" }
         BSONObj constrainIndexKey_;
@@ -162,6 +212,11 @@ namespace mongo {
         // so we delete the mem when we're done:
         vector< shared_ptr< BSONObjBuilder > > builders_;
 
+        bool _compiled;                  // false when matching index keys
+        vector<FieldPredicates> _fields;
+        vector<int> _slowBasics;         // $all, checked against the whole object
+        vector<int> _slowRegexs;         // dotted field names
+
         friend class KeyValJSMatcher;
     };
     
@@ -16,6 +16,7 @@
  */
 
 #include "stdafx.h"
+#include <boost/thread/tss.hpp>
 #include "db.h"
 #include "instance.h"
 #include "commands.h"
@@ -562,33 +562,130 @@ namespace mongo {
     
     /* ------------------------------------------------------------------------- */
 
-    boost::mutex NamespaceDetailsTransient::_qcMutex;
-    map< string, shared_ptr< NamespaceDetailsTransient > > NamespaceDetailsTransient::_map;
-    typedef map< string, shared_ptr< NamespaceDetailsTransient > >::iterator ouriter;
+    NamespaceDetailsTransient::Node * volatile NamespaceDetailsTransient::_buckets[ NamespaceDetailsTransient::NBuckets ];
+    boost::mutex NamespaceDetailsTransient::_mapMutex;
 
     void NamespaceDetailsTransient::reset() {
         clearQueryCache();
         _keysComputed = false;
     }
-    
-/*    NamespaceDetailsTransient& NamespaceDetailsTransient::get(const char *ns) {
-        shared_ptr< NamespaceDetailsTransient > &t = map_[ ns ];
-        if ( t.get() == 0 )
-            t.reset( new NamespaceDetailsTransient(ns) );
-        return *t;
+
+    NamespaceDetailsTransient& NamespaceDetailsTransient::_insert(const char *ns, unsigned h) {
+        boostlock lk(_mapMutex);
+        Node * volatile &head = _buckets[ h % NBuckets ];
+        // someone may have added it while we waited for the mutex
+        for( Node *n = head; n; n = n->next )
+            if ( n->hash == h && n->nsdt->_ns == ns )
+                return *n->nsdt;
+        Node *n = new Node( h, ns, head );
+        memoryBarrier();
+        head = n;
+        return *n->nsdt;
     }
-*/
+
     void NamespaceDetailsTransient::clearForPrefix(const char *prefix) {
         assertInWriteLock();
-        vector< string > found;
-        for( ouriter i = _map.begin(); i != _map.end(); ++i )
-            if ( strncmp( i->first.c_str(), prefix, strlen( prefix ) ) == 0 )
-                found.push_back( i->first );
-        for( vector< string >::iterator i = found.begin(); i != found.end(); ++i ) {
-            _map[ *i ].reset();
+        int len = strlen( prefix );
+        for( int i = 0; i < NBuckets; ++i ) {
+            for( Node *n = _buckets[ i ]; n; n = n->next ) {
+                if ( strncmp( n->nsdt->_ns.c_str(), prefix, len ) == 0 ) {
+                    string ns = n->nsdt->_ns;
+                    n->nsdt.reset( new NamespaceDetailsTransient( ns.c_str() ) );
+                }
+            }
         }
     }
     
+    /* a recorded plan is replanned once the collection has seen this many writes, or
+       this fraction of its size in writes, whichever is larger */
+    const long long QcMinWritesBeforeReplan = 100;
+    const double QcFractionChangedBeforeReplan = 0.1;
+    /* a plan whose running average nscanned climbs past this multiple of what it
+       scanned when picked is dropped.  tiny nscanned values are rounded up first, or
+       point queries would bounce between plans over noise. */
+    const double QcDegradeFactor = 4.0;
+    const long long QcMinDegradeNScanned = 25;
+    const double QcAverageWeight = 0.25;
+
+    bool NamespaceDetailsTransient::stale( const CachedQueryPlan &p ) const {
+        long long writes = _qcWriteCount - p.writeCount;
+        return writes >= QcMinWritesBeforeReplan && writes >= p.nRecords * QcFractionChangedBeforeReplan;
+    }
+
+    BSONObj NamespaceDetailsTransient::indexForPattern( const QueryPattern &pattern ) {
+        ++_qcLookups;
+        map< QueryPattern, CachedQueryPlan >::iterator i = _qcCache.find( pattern );
+        if ( i == _qcCache.end() )
+            return BSONObj();
+        if ( stale( i->second ) ) {
+            log(1) << "query cache: data changed, replanning " << _ns << ' ' << pattern.toString() << endl;
+            _qcCache.erase( i );
+            return BSONObj();
+        }
+        ++_qcHits;
+        ++i->second.hits;
+        return i->second.indexKey;
+    }
+
+    void NamespaceDetailsTransient::registerIndexForPattern( const QueryPattern &pattern, const BSONObj &indexKey, long long nScanned ) {
+        if ( indexKey.isEmpty() ) {
+            _qcCache.erase( pattern );
+            return;
+        }
+        CachedQueryPlan &p = _qcCache[ pattern ];
+        p = CachedQueryPlan();
+        p.indexKey = indexKey.getOwned();
+        p.nScanned = nScanned;
+        p.writeCount = _qcWriteCount;
+        NamespaceDetails *d = nsdetails( _ns.c_str() );
+        p.nRecords = d ? d->nrecords : 0;
+    }
+
+    void NamespaceDetailsTransient::notePlanRun( const QueryPattern &pattern, long long nScanned, long long nReturned, int millis ) {
+        map< QueryPattern, CachedQueryPlan >::iterator i = _qcCache.find( pattern );
+        if ( i == _qcCache.end() )
+            return;
+        CachedQueryPlan &p = i->second;
+        if ( p.runs++ == 0 ) {
+            p.avgNScanned = (double) nScanned;
+            p.avgNReturned = (double) nReturned;
+            p.avgMillis = millis;
+        }
+        else {
+            p.avgNScanned += QcAverageWeight * ( nScanned - p.avgNScanned );
+            p.avgNReturned += QcAverageWeight * ( nReturned - p.avgNReturned );
+            p.avgMillis += QcAverageWeight * ( millis - p.avgMillis );
+        }
+        if ( p.avgNScanned > QcDegradeFactor * max( p.nScanned, QcMinDegradeNScanned ) ) {
+            log(1) << "query cache: plan " << p.indexKey.toString() << " degraded, replanning " << _ns << ' ' << pattern.toString() << endl;
+            _qcCache.erase( i );
+        }
+    }
+
+    void NamespaceDetailsTransient::appendQueryCacheStats( BSONObjBuilder &b ) {
+        b.append( "lookups", (double) _qcLookups );
+        b.append( "hits", (double) _qcHits );
+        b.append( "hitRate", _qcLookups ? (double) _qcHits / _qcLookups : 0.0 );
+        b.append( "writes", (double) _qcWriteCount );
+        vector< BSONObj > entries;
+        for( map< QueryPattern, CachedQueryPlan >::const_iterator i = _qcCache.begin(); i != _qcCache.end(); ++i ) {
+            const CachedQueryPlan &p = i->second;
+            BSONObjBuilder e;
+            e.append( "pattern", i->first.toString() );
+            e.append( "index", p.indexKey );
+            e.append( "nscanned", (double) p.nScanned );
+            e.append( "hits", (double) p.hits );
+            e.append( "runs", (double) p.runs );
+            e.append( "avgNScanned", p.avgNScanned );
+            e.append( "avgNReturned", p.avgNReturned );
+            e.append( "avgMillis", p.avgMillis );
+            e.append( "writesSinceRecorded", (double) ( _qcWriteCount - p.writeCount ) );
+            e.appendBool( "stale", stale( p ) );
+            entries.push_back( e.obj() );
+        }
+        b.append( "entries", entries );
+    }
+
     void NamespaceDetailsTransient::computeIndexKeys() {
         _keysComputed = true;
         _indexKeys.clear();
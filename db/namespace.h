@@ -522,10 +522,33 @@ namespace mongo {
     private:
         string _ns;
         void reset();
-        static std::map< string, shared_ptr< NamespaceDetailsTransient > > _map;
+
+        /* ns -> NamespaceDetailsTransient hash.  Lookups take no lock: a bucket chain is only
+           ever extended by pushing a fully built node on its head (under _mapMutex), and nodes
+           are never unlinked.  clearForPrefix() swaps in a fresh object, which is only safe
+           because it runs in the write lock, when nobody else can hold a reference.
+        */
+        struct Node {
+            Node(unsigned h, const char *ns, Node *n) : hash(h), nsdt(new NamespaceDetailsTransient(ns)), next(n) { }
+            const unsigned hash;
+            shared_ptr< NamespaceDetailsTransient > nsdt;
+            Node * const next;
+        };
+        enum { NBuckets = 4096 };
+        static Node * volatile _buckets[ NBuckets ];
+        static boost::mutex _mapMutex;
+        static unsigned hashNs(const char *ns) {
+            unsigned x = 0;
+            for( const char *p = ns; *p; ++p )
+                x = x * 131 + *p;
+            return x;
+        }
+        static NamespaceDetailsTransient& _insert(const char *ns, unsigned h);
     public:
-        NamespaceDetailsTransient(const char *ns) : _ns(ns), _keysComputed(false), _qcWriteCount(), _cll_enabled() { }
-        /* _get() is not threadsafe */
+        NamespaceDetailsTransient(const char *ns) : _ns(ns), _keysComputed(false), _qcWriteCount(), _qcLookups(), _qcHits(), _cll_enabled() { }
+        /* _get() is threadsafe, and lock free unless ns has never been seen before.  you still
+           need at least a read lock to use the returned object, as clearForPrefix() may replace it.
+        */
         static NamespaceDetailsTransient& _get(const char *ns);
         /* use get_w() when doing write operations */
         static NamespaceDetailsTransient& get_w(const char *ns) { 
@@ -557,35 +580,55 @@ namespace mongo {
         }
 
         /* query cache (for query optimizer) ------------------------------------- */
+    public:
+        /* what we remember about the plan picked for a QueryPattern.  the averages are
+           exponentially weighted over the runs that reused the plan, so a plan that has
+           gone bad is noticed even though it was a good choice when recorded.
+        */
+        struct CachedQueryPlan {
+            CachedQueryPlan() : nScanned(), writeCount(), nRecords(), hits(), runs(), avgNScanned(), avgNReturned(), avgMillis() { }
+            BSONObj indexKey;
+            long long nScanned;   // nscanned by the trial run that picked this plan
+            long long writeCount; // _qcWriteCount when recorded
+            long long nRecords;   // collection size when recorded
+            long long hits;       // times the plan was handed to the optimizer
+            long long runs;       // reuses that completed and reported back
+            double avgNScanned;
+            double avgNReturned;
+            double avgMillis;
+        };
     private:
-        int _qcWriteCount;
-        map< QueryPattern, pair< BSONObj, long long > > _qcCache;
+        long long _qcWriteCount;
+        long long _qcLookups;
+        long long _qcHits;
+        map< QueryPattern, CachedQueryPlan > _qcCache;
+        bool stale( const CachedQueryPlan &p ) const;
     public:
-        static boost::mutex _qcMutex;
-        /* you must be in the qcMutex when calling this (and using the returned val): */
-        static NamespaceDetailsTransient& get_inlock(const char *ns) {
-            return _get(ns);
-        }
+        /* per namespace, so plan lookups on different collections don't contend.  hold this
+           when touching the query cache from a read lock; in the write lock it isn't needed.
+        */
+        boost::mutex _qcMutex;
         void clearQueryCache() { // public for unit tests
             _qcCache.clear();
-            _qcWriteCount = 0;
         }
-        /* you must notify the cache if you are doing writes, as query plan optimality will change */
+        /* you must notify the cache if you are doing writes, as query plan optimality will change.
+           entries aren't dropped here -- each is checked against the write count when next used.
+        */
         void notifyOfWriteOp() {
-            if ( _qcCache.empty() )
-                return;
-            if ( ++_qcWriteCount >= 100 )
-                clearQueryCache();
-        }
-        BSONObj indexForPattern( const QueryPattern &pattern ) {
-            return _qcCache[ pattern ].first;
+            ++_qcWriteCount;
         }
+        /* empty if no plan, or the plan recorded is stale.  counts as a cache lookup. */
+        BSONObj indexForPattern( const QueryPattern &pattern );
         long long nScannedForPattern( const QueryPattern &pattern ) {
-            return _qcCache[ pattern ].second;
-        }
-        void registerIndexForPattern( const QueryPattern &pattern, const BSONObj &indexKey, long long nScanned ) {
-            _qcCache[ pattern ] = make_pair( indexKey, nScanned );
+            map< QueryPattern, CachedQueryPlan >::const_iterator i = _qcCache.find( pattern );
+            return i == _qcCache.end() ? 0 : i->second.nScanned;
         }
+        /* an empty indexKey forgets the pattern */
+        void registerIndexForPattern( const QueryPattern &pattern, const BSONObj &indexKey, long long nScanned );
+        /* a recorded plan was reused and ran to completion.  drops the plan if it is now
+           doing much worse than when it was picked. */
+        void notePlanRun( const QueryPattern &pattern, long long nScanned, long long nReturned, int millis );
+        void appendQueryCacheStats( BSONObjBuilder &b );
 
         /* for collection-level logging -- see CmdLogCollection ----------------- */ 
         /* assumed to be in write lock for this */
@@ -603,10 +646,11 @@ namespace mongo {
     }; /* NamespaceDetailsTransient */
 
     inline NamespaceDetailsTransient& NamespaceDetailsTransient::_get(const char *ns) {
-        shared_ptr< NamespaceDetailsTransient > &t = _map[ ns ];
-        if ( t.get() == 0 )
-            t.reset( new NamespaceDetailsTransient(ns) );
-        return *t;
+        unsigned h = hashNs( ns );
+        for( Node *n = _buckets[ h % NBuckets ]; n; n = n->next )
+            if ( n->hash == h && n->nsdt->_ns == ns )
+                return *n->nsdt;
+        return _insert( ns, h );
     }
 
     /* NamespaceIndex is the ".ns" file you see in the data directory.  It is the "system catalog"
@@ -39,6 +39,8 @@ _ disallow system* manipulations from the database.
 #include "namespace.h"
 #include "queryutil.h"
 #include "extsort.h"
+#include "instance.h"
+#include "../s/d_logic.h"
 
 namespace mongo {
 
@@ -728,6 +730,15 @@ namespace mongo {
     }
 
     void getKeysFromObject( const BSONObj &keyPattern, const BSONObj &obj, BSONObjSetDefaultOrder &keys ) {
+        if ( isHashedKeyPattern( keyPattern ) ) {
+            // one key per object, the hash of the field's value
+            BSONElement e = obj.getFieldDotted( keyPattern.firstElement().fieldName() );
+            uassert( "can't use an array for a hashed key" , e.type() != Array );
+            BSONObjBuilder b;
+            b.append( "" , e.hash64() );
+            keys.insert( b.obj() );
+            return;
+        }
         BSONObjIterator i( keyPattern );
         vector< const char * > fieldNames;
         vector< BSONElement > fixed;
@@ -861,6 +872,7 @@ namespace mongo {
 
         /* check if any cursors point to us.  if so, advance them. */
         ClientCursor::aboutToDelete(dl);
+        aboutToDeleteForSharding( ns , dl );
 
         unindexRecord(d, todelete, dl, noWarn);
 
@@ -1262,8 +1274,10 @@ namespace mongo {
         theDataFileMgr.insert(system_indexes.c_str(), o.objdata(), o.objsize(), true);
     }
 
-    // should be { <something> : <simpletype[1|-1]>, .keyp.. } 
+    // should be { <something> : <simpletype[1|-1]>, .keyp.. }, or { <something> : "hashed" }
     bool validKeyPattern(BSONObj kp) { 
+        if( isHashedKeyPattern(kp) && kp.nFields() != 1 )
+            return false;
         BSONObjIterator i(kp);
         while( i.moreWithEOO() ) { 
             BSONElement e = i.next();
@@ -1361,6 +1375,8 @@ namespace mongo {
                 string s = string("bad index key pattern ") + key.toString();
                 uassert(s.c_str(), false);
             }
+            // different values can hash alike, so uniqueness can't be checked on the hash
+            uassert( "a hashed index can't be unique", !( isHashedKeyPattern( key ) && io["unique"].trueValue() ) );
             if ( *name == 0 || tabletoidxns.empty() || key.isEmpty() || key.objsize() > 2048 ) {
                 out() << "user warning: bad add index attempt name:" << (name?name:"") << "\n  ns:" <<
                     tabletoidxns << "\n  ourns:" << ns;
@@ -1536,6 +1552,9 @@ namespace mongo {
             }
         }
 
+        if ( d->capped )
+            cappedInsertNotifier.notify( ns );
+
         //	out() << "   inserted at loc:" << hex << loc.getOfs() << " lenwhdr:" << hex << lenWHdr << dec << ' ' << ns << endl;
         return loc;
     }
@@ -1572,6 +1591,9 @@ namespace mongo {
 
         d->nrecords++;
 
+        // the caller fills in the record before it lets go of the write lock, so waiters won't see it half done
+        cappedInsertNotifier.notify( ns );
+
         return r;
     }
 
@@ -282,11 +282,16 @@ namespace mongo {
         return qr;
     }
 
-    QueryResult* getMore(const char *ns, int ntoreturn, long long cursorid , stringstream& ss) {
+    QueryResult* getMore(const char *ns, int ntoreturn, long long cursorid , stringstream& ss, Message *reply) {
         ClientCursor *cc = ClientCursor::find(cursorid);
+
+        /* with no field selection an object goes back byte for byte as it is in the datafile, so
+           rather than copy it into b we point the reply at the record.  see Message::appendPiece().
+        */
+        bool inPlace = reply && cc && cc->filter.get() == 0;
         
         int bufSize = 512;
-        if ( cc ){
+        if ( cc && !inPlace ){
             bufSize += sizeof( QueryResult );
             bufSize += ( ntoreturn ? 4 : 1 ) * 1024 * 1024;
         }
@@ -331,10 +336,16 @@ namespace mongo {
                     }
                     else {
                         BSONObj js = c->current();
-                        fillQueryResultFromObj(b, cc->filter.get(), js);
+                        if ( !inPlace )
+                            fillQueryResultFromObj(b, cc->filter.get(), js);
+                        else if ( js.isOwned() )
+                            reply->appendCopy( js.objdata(), js.objsize() );
+                        else
+                            reply->appendPiece( js.objdata(), js.objsize() );
                         n++;
-                        if ( (ntoreturn>0 && (n >= ntoreturn || b.len() > MaxBytesToReturnToClientAtOnce)) ||
-                             (ntoreturn==0 && b.len()>1*1024*1024) ) {
+                        int len = b.len() + ( reply ? reply->piecesLen() : 0 );
+                        if ( (ntoreturn>0 && (n >= ntoreturn || len > MaxBytesToReturnToClientAtOnce)) ||
+                             (ntoreturn==0 && len>1*1024*1024) ) {
                             c->advance();
                             cc->pos += n;
                             //cc->updateLocation();
@@ -351,7 +362,7 @@ namespace mongo {
         }
 
         QueryResult *qr = (QueryResult *) b.buf();
-        qr->len = b.len();
+        qr->len = b.len() + ( reply ? reply->piecesLen() : 0 );
         qr->setOperation(opReply);
         qr->resultFlags() = resultFlags;
         qr->cursorId = cursorid;
@@ -362,6 +373,47 @@ namespace mongo {
         return qr;
     }
 
+    CappedInsertNotifier cappedInsertNotifier;
+
+    unsigned long long CappedInsertNotifier::prepare( const string& ns ) {
+        boostlock lk( _m );
+        Waiters *&w = _ns[ ns ];
+        if ( w == 0 )
+            w = new Waiters();
+        _waiting++;
+        return w->inserts;
+    }
+
+    bool CappedInsertNotifier::wait( const string& ns , unsigned long long ticket , int millis ) {
+        boost::xtime xt;
+        boost::xtime_get(&xt, boost::TIME_UTC);
+        xt.sec += ( millis / 1000 );
+        xt.nsec += ( millis % 1000 ) * 1000000;
+        if ( xt.nsec >= 1000000000 ) {
+            xt.nsec -= 1000000000;
+            xt.sec++;
+        }
+
+        boostlock lk( _m );
+        Waiters *w = _ns[ ns ];
+        assert( w );
+        while ( w->inserts == ticket ) {
+            if ( ! w->changed.timed_wait( lk , xt ) )
+                break;
+        }
+        _waiting--;
+        return w->inserts != ticket;
+    }
+
+    void CappedInsertNotifier::_notify( const char *ns ) {
+        boostlock lk( _m );
+        map< string , Waiters* >::iterator i = _ns.find( ns );
+        if ( i == _ns.end() )
+            return;
+        i->second->inserts++;
+        i->second->changed.notify_all();
+    }
+
     class CountOp : public QueryOp {
     public:
         CountOp( const BSONObj &spec ) : spec_( spec ), count_(), bc_() {}
@@ -640,6 +692,7 @@ namespace mongo {
         auto_ptr< Cursor > cursor() { return c_; }
         auto_ptr< KeyValJSMatcher > matcher() { return matcher_; }
         int n() const { return n_; }
+        virtual long long nReturned() const { return n_; }
         long long nscanned() const { return nscanned_; }
         bool saveClientCursor() const { return saveClientCursor_; }
         bool mayCreateCursor2() const { return ( queryOptions_ & Option_CursorTailable ) && ntoreturn_ != 1; }
@@ -842,6 +895,8 @@ namespace mongo {
                     ClientCursor *cc = new ClientCursor();
                     if ( queryOptions & Option_NoCursorTimeout )
                         cc->noTimeout();
+                    if ( ( queryOptions & Option_CursorTailable ) && ( queryOptions & Option_AwaitData ) )
+                        cc->awaitData();
                     cc->c = c;
                     cursorid = cc->cursorid;
                     cc->query = jsobj.getOwned();
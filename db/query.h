@@ -71,8 +71,51 @@
 
 namespace mongo {
 
-    // for an existing query (ie a ClientCursor), send back additional information.
-    QueryResult* getMore(const char *ns, int ntoreturn, long long cursorid , stringstream& ss);
+    /* for an existing query (ie a ClientCursor), send back additional information.
+       if reply is given, objects that go back unchanged may be added to it as pieces that
+       point into the datafiles instead of being copied into the result; the result is then
+       reply's data.
+    */
+    QueryResult* getMore(const char *ns, int ntoreturn, long long cursorid , stringstream& ss, Message *reply = 0);
+
+    /* lets a getMore on an Option_AwaitData cursor that has reached the end of a capped collection
+       sleep, without the db lock, until something is inserted there.  inserts take the write lock
+       and waiters register under the db lock, so an insert can't slip in between a waiter seeing
+       the end and going to sleep.
+    */
+    class CappedInsertNotifier : boost::noncopyable {
+    public:
+        CappedInsertNotifier() : _waiting(0) {}
+
+        /* call with the db lock held.  @return ticket for wait() */
+        unsigned long long prepare( const string& ns );
+
+        /* call without the db lock, once for each prepare().
+           @return true if ns had an insert since the ticket was handed out
+        */
+        bool wait( const string& ns , unsigned long long ticket , int millis );
+
+        /* call with the write lock held, after inserting into a capped collection */
+        void notify( const char *ns ) {
+            if ( _waiting )
+                _notify( ns );
+        }
+
+    private:
+        void _notify( const char *ns );
+
+        struct Waiters {
+            Waiters() : inserts(0) {}
+            unsigned long long inserts;
+            boost::condition changed;
+        };
+
+        boost::mutex _m;
+        map< string , Waiters* > _ns; // entries are never freed; there are only ever a few capped collections
+        volatile int _waiting;
+    };
+
+    extern CappedInsertNotifier cappedInsertNotifier;
 
     struct UpdateResult {
         bool existing;
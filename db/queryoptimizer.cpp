@@ -76,6 +76,26 @@ namespace mongo {
         }
 
         BSONObj idxKey = index_->keyPattern();
+        if ( isHashedKeyPattern( idxKey ) ) {
+            // only good for finding a single value, and its order is no use for sorting
+            if ( order_.isEmpty() )
+                scanAndOrderRequired_ = false;
+            const FieldRange &fr = fbs.range( idxKey.firstElement().fieldName() );
+            BSONObjBuilder lower, upper;
+            if ( fr.equality() && !fr.min().mayEncapsulate() && fr.min().type() != RegEx ) {
+                lower.append( "", fr.min().hash64() );
+                upper.append( "", fr.min().hash64() );
+                optimal_ = !scanAndOrderRequired_ && fbs.nNontrivialRanges() == 1;
+            }
+            else {
+                lower.appendMinKey( "" );
+                upper.appendMaxKey( "" );
+                unhelpful_ = startKey.isEmpty() && endKey.isEmpty();
+            }
+            indexBounds_.push_back( make_pair( startKey.isEmpty() ? lower.obj() : startKey,
+                                               endKey.isEmpty() ? upper.obj() : endKey ) );
+            return;
+        }
         BSONObjIterator o( order );
         BSONObjIterator k( idxKey );
         if ( !o.moreWithEOO() )
@@ -206,8 +226,9 @@ namespace mongo {
     
     void QueryPlan::registerSelf( long long nScanned ) const {
         if ( fbs_.matchPossible() ) {
-            boostlock lk(NamespaceDetailsTransient::_qcMutex);
-            NamespaceDetailsTransient::get_inlock( ns() ).registerIndexForPattern( fbs_.pattern( order_ ), indexKey(), nScanned );  
+            NamespaceDetailsTransient& nsd = NamespaceDetailsTransient::_get( ns() );
+            boostlock lk(nsd._qcMutex);
+            nsd.registerIndexForPattern( fbs_.pattern( order_ ), indexKey(), nScanned );  
         }
     }
     
@@ -299,8 +320,8 @@ namespace mongo {
         }
         
         if ( honorRecordedPlan_ ) {
-            boostlock lk(NamespaceDetailsTransient::_qcMutex);
-            NamespaceDetailsTransient& nsd = NamespaceDetailsTransient::get_inlock( ns );
+            NamespaceDetailsTransient& nsd = NamespaceDetailsTransient::_get( ns );
+            boostlock lk(nsd._qcMutex);
             BSONObj bestIndex = nsd.indexForPattern( fbs_.pattern( order_ ) );
             if ( !bestIndex.isEmpty() ) {
                 usingPrerecordedPlan_ = true;
@@ -367,8 +388,9 @@ namespace mongo {
             if ( res->complete() || plans_.size() > 1 )
                 return res;
             {
-                boostlock lk(NamespaceDetailsTransient::_qcMutex);
-                NamespaceDetailsTransient::get_inlock( fbs_.ns() ).registerIndexForPattern( fbs_.pattern( order_ ), BSONObj(), 0 );
+                NamespaceDetailsTransient& nsd = NamespaceDetailsTransient::_get( fbs_.ns() );
+                boostlock lk(nsd._qcMutex);
+                nsd.registerIndexForPattern( fbs_.pattern( order_ ), BSONObj(), 0 );
             }
             init();
         }
@@ -376,6 +398,12 @@ namespace mongo {
         return r.run();
     }
     
+    void QueryPlanSet::notePlanRun( long long nScanned, long long nReturned, int millis ) {
+        NamespaceDetailsTransient& nsd = NamespaceDetailsTransient::_get( fbs_.ns() );
+        boostlock lk(nsd._qcMutex);
+        nsd.notePlanRun( fbs_.pattern( order_ ), nScanned, nReturned, millis );
+    }
+    
     BSONObj QueryPlanSet::explain() const {
         vector< BSONObj > arr;
         for( PlanSet::const_iterator i = plans_.begin(); i != plans_.end(); ++i ) {
@@ -411,6 +439,7 @@ namespace mongo {
                 return *i;
         }
         
+        Timer t;
         long long nScanned = 0;
         long long nScannedBackup = 0;
         while( 1 ) {
@@ -425,6 +454,8 @@ namespace mongo {
                         nScanned += nScannedBackup;
                     if ( plans_.mayRecordPlan_ && op.mayRecordPlan() )
                         op.qp().registerSelf( nScanned );
+                    else if ( plans_.usingPrerecordedPlan_ && op.mayRecordPlan() )
+                        plans_.notePlanRun( nScanned, op.nReturned(), t.millis() );
                     return *i;
                 }
                 if ( op.error() )
@@ -488,7 +519,7 @@ namespace mongo {
                 return false;
             if ( strcmp( pe.fieldName(), ke.fieldName() ) != 0 )
                 return false;
-            if ( ( i == firstSignificantField ) && !( ( direction > 0 ) == ( pe.number() > 0 ) ) )
+            if ( ( i == firstSignificantField ) && !( ( direction > 0 ) == ( elementDirection( pe ) > 0 ) ) )
                 return false;
             ++i;
         }
@@ -575,6 +606,9 @@ namespace mongo {
             NamespaceDetails::IndexIterator i = d->ii();
             while( i.more() ) {
                 IndexDetails& ii = i.next();
+                // a hashed index has to be asked for by name, min and max would be hashes
+                if ( isHashedKeyPattern( ii.keyPattern() ) )
+                    continue;
                 if ( indexWorks( ii.keyPattern(), min.isEmpty() ? max : min, ret.first, ret.second ) ) {
                     id = &ii;
                     keyPattern = ii.keyPattern();
@@ -79,6 +79,8 @@ namespace mongo {
         virtual void init() = 0;
         virtual void next() = 0;
         virtual bool mayRecordPlan() const = 0;
+        // Number of documents produced, reported to the query cache for plan statistics.
+        virtual long long nReturned() const { return 0; }
         // Return a copy of the inheriting class, which will be run with its own
         // query plan.
         virtual QueryOp *clone() const = 0;
@@ -132,6 +134,7 @@ namespace mongo {
         }
         void init();
         void addHint( IndexDetails &id );
+        void notePlanRun( long long nScanned, long long nReturned, int millis );
         struct Runner {
             Runner( QueryPlanSet &plans, QueryOp &op );
             shared_ptr< QueryOp > run();
@@ -257,6 +257,26 @@ namespace mongo {
         return b.obj();
     }
     
+    string QueryPattern::toString() const {
+        stringstream ss;
+        ss << "{ ";
+        for( map< string, Type >::const_iterator i = fieldTypes_.begin(); i != fieldTypes_.end(); ++i ) {
+            if ( i != fieldTypes_.begin() )
+                ss << ", ";
+            ss << i->first << ": ";
+            switch( i->second ) {
+            case Equality: ss << "equality"; break;
+            case LowerBound: ss << "lowerBound"; break;
+            case UpperBound: ss << "upperBound"; break;
+            case UpperAndLowerBound: ss << "upperAndLowerBound"; break;
+            }
+        }
+        ss << " }";
+        if ( !sort_.isEmpty() )
+            ss << " sort: " << sort_.toString();
+        return ss.str();
+    }
+
     QueryPattern FieldRangeSet::pattern( const BSONObj &sort ) const {
         QueryPattern qp;
         for( map< string, FieldRange >::const_iterator i = ranges_.begin(); i != ranges_.end(); ++i ) {
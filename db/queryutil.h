@@ -118,6 +118,8 @@ namespace mongo {
                 return true;
             return sort_.woCompare( other.sort_ ) < 0;
         }
+        // for diagnostics, eg "{ a: equality, b: lowerBound } sort: { b: -1 }"
+        string toString() const;
     private:
         QueryPattern() {}
         void setSort( const BSONObj sort ) {
@@ -1103,7 +1103,7 @@ namespace mongo {
             // queryObj = { ts: { $gte: syncedTo } }
 
             log(2) << "repl: " << ns << ".find(" << queryObj.toString() << ')' << '\n';
-            cursor = conn->query( ns.c_str(), queryObj, 0, 0, 0, Option_CursorTailable | Option_SlaveOk | Option_OplogReplay );
+            cursor = conn->query( ns.c_str(), queryObj, 0, 0, 0, Option_CursorTailable | Option_SlaveOk | Option_OplogReplay | Option_AwaitData );
             c = cursor.get();
             tailing = false;
         }
@@ -1563,14 +1563,15 @@ namespace mongo {
             }
             try {
                 int nApplied = 0;
+                Timer t;
                 s = _replMain(sources, nApplied);
                 if( s == 1 ) { 
-                    if( nApplied == 0 ) s = 2;
-                    else if( nApplied > 100 ) { 
-                        // sleep very little - just enought that we aren't truly hammering master
-                        sleepmillis(75);
-                        s = 0;
-                    }
+                    /* the master holds our tailing getmore open until it has new ops (Option_AwaitData),
+                       so there is no need to sleep between passes.  a pass that comes back empty right
+                       away means a master that doesn't do that; don't hammer it.
+                    */
+                    if( nApplied == 0 && t.millis() < 100 ) s = 2;
+                    else s = 0;
                 }
             } catch (...) {
                 out() << "caught exception in _replMain" << endl;
@@ -21,6 +21,11 @@
 
 #include "dbtests.h"
 #include "../util/base64.h"
+#include "../util/message.h"
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#endif
 
 namespace BasicTests {
 
@@ -111,6 +116,139 @@ namespace BasicTests {
         }
     };
     
+    class MessagePieces {
+    public:
+        void run() {
+            const char *a = "abc";
+            string b = "defgh";
+            Message m;
+            m.appendPiece( a, 3 );
+            m.appendCopy( b.c_str(), 5 );
+            b = "XXXXX"; // the copy mustn't see this
+            m.appendPiece( a, 1 );
+
+            MsgData *d = (MsgData *) malloc( MsgDataHeaderSize );
+            d->len = MsgDataHeaderSize + m.piecesLen();
+            d->setOperation( opReply );
+            m.setData( d, true );
+            ASSERT( m.hasPieces() );
+            ASSERT_EQUALS( 9, m.piecesLen() );
+
+            m.consolidate();
+            ASSERT( !m.hasPieces() );
+            ASSERT_EQUALS( MsgDataHeaderSize + 9, m.data->len );
+            ASSERT_EQUALS( opReply, m.data->operation() );
+            ASSERT_EQUALS( string( "abcdefgha" ), string( m.data->_data, 9 ) );
+        }
+    };
+
+#if !defined(_WIN32)
+    /* a reply bigger than a small socket buffer, over a socketpair, so the first send is partial */
+    class SendPiecesBase {
+    public:
+        SendPiecesBase() {
+            ASSERT_EQUALS( 0, socketpair( AF_UNIX, SOCK_STREAM, 0, _fds ) );
+            int size = 4096;
+            setsockopt( _fds[ 0 ], SOL_SOCKET, SO_SNDBUF, &size, sizeof( size ) );
+            SockAddr far;
+            _port = new MessagingPort( _fds[ 0 ], far );
+            for ( int i = 0; i < 3; i++ ) {
+                _src[ i ] = (char *) malloc( PieceSize );
+                memset( _src[ i ], 'a' + i, PieceSize );
+                _m.appendPiece( _src[ i ], PieceSize );
+            }
+            MsgData *d = (MsgData *) malloc( MsgDataHeaderSize );
+            d->len = MsgDataHeaderSize + _m.piecesLen();
+            d->setOperation( opReply );
+            _m.setData( d, true );
+        }
+        virtual ~SendPiecesBase() {
+            _m.reset();
+            delete _port;
+            close( _fds[ 1 ] );
+            for ( int i = 0; i < 3; i++ )
+                free( _src[ i ] );
+        }
+    protected:
+        enum { PieceSize = 64 * 1024 };
+        /* what the other end should see, from the header the port filled in */
+        string expected() const {
+            return string( (char *) _m.data, MsgDataHeaderSize ) + string( PieceSize, 'a' ) +
+                string( PieceSize, 'b' ) + string( PieceSize, 'c' );
+        }
+        /* the data files changing under the reply */
+        void scribble() {
+            for ( int i = 0; i < 3; i++ )
+                memset( _src[ i ], 'X', PieceSize );
+        }
+        /* whatever has arrived, without waiting for more */
+        void readAvailable( string &into ) {
+            char buf[ 4096 ];
+            int x;
+            while ( ( x = recv( _fds[ 1 ], buf, sizeof( buf ), MSG_DONTWAIT ) ) > 0 )
+                into.append( buf, x );
+        }
+        static void readAll( int fd, string *into, int len ) {
+            char buf[ 4096 ];
+            while ( (int) into->size() < len ) {
+                int x = recv( fd, buf, min( (int) sizeof( buf ), len - (int) into->size() ), 0 );
+                if ( x <= 0 )
+                    break;
+                into->append( buf, x );
+            }
+        }
+        int _fds[ 2 ];
+        MessagingPort *_port;
+        char *_src[ 3 ];
+        Message _m;
+    };
+
+    /* copyUnsent keeps exactly what hadn't gone out, and the rest of the send picks up there */
+    class CopyUnsent : public SendPiecesBase {
+    public:
+        void run() {
+            _port->sayWithoutBlocking( _m, 7 );
+            string got;
+            readAvailable( got );
+            int total = _m.data->len;
+            ASSERT( got.size() > 0 );
+            ASSERT( (int) got.size() < total );
+
+            _m.copyUnsent();
+            scribble();
+
+            boost::thread reader( boost::bind( &SendPiecesBase::readAll, _fds[ 1 ], &got, total ) );
+            _port->say( _m );
+            reader.join();
+            ASSERT_EQUALS( total, (int) got.size() );
+            ASSERT( got == expected() );
+            ASSERT_EQUALS( 7, (int) ( (MsgData *) got.c_str() )->responseTo );
+        }
+    };
+
+    /* a pinned reply goes on from the original memory, and copies it once a writer waits */
+    class PinnedSend : public SendPiecesBase {
+    public:
+        void run() {
+            _port->sayWithoutBlocking( _m, 7 );
+            _m.pin();
+            ASSERT( _m.pinned() );
+            int total = _m.data->len;
+
+            boost::thread sender( boost::bind( &MessagingPort::say, _port, boost::ref( _m ), -1 ) );
+            responsePins.waitForNone();
+            ASSERT( !_m.pinned() );
+            scribble();
+
+            string got;
+            readAll( _fds[ 1 ], &got, total );
+            sender.join();
+            ASSERT_EQUALS( total, (int) got.size() );
+            ASSERT( got == expected() );
+        }
+    };
+#endif
+
     class All : public Suite {
     public:
         All() : Suite( "basic" ){
@@ -119,6 +257,11 @@ namespace BasicTests {
         void setupTests(){
             add< Rarely >();
             add< Base64Tests >();
+            add< MessagePieces >();
+#if !defined(_WIN32)
+            add< CopyUnsent >();
+            add< PinnedSend >();
+#endif
         }
     } myall;
     
@@ -20,10 +20,13 @@
 #include "stdafx.h"
 #include "../db/jsobj.h"
 #include "../db/json.h"
+#include "../scripting/engine.h"
 
 #include "dbtests.h"
 
 #include <limits>
+#include <fstream>
+#include <boost/filesystem/operations.hpp>
 
 namespace JsonTests {
     namespace JsonStringTests {
@@ -976,7 +979,133 @@ namespace JsonTests {
                 return "{ \"time.valid\" : { $gt : { \"$date\" :  1257829200000 } , $lt : { \"$date\" : 1257829200100 } } }";
             }
         };
-        
+
+        class ExponentNoDot : public Base {
+            virtual BSONObj bson() const {
+                BSONObjBuilder b;
+                b.append( "a", 1000.0 );
+                return b.obj();
+            }
+            virtual string json() const {
+                return "{ \"a\" : 1e3 }";
+            }
+        };
+
+        class DbrefSpaced : public Base {
+            virtual BSONObj bson() const {
+                BSONObjBuilder b;
+                OID o;
+                memset( &o, 0, 12 );
+                b.appendDBRef( "a", "ns", o );
+                return b.obj();
+            }
+            virtual string json() const {
+                return "{ \"a\" : Dbref(  \"ns\" ,  \"000000000000000000000000\"  ) }";
+            }
+        };
+
+        class TrailingComma : public Bad {
+            virtual string json() const {
+                return "{ \"a\" : 1, }";
+            }
+        };
+
+        class TrailingGarbage : public Bad {
+            virtual string json() const {
+                return "{ \"a\" : 1 } x";
+            }
+        };
+
+        class UnterminatedString : public Bad {
+            virtual string json() const {
+                return "{ \"a\" : \"b }";
+            }
+        };
+
+        /** Every object literal in jstests/ that fromjson accepts must match what the js engine makes of it. */
+        class Corpus {
+        public:
+            void run() {
+                boost::filesystem::path dir( "jstests" );
+                if ( !boost::filesystem::exists( dir ) ) {
+                    out() << "jstests/ not found, skipping json corpus" << endl;
+                    return;
+                }
+                auto_ptr< Scope > s( globalScriptEngine->createScope() );
+                int compared = 0;
+                int bad = 0;
+                boost::filesystem::directory_iterator end;
+                for ( boost::filesystem::directory_iterator i( dir ); i != end; ++i ) {
+                    string name = i->path().string();
+                    if ( name.size() < 3 || name.substr( name.size() - 3 ) != ".js" )
+                        continue;
+                    ifstream f( name.c_str() );
+                    stringstream ss;
+                    ss << f.rdbuf();
+                    string code = ss.str();
+                    for ( size_t start = code.find( '{' ); start != string::npos; start = code.find( '{', start + 1 ) ) {
+                        size_t end = matching( code, start );
+                        if ( end == string::npos )
+                            continue;
+                        string text = code.substr( start, end - start + 1 );
+                        if ( extended( text ) )
+                            continue;
+                        BSONObj parsed;
+                        try {
+                            parsed = fromjson( text );
+                        }
+                        catch ( MsgAssertionException& ) {
+                            continue;
+                        }
+                        if ( !s->exec( "__corpus = " + text + ";", "corpus", false, false, false ) ||
+                             s->type( "__corpus" ) != Object )
+                            continue;
+                        BSONObj js = s->getObject( "__corpus" );
+                        // js collapses repeated field names, fromjson keeps them all
+                        if ( js.nFields() != parsed.nFields() )
+                            continue;
+                        ++compared;
+                        if ( js.woCompare( parsed ) ) {
+                            ++bad;
+                            out() << name << ": " << text << endl;
+                            out() << "  fromjson: " << parsed.jsonString() << endl;
+                            out() << "  js      : " << js.jsonString() << endl;
+                        }
+                    }
+                }
+                out() << "json corpus: compared " << compared << " literals" << endl;
+                ASSERT( compared > 100 );
+                ASSERT_EQUALS( 0, bad );
+            }
+        private:
+            /** @return offset of the '}' closing the '{' at start, skipping quoted strings */
+            static size_t matching( const string &code, size_t start ) {
+                int depth = 0;
+                for ( size_t i = start; i < code.size(); ++i ) {
+                    char c = code[ i ];
+                    if ( c == '"' || c == '\'' ) {
+                        for ( ++i; i < code.size() && code[ i ] != c && code[ i ] != '\n'; ++i )
+                            if ( code[ i ] == '\\' )
+                                ++i;
+                        if ( i >= code.size() || code[ i ] == '\n' )
+                            return string::npos;
+                    }
+                    else if ( c == '{' )
+                        ++depth;
+                    else if ( c == '}' && --depth == 0 )
+                        return i;
+                }
+                return string::npos;
+            }
+            /** strict-mode wrappers mean something different to fromjson than to js */
+            static bool extended( const string &text ) {
+                const char *keys[] = { "$oid", "$date", "$regex", "$binary", "$ref", 0 };
+                for ( int i = 0; keys[ i ]; ++i )
+                    if ( text.find( keys[ i ] ) != string::npos )
+                        return true;
+                return false;
+            }
+        };
 
     } // namespace FromJsonTests
 
@@ -1059,6 +1188,12 @@ namespace JsonTests {
             add< FromJsonTests::NumericTypes >();
             add< FromJsonTests::NegativeNumericTypes >();
             add< FromJsonTests::EmbeddedDates >();
+            add< FromJsonTests::ExponentNoDot >();
+            add< FromJsonTests::DbrefSpaced >();
+            add< FromJsonTests::TrailingComma >();
+            add< FromJsonTests::TrailingGarbage >();
+            add< FromJsonTests::UnterminatedString >();
+            add< FromJsonTests::Corpus >();
         }
     } myall;
 
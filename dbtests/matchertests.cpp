@@ -108,6 +108,68 @@ namespace MatcherTests {
         }        
     };
     
+    class MultipleFields {
+    public:
+        void run() {
+            JSMatcher m( fromjson( "{a:1,'b.c':{$gt:2},d:/^x/,e:{$ne:null},f:{$nin:[1,2]}}" ) );
+            ASSERT( m.matches( fromjson( "{z:0,d:'xy',e:3,b:{c:3},a:1}" ) ) );
+            ASSERT( m.matches( fromjson( "{a:[0,1],b:[{c:1},{c:5}],d:['q','xq'],e:0,f:3}" ) ) );
+            ASSERT( !m.matches( fromjson( "{a:1,b:{c:2},d:'xy',e:3}" ) ) );
+            ASSERT( !m.matches( fromjson( "{a:1,b:{c:3},d:'yx',e:3}" ) ) );
+            ASSERT( !m.matches( fromjson( "{a:1,b:{c:3},d:'xy'}" ) ) );
+            ASSERT( !m.matches( fromjson( "{a:1,b:{c:3},d:'xy',e:3,f:2}" ) ) );
+            ASSERT( !m.matches( fromjson( "{b:{c:3},d:'xy',e:3}" ) ) );
+        }
+    };
+
+    class MissingNull {
+    public:
+        void run() {
+            JSMatcher m( fromjson( "{a:null,'b.c':null}" ) );
+            ASSERT( m.matches( fromjson( "{}" ) ) );
+            ASSERT( m.matches( fromjson( "{a:null,b:{}}" ) ) );
+            ASSERT( !m.matches( fromjson( "{a:1}" ) ) );
+            ASSERT( !m.matches( fromjson( "{b:{c:1}}" ) ) );
+        }
+    };
+
+    class DuplicateField {
+    public:
+        void run() {
+            // the first of repeated field names is the one matched, as with getField()
+            JSMatcher m( fromjson( "{a:1}" ) );
+            ASSERT( m.matches( fromjson( "{a:1,a:2}" ) ) );
+            ASSERT( !m.matches( fromjson( "{a:2,a:1}" ) ) );
+        }
+    };
+
+    class Ranges {
+    public:
+        void run() {
+            JSMatcher m( fromjson( "{a:{$ranges:[[1,3],[10,20]]}}" ) );
+            ASSERT( m.matches( fromjson( "{a:1}" ) ) );
+            ASSERT( m.matches( fromjson( "{a:2.5}" ) ) );
+            ASSERT( !m.matches( fromjson( "{a:3}" ) ) );
+            ASSERT( !m.matches( fromjson( "{a:5}" ) ) );
+            ASSERT( m.matches( fromjson( "{a:10}" ) ) );
+            ASSERT( !m.matches( fromjson( "{a:20}" ) ) );
+
+            BSONObjBuilder b;
+            {
+                BSONObjBuilder a( b.subobjStart( "a" ) );
+                BSONObjBuilder list( a.subarrayStart( "$ranges" ) );
+                BSONObjBuilder r( list.subarrayStart( "0" ) );
+                r.appendMinKey( "0" );
+                r.append( "1" , 0 );
+                r.done();
+                list.done();
+                a.done();
+            }
+            JSMatcher n( b.obj() );
+            ASSERT( n.matches( fromjson( "{a:-5}" ) ) );
+            ASSERT( !n.matches( fromjson( "{a:0}" ) ) );
+        }
+    };
 
     class All : public Suite {
     public:
@@ -121,6 +183,10 @@ namespace MatcherTests {
             add< MixedNumericGt >();
             add< MixedNumericIN >();
             add< Size >();
+            add< MultipleFields >();
+            add< MissingNull >();
+            add< DuplicateField >();
+            add< Ranges >();
         }
     } dball;
     
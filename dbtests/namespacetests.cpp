@@ -435,6 +435,53 @@ namespace NamespaceTests {
             }
             
         };
+
+        class Hashed : public Base {
+        public:
+            void run(){
+                create();
+
+                BSONObjSetDefaultOrder keys;
+                id().getKeysFromObject( fromjson( "{x:5,y:'b'}" ) , keys );
+                checkSize( 1 , keys );
+                ASSERT_EQUALS( NumberLong , keys.begin()->firstElement().type() );
+                BSONObj five = *keys.begin();
+
+                // equal values hash the same whatever their numeric type
+                keys.clear();
+                id().getKeysFromObject( BSON( "x" << 5.0 ) , keys );
+                assertEquals( five , *keys.begin() );
+
+                keys.clear();
+                id().getKeysFromObject( fromjson( "{x:6}" ) , keys );
+                ASSERT( five.woCompare( *keys.begin() ) != 0 );
+
+                // missing is the same as null
+                BSONObjSetDefaultOrder missing;
+                id().getKeysFromObject( fromjson( "{y:1}" ) , missing );
+                keys.clear();
+                id().getKeysFromObject( fromjson( "{x:null}" ) , keys );
+                checkSize( 1 , missing );
+                assertEquals( *missing.begin() , *keys.begin() );
+
+                keys.clear();
+                ASSERT_EXCEPTION( id().getKeysFromObject( fromjson( "{x:[1,2]}" ) , keys ),
+                                  UserException );
+
+                // embedded objects hash field by field, numbers by value
+                BSONObjSetDefaultOrder a, b, c;
+                id().getKeysFromObject( fromjson( "{x:{p:5,q:[1,{r:2}]}}" ) , a );
+                id().getKeysFromObject( fromjson( "{x:{p:5.0,q:[1.0,{r:2.0}]}}" ) , b );
+                id().getKeysFromObject( fromjson( "{x:{q:[1,{r:2}],p:5}}" ) , c );
+                assertEquals( *a.begin() , *b.begin() );
+                ASSERT( a.begin()->woCompare( *c.begin() ) != 0 );
+            }
+
+        private:
+            virtual BSONObj key() const {
+                return BSON( "x" << "hashed" );
+            }
+        };
         
         class ArraySubelementComplex : public Base {
         public:
@@ -782,6 +829,7 @@ namespace NamespaceTests {
             add< IndexDetailsTests::MissingField >();
             add< IndexDetailsTests::SubobjectMissing >();
             add< IndexDetailsTests::CompoundMissing >();
+            add< IndexDetailsTests::Hashed >();
             add< NamespaceDetailsTests::Create >();
             add< NamespaceDetailsTests::SingleAlloc >();
             add< NamespaceDetailsTests::Realloc >();
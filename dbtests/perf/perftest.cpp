@@ -20,7 +20,9 @@
 #include "stdafx.h"
 
 #include "../../client/dbclient.h"
+#include "../../db/client.h"
 #include "../../db/instance.h"
+#include "../../db/matcher.h"
 #include "../../db/query.h"
 #include "../../db/queryoptimizer.h"
 #include "../../util/file_allocator.h"
@@ -310,6 +312,24 @@ namespace BSON {
         }
     };
 
+    // One large document, as mongoimport --jsonArray style input would produce.
+    class BigParse {
+    public:
+        BigParse() {
+            stringstream ss;
+            ss << "{ a : [ ";
+            for( int i = 0; i < 10000; ++i )
+                ss << ( i ? ", " : "" ) << "{ \"x\" : " << i << ", \"y\" : " << i << ".5, \"s\" : \"str" << i << "\" }";
+            ss << " ] }";
+            json_ = ss.str();
+        }
+        void run() {
+            for( int i = 0; i < 20; ++i )
+                fromjson( json_ );
+        }
+        string json_;
+    };
+
     class Json {
     public:
         Json() : o_( fromjson( sample ) ) {}
@@ -336,6 +356,7 @@ namespace BSON {
         void setupTests(){
             add< Parse >();
             add< ShopwikiParse >();
+            add< BigParse >();
             add< Json >();
             add< ShopwikiJson >();
         }
@@ -687,6 +708,203 @@ namespace Plan {
 
 } // namespace Plan
 
+namespace Transient {
+
+    // NamespaceDetailsTransient lookup is paid on every query and every write.
+    class Get {
+    public:
+        Get() : ns_( testNs( this ) ) {
+            lk_.reset( new dblock );
+        }
+        void run() {
+            for( int i = 0; i < 1000000; ++i )
+                NamespaceDetailsTransient::_get( ns_.c_str() );
+        }
+        string ns_;
+        auto_ptr< dblock > lk_;
+    };
+
+    class GetMany {
+    public:
+        GetMany() {
+            for( int i = 0; i < 1000; ++i ) {
+                stringstream ss;
+                ss << testNs( this ) << i;
+                ns_.push_back( ss.str() );
+            }
+            lk_.reset( new dblock );
+        }
+        void run() {
+            for( int i = 0; i < 1000000; ++i )
+                NamespaceDetailsTransient::_get( ns_[ i % 1000 ].c_str() );
+        }
+        vector< string > ns_;
+        auto_ptr< dblock > lk_;
+    };
+
+    class RecordedPlan {
+    public:
+        RecordedPlan() : ns_( testNs( this ) ), pattern_( FieldRangeSet( ns_.c_str(), BSON( "a" << 1 ) ).pattern() ) {
+            lk_.reset( new dblock );
+        }
+        void run() {
+            for( int i = 0; i < 1000000; ++i ) {
+                NamespaceDetailsTransient &nsd = NamespaceDetailsTransient::_get( ns_.c_str() );
+                boostlock lk( nsd._qcMutex );
+                nsd.indexForPattern( pattern_ );
+            }
+        }
+        string ns_;
+        QueryPattern pattern_;
+        auto_ptr< dblock > lk_;
+    };
+
+    class All : public RunnerSuite {
+    public:
+        All() : RunnerSuite( "transient" ){}
+        void setupTests(){
+            add< Get >();
+            add< GetMany >();
+            add< RecordedPlan >();
+        }
+    } all;
+
+} // namespace Transient
+
+namespace Matcher {
+
+    // A wide document and an eight predicate query over it.
+    BSONObj wide() {
+        BSONObjBuilder b;
+        for( int i = 0; i < 50; ++i ) {
+            stringstream ss;
+            ss << "f" << i;
+            b.append( ss.str().c_str(), i );
+        }
+        b.append( "name", "joe" );
+        b.append( "sub", BSON( "x" << 1 << "y" << "abc" ) );
+        return b.obj();
+    }
+
+    const char *eight = "{f3:3,f10:{$gt:5},f20:{$lt:100},f30:{$in:[29,30,31]},"
+    "f40:{$ne:0},f49:{$gte:49},name:'joe','sub.x':1}";
+
+    class EightMatch {
+    public:
+        EightMatch() : o_( wide() ), m_( fromjson( eight ) ) {}
+        void run() {
+            for( int i = 0; i < 100000; ++i )
+                assert( m_.matches( o_ ) );
+        }
+        BSONObj o_;
+        JSMatcher m_;
+    };
+
+    class EightNoMatch {
+    public:
+        EightNoMatch() : o_( wide() ), m_( fromjson( "{f3:3,f10:{$gt:5},f20:{$lt:100},f30:{$in:[29,30,31]},"
+                                                      "f40:{$ne:0},f49:{$gte:49},name:'joe','sub.x':2}" ) ) {}
+        void run() {
+            for( int i = 0; i < 100000; ++i )
+                assert( !m_.matches( o_ ) );
+        }
+        BSONObj o_;
+        JSMatcher m_;
+    };
+
+    class Missing {
+    public:
+        Missing() : o_( wide() ), m_( fromjson( "{f1:1,nothere:null}" ) ) {}
+        void run() {
+            for( int i = 0; i < 100000; ++i )
+                assert( m_.matches( o_ ) );
+        }
+        BSONObj o_;
+        JSMatcher m_;
+    };
+
+    class Regex {
+    public:
+        Regex() : o_( wide() ), m_( fromjson( "{f48:48,name:/^jo/,'sub.y':/b/}" ) ) {}
+        void run() {
+            for( int i = 0; i < 100000; ++i )
+                assert( m_.matches( o_ ) );
+        }
+        BSONObj o_;
+        JSMatcher m_;
+    };
+
+    class All : public RunnerSuite {
+    public:
+        All() : RunnerSuite( "matcher" ){}
+        void setupTests(){
+            add< EightMatch >();
+            add< EightNoMatch >();
+            add< Missing >();
+            add< Regex >();
+        }
+    } all;
+
+} // namespace Matcher
+
+namespace ShardVersion {
+
+    // Every message goes through the shard version check before it locks.  Plain is a
+    // connection that never set a version, Sharded one that set them for a few namespaces.
+    class Plain {
+    public:
+        Plain() : ns_( testNs( this ) ) {
+            client_->insert( ns_.c_str(), BSON( "_id" << 0 ) );
+        }
+        void run() {
+            for( int i = 0; i < 100000; ++i )
+                client_->findOne( ns_.c_str(), QUERY( "_id" << 0 ) );
+        }
+        string ns_;
+    };
+
+    // A connection stays in sharded mode once it's set a version, so this one gets a thread,
+    // and a Client, of its own.
+    class Sharded {
+    public:
+        Sharded() : ns_( testNs( this ) ) {
+            client_->insert( ns_.c_str(), BSON( "_id" << 0 ) );
+        }
+        void run() {
+            boost::thread t( boost::bind( &Sharded::shardedThread, this ) );
+            t.join();
+        }
+        void shardedThread() {
+            Client::initThread( "perftest sharded" );
+            DBDirectClient c;
+            for( int i = 0; i < 8; ++i ) {
+                stringstream ss;
+                ss << ns_ << i;
+                setVersion( c, ss.str() );
+            }
+            setVersion( c, ns_ );
+            for( int i = 0; i < 100000; ++i )
+                c.findOne( ns_.c_str(), QUERY( "_id" << 0 ) );
+            cc().shutdown();
+        }
+        void setVersion( DBDirectClient &c, const string &ns ) {
+            BSONObj info;
+            ASSERT( c.runCommand( "admin", BSON( "setShardVersion" << ns << "configdb" << "perftest" << "version" << 1 << "authoritative" << true ), info ) );
+        }
+        string ns_;
+    };
+
+    class All : public RunnerSuite {
+    public:
+        All() : RunnerSuite( "shardversion" ){}
+        void setupTests(){
+            add< Plain >();
+            add< Sharded >();
+        }
+    } all;
+
+} // namespace ShardVersion
+
 int main( int argc, char **argv ) {
     logLevel = -1;
     client_ = new DBDirectClient();
@@ -1018,6 +1018,35 @@ namespace QueryOptimizerTests {
             }
         };
         
+        class RecordedPlanDegrades : public Base {
+        public:
+            void run() {
+                Helpers::ensureIndex( ns(), BSON( "a" << 1 ), false, "a_1" );
+                QueryPattern p = FieldRangeSet( ns(), BSON( "a" << 1 ) ).pattern();
+                NamespaceDetailsTransient &nsd = NamespaceDetailsTransient::_get( ns() );
+                nsd.registerIndexForPattern( p, BSON( "a" << 1 ), 10 );
+                nsd.notePlanRun( p, 20, 1, 0 );
+                ASSERT( BSON( "a" << 1 ).woCompare( nsd.indexForPattern( p ) ) == 0 );
+                nsd.notePlanRun( p, 1000, 1, 0 );
+                ASSERT( nsd.indexForPattern( p ).isEmpty() );
+            }
+        };
+        
+        class RecordedPlanStaleAfterWrites : public Base {
+        public:
+            void run() {
+                Helpers::ensureIndex( ns(), BSON( "a" << 1 ), false, "a_1" );
+                QueryPattern p = FieldRangeSet( ns(), BSON( "a" << 1 ) ).pattern();
+                NamespaceDetailsTransient &nsd = NamespaceDetailsTransient::_get( ns() );
+                nsd.registerIndexForPattern( p, BSON( "a" << 1 ), 1 );
+                for( int i = 0; i < 99; ++i )
+                    nsd.notifyOfWriteOp();
+                ASSERT( BSON( "a" << 1 ).woCompare( nsd.indexForPattern( p ) ) == 0 );
+                nsd.notifyOfWriteOp();
+                ASSERT( nsd.indexForPattern( p ).isEmpty() );
+            }
+        };
+        
         class InQueryIntervals : public Base {
         public:
             void run() {
@@ -1155,6 +1184,8 @@ namespace QueryOptimizerTests {
             add< QueryPlanSetTests::DeleteOneScan >();
             add< QueryPlanSetTests::DeleteOneIndex >();
             add< QueryPlanSetTests::TryOtherPlansBeforeFinish >();
+            add< QueryPlanSetTests::RecordedPlanDegrades >();
+            add< QueryPlanSetTests::RecordedPlanStaleAfterWrites >();
             add< QueryPlanSetTests::InQueryIntervals >();
             add< QueryPlanSetTests::EqualityThenIn >();
             add< QueryPlanSetTests::NotEqualityThenIn >();
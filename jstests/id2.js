@@ -0,0 +1,46 @@
+// _id must survive a round trip through the shell even if the script never reads it
+
+t = db.id2;
+t.drop();
+
+t.save( { _id : 1 , a : 1 } );
+t.save( { _id : "s" , a : 1 } );
+t.save( { a : 1 } );
+
+// int _id, changed but never read
+o = t.findOne( { _id : 1 } );
+o.x = 1;
+t.update( { _id : 1 } , o );
+assert.eq( 3 , t.count() , "A1" );
+assert.eq( 1 , t.findOne( { _id : 1 } ).x , "A2" );
+assert.eq( 1 , t.find( { x : 1 } ).count() , "A3" );
+
+// ObjectId _id, changed but never read
+o = t.findOne( { a : 1 , x : { $exists : false } , _id : { $type : 7 } } );
+o.x = 2;
+t.update( { x : { $exists : false } , _id : { $type : 7 } } , o );
+assert.eq( 3 , t.count() , "B1" );
+assert.eq( 1 , t.find( { x : 2 , _id : { $type : 7 } } ).count() , "B2" );
+
+// save() reads _id itself, and must not insert a second copy
+o = t.findOne( { _id : "s" } );
+o.x = 3;
+t.save( o );
+assert.eq( 3 , t.count() , "C1" );
+assert.eq( 3 , t.findOne( { _id : "s" } ).x , "C2" );
+
+// reading a nested object doesn't change anything, writing to it does
+t.save( { _id : 2 , n : { b : 1 } } );
+o = t.findOne( { _id : 2 } );
+assert.eq( 1 , o.n.b , "D1" );
+o.n.b = 5;
+t.save( o );
+assert.eq( 5 , t.findOne( { _id : 2 } ).n.b , "D2" );
+assert.eq( 4 , t.count() , "D3" );
+
+// server side, same thing
+assert.eq( 1 , db.eval( function(){ var o = db.id2.findOne( { _id : 1 } ); o.y = 1; db.id2.update( { _id : 1 } , o ); return db.id2.find( { _id : 1 , y : 1 } ).count(); } ) , "E1" );
+assert.eq( 4 , t.count() , "E2" );
+
+// missing fields read as undefined on a document
+assert.eq( "undefined" , typeof( t.findOne( { _id : 1 } ).zzz ) , "F1" );
@@ -0,0 +1,50 @@
+// a hashed index finds single values, but can't do ranges or sorting
+
+t = db.index_hashed;
+t.drop();
+
+for ( i=0; i<100; i++ )
+    t.save( { a : i , b : i % 10 } );
+t.save( { b : -1 } );
+
+t.ensureIndex( { a : "hashed" } );
+assert.eq( 2 , t.getIndexes().length , "indexes" );
+
+assert.eq( 1 , t.find( { a : 5 } ).itcount() , "A1" );
+assert.eq( 1 , t.find( { a : 5.0 } ).itcount() , "A2" );
+assert.eq( 0 , t.find( { a : "5" } ).itcount() , "A3" );
+assert.eq( 1 , t.find( { a : 5 } ).explain().nscanned , "A4" );
+assert.eq( 1 , t.find( { a : null } ).itcount() , "A5" );
+assert.eq( 1 , t.find( { a : 5 } ).count() , "A6" );
+
+// ranges and sorts still come out right, just without the index's help
+assert.eq( 10 , t.find( { a : { $lt : 10 } } ).itcount() , "B1" );
+assert.eq( 10 , t.find( { a : { $lt : 10 } } ).count() , "B2" );
+assert.eq( [ 0 , 1 , 2 ] , t.find( { a : { $gte : 0 } } ).sort( { a : 1 } ).limit( 3 ).toArray().map( function(z){ return z.a; } ) , "B3" );
+
+t.update( { a : 7 } , { $set : { b : 70 } } );
+assert.eq( 70 , t.findOne( { a : 7 } ).b , "C1" );
+t.remove( { a : 8 } );
+assert.eq( 0 , t.find( { a : 8 } ).itcount() , "C2" );
+assert.eq( 100 , t.find().itcount() , "C3" );
+
+// can't hash an array
+t.save( { a : [ 1 , 2 ] } );
+assert( db.getLastError() , "E1" );
+assert.eq( 100 , t.find().itcount() , "E2" );
+
+// only one field
+t.ensureIndex( { a : "hashed" , b : 1 } );
+assert.eq( 2 , t.getIndexes().length , "F1" );
+
+// embedded objects hash by value, like the matcher compares them
+t.save( { a : { x : 5 , y : [ 1 , 2 ] } } );
+assert.eq( 1 , t.find( { a : { x : 5.0 , y : [ 1.0 , 2 ] } } ).itcount() , "G1" );
+assert.eq( 1 , t.find( { a : { x : 5.0 , y : [ 1.0 , 2 ] } } ).explain().nscanned , "G2" );
+
+// different values can hash alike, so no unique hashed index
+u = db.index_hashed_unique;
+u.drop();
+u.save( { a : 1 } );
+u.ensureIndex( { a : "hashed" } , { unique : true } );
+assert.eq( 1 , u.getIndexes().length , "H1" );
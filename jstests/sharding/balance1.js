@@ -0,0 +1,34 @@
+// balance1.js
+
+s = new ShardingTest( "balance1" , 2 , 1 , 1 );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { num : 1 } } );
+
+db = s.getDB( "test" );
+for ( var i=0; i<200; i++ )
+    db.foo.save( { num : i } );
+db.getLastError();
+
+for ( var i=10; i<200; i+=10 )
+    s.adminCommand( { split : "test.foo" , middle : { num : i } } );
+
+function diff(){
+    var x = s.config.chunks.count( { ns : "test.foo" , shard : s._serverNames[0] } );
+    var y = s.config.chunks.count( { ns : "test.foo" , shard : s._serverNames[1] } );
+    return Math.abs( x - y );
+}
+
+assert.eq( 20 , s.config.chunks.count() , "setup" );
+assert.lt( 10 , diff() , "should start unbalanced" );
+
+s.setBalancer( true );
+assert.soon( function(){
+    var d = diff();
+    print( "diff: " + d );
+    return d < 5;
+} , "balance didn't happen" , 1000 * 60 * 3 , 5000 );
+
+assert.eq( 200 , db.foo.find().itcount() , "lost docs" );
+
+s.stop();
@@ -0,0 +1,32 @@
+// changelog1.js - a second mongos hears about splits and moves from config.changelog, before anything goes stale
+
+s = new ShardingTest( "changelog1" , 2 , 0 , 2 );
+
+s2 = s._mongos[1];
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { num : 1 } } );
+
+for ( var i=0; i<100; i++ )
+    s.getDB( "test" ).foo.save( { num : i } );
+s.getDB( "test" ).getLastError();
+
+// so the second one has the collection cached
+assert.eq( 100 , s2.getDB( "test" ).foo.find().itcount() , "other A" );
+
+function version( m ){
+    return tojson( m.getDB( "admin" ).runCommand( { getShardVersion : "test.foo" } ).version );
+}
+
+s.adminCommand( { split : "test.foo" , middle : { num : 50 } } );
+s.adminCommand( { movechunk : "test.foo" , find : { num : 50 } , to : s.getOther( s.getServer( "test" ) ).name } );
+
+assert.eq( 1 , s.config.changelog.find( { what : "split" , ns : "test.foo" } ).count() , "logged split" );
+assert.eq( 1 , s.config.changelog.find( { what : "moveChunk" , ns : "test.foo" } ).count() , "logged move" );
+
+// nothing has gone through the second mongos since, so only the changelog can tell it
+assert.soon( function(){ return version( s2 ) == version( s.s ); } , "other mongos never caught up" , 30000 );
+
+assert.eq( 100 , s2.getDB( "test" ).foo.find().itcount() , "other B" );
+
+s.stop();
@@ -0,0 +1,48 @@
+// cursor1.js - mongos keeps a cursor open between batches and lets go of it when it's done
+
+s = new ShardingTest( "cursor1" , 2 );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { num : 1 } } );
+
+db = s.getDB( "test" );
+
+big = "";
+while ( big.length < 1024 )
+    big += "asdasdasdasdasdasdasdasdasd";
+
+num = 3000;
+for ( var i=0; i<num; i++ )
+    db.foo.save( { num : i , s : big } );
+db.getLastError();
+
+s.adminCommand( { split : "test.foo" , middle : { num : num / 2 } } );
+s.adminCommand( { movechunk : "test.foo" , find : { num : num / 2 } , to : s.getOther( s.getServer( "test" ) ).name } );
+
+function open(){
+    return s.admin.runCommand( { cursorInfo : 1 } ).totalOpen;
+}
+
+assert.eq( 0 , open() , "A" );
+
+// more than fits in a batch, so the cursor stays open after the first
+c = db.foo.find();
+c.next();
+assert.eq( 1 , open() , "B" );
+
+var n = 1;
+while ( c.hasNext() ){
+    c.next();
+    n++;
+}
+assert.eq( num , n , "all" );
+assert.eq( 0 , open() , "C" );
+
+// sorted across both shards
+c = db.foo.find().sort( { s : 1 , num : -1 } );
+assert.eq( num - 1 , c.next().num , "sorted first" );
+assert.eq( 1 , open() , "D" );
+assert.eq( num - 1 , c.itcount() , "sorted rest" );
+assert.eq( 0 , open() , "E" );
+
+s.stop();
@@ -132,7 +132,38 @@ assert.eq( 3 , db.foo6.find().count() );
 s.adminCommand( { split : "test.foo6" , middle : { a : 2 } } );
 s.adminCommand( { movechunk : "test.foo6" , find : { a : 3 } , to : s.getOther( s.getServer( "test" ) ).name } );
 
-assert.throws( function(){ db.foo6.group( { key : { a : 1 } , initial : { count : 0 } , reduce : function(z,prev){ prev.count++; } } ); } );;
+x = db.foo6.group( { key : { a : 1 } , initial : { count : 0 } , reduce : function(z,prev){ prev.count++; } } );
+assert.eq( 2 , x.length , "sharded group 1" );
+x.sort( function(l,r){ return l.a - r.a; } );
+assert.eq( 1 , x[0].count , "sharded group 2" );
+assert.eq( 2 , x[1].count , "sharded group 3" );
+
+// a key spanning shards needs combine
+assert.throws( function(){ db.foo6.group( { initial : { count : 0 } , reduce : function(z,prev){ prev.count++; } } ); } );
+x = db.foo6.group( { initial : { count : 0 } , reduce : function(z,prev){ prev.count++; } ,
+                     combine : function(a,b){ a.count += b.count; } ,
+                     finalize : function(o){ o.twice = o.count * 2; } } );
+assert.eq( 1 , x.length , "sharded group combine 1" );
+assert.eq( 3 , x[0].count , "sharded group combine 2" );
+assert.eq( 6 , x[0].twice , "sharded group finalize" );
+
+// a shard's chunks all go in one command even when they aren't next to each other,
+// so a key that only that shard has doesn't need combine
+s.adminCommand( { shardcollection : "test.foo7" , key : { a : 1 } } );
+db.foo7.save( { a : 1 , b : 1 } );
+db.foo7.save( { a : 5 , b : 2 } );
+db.foo7.save( { a : 9 , b : 1 } );
+s.adminCommand( { split : "test.foo7" , middle : { a : 3 } } );
+s.adminCommand( { split : "test.foo7" , middle : { a : 7 } } );
+s.adminCommand( { movechunk : "test.foo7" , find : { a : 5 } , to : s.getOther( s.getServer( "test" ) ).name } );
+
+x = db.foo7.group( { key : { b : 1 } , initial : { count : 0 } , reduce : function(z,prev){ prev.count++; } } );
+assert.eq( 2 , x.length , "split runs group 1" );
+x.sort( function(l,r){ return l.b - r.b; } );
+assert.eq( 2 , x[0].count , "split runs group 2" );
+assert.eq( 1 , x[1].count , "split runs group 3" );
+assert.eq( 3 , db.foo7.count() , "split runs count" );
+assert.eq( 2 , db.foo7.count( { b : 1 } ) , "split runs count query" );
 
 
 s.stop()
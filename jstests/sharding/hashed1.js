@@ -0,0 +1,54 @@
+// hashed1.js - a hashed shard key spreads ascending inserts over all the shards
+
+s = new ShardingTest( "hashed1" , 2 );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { num : "hashed" } } );
+
+// presplit, evenly
+assert.eq( 4 , s.config.chunks.count() , "presplit" );
+s.config.shards.find().forEach(
+    function(z){
+        assert.eq( 2 , s.config.chunks.count( { shard : z.host } ) , "presplit " + z.host );
+    }
+);
+
+db = s.getDB( "test" );
+
+for ( var i=0; i<200; i++ )
+    db.foo.save( { num : i } );
+db.getLastError();
+
+assert.eq( 200 , db.foo.find().itcount() , "all" );
+assert.eq( 200 , db.foo.count() , "count" );
+
+// the ascending keys didn't all land in the last chunk
+s._connections.forEach(
+    function(z){
+        var n = z.getDB( "test" ).foo.count();
+        assert( n > 20 , "lopsided: " + n );
+    }
+);
+
+// point queries and updates still go to one place
+for ( var i=0; i<200; i+=17 ){
+    assert.eq( 1 , db.foo.find( { num : i } ).itcount() , "find " + i );
+    assert.eq( i , db.foo.findOne( { num : i } ).num , "findOne " + i );
+}
+db.foo.update( { num : 5 } , { num : 5 , x : 1 } );
+assert.eq( 1 , db.foo.findOne( { num : 5 } ).x , "update" );
+
+// ranges and sorts have to ask everyone
+assert.eq( 10 , db.foo.find( { num : { $lt : 10 } } ).itcount() , "range" );
+assert.eq( [ 0 , 1 , 2 ] , db.foo.find().sort( { num : 1 } ).limit( 3 ).toArray().map( function(z){ return z.num; } ) , "sort" );
+
+// a chunk is still found and moved by a document in it
+var from = s._connections[0].getDB( "test" ).foo.findOne( { num : 3 } ) ? s._connections[0] : s._connections[1];
+var to = s.getOther( from );
+s.adminCommand( { movechunk : "test.foo" , find : { num : 3 } , to : to.name } );
+assert.eq( 1 , to.getDB( "test" ).foo.find( { num : 3 } ).itcount() , "moved" );
+assert.eq( 0 , from.getDB( "test" ).foo.find( { num : 3 } ).itcount() , "moved from" );
+assert.eq( 200 , db.foo.find().itcount() , "after move" );
+assert.eq( 200 , from.getDB( "test" ).foo.count() + to.getDB( "test" ).foo.count() , "after move, on shards" );
+
+s.stop();
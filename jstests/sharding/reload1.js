@@ -0,0 +1,40 @@
+// reload1.js - a second mongos picks up splits, moves and a re-sharded collection
+
+s = new ShardingTest( "reload1" , 2 , 1 , 2 );
+
+s2 = s._mongos[1];
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { num : 1 } } );
+
+for ( var i=0; i<100; i++ )
+    s.getDB( "test" ).foo.save( { num : i } );
+
+assert.eq( 100 , s2.getDB( "test" ).foo.find().itcount() , "other A" );
+
+other = s.getOther( s.getServer( "test" ) ).name;
+for ( var i=10; i<100; i+=10 ){
+    s.adminCommand( { split : "test.foo" , middle : { num : i } } );
+    if ( i % 20 == 0 )
+        s.adminCommand( { movechunk : "test.foo" , find : { num : i } , to : other } );
+}
+assert.eq( 10 , s.config.chunks.count() , "chunks" );
+
+for ( var i=0; i<100; i+=5 )
+    assert.eq( 1 , s2.getDB( "test" ).foo.find( { num : i } ).itcount() , "other find " + i );
+
+for ( var i=100; i<110; i++ )
+    s2.getDB( "test" ).foo.save( { num : i } );
+assert.eq( 110 , s.getDB( "test" ).foo.find().itcount() , "normal B" );
+assert.eq( 110 , s2.getDB( "test" ).foo.find().itcount() , "other B" );
+
+// dropped and sharded again, the old chunks mustn't linger
+s.getDB( "test" ).foo.drop();
+s.adminCommand( { shardcollection : "test.foo" , key : { num : 1 } } );
+for ( var i=0; i<10; i++ )
+    s.getDB( "test" ).foo.save( { num : i } );
+s.adminCommand( { split : "test.foo" , middle : { num : 5 } } );
+
+assert.eq( 10 , s2.getDB( "test" ).foo.find().itcount() , "other C" );
+
+s.stop();
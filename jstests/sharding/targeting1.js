@@ -0,0 +1,60 @@
+// targeting1.js - updates and deletes without an exact shard key only go to the shards that could match
+
+s = new ShardingTest( "targeting1" , 2 );
+
+s.adminCommand( { enablesharding : "test" } );
+s.adminCommand( { shardcollection : "test.foo" , key : { num : 1 } } );
+
+db = s.getDB( "test" );
+
+for ( var i=0; i<100; i++ )
+    db.foo.save( { num : i } );
+db.getLastError();
+
+primary = s.getServer( "test" );
+secondary = s.getOther( primary );
+
+s.adminCommand( { split : "test.foo" , middle : { num : 50 } } );
+s.adminCommand( { movechunk : "test.foo" , find : { num : 50 } , to : secondary.name } );
+
+primary = primary.getDB( "test" );
+secondary = secondary.getDB( "test" );
+
+assert.eq( 50 , primary.foo.count() , "setup primary" );
+assert.eq( 50 , secondary.foo.count() , "setup secondary" );
+
+// $in all on one shard is fine for a single update
+db.foo.update( { num : { $in : [ 3 , 7 ] } } , { $set : { x : 1 } } );
+assert( ! db.getLastError() , "single update, one shard" );
+assert.eq( 1 , db.foo.find( { x : 1 } ).itcount() , "single update, one shard count" );
+
+// but not when it spans them
+db.foo.update( { num : { $in : [ 3 , 70 ] } } , { $set : { x : 2 } } );
+assert( db.getLastError() , "single update, two shards" );
+assert.eq( 0 , db.foo.find( { x : 2 } ).itcount() , "single update, two shards count" );
+
+// multi updates hit what they need to
+db.foo.update( { num : { $in : [ 3 , 70 ] } } , { $inc : { y : 1 } } , false , true );
+assert( ! db.getLastError() , "multi $in" );
+assert.eq( 1 , primary.foo.find( { y : 1 } ).itcount() , "multi $in primary" );
+assert.eq( 1 , secondary.foo.find( { y : 1 } ).itcount() , "multi $in secondary" );
+
+db.foo.update( { num : { $gt : 60 } } , { $inc : { z : 1 } } , false , true );
+assert.eq( 39 , secondary.foo.find( { z : 1 } ).itcount() , "multi range" );
+assert.eq( 0 , primary.foo.find( { z : 1 } ).itcount() , "multi range primary" );
+
+// deletes
+db.foo.remove( { num : { $in : [ 1 , 2 , 80 ] } } );
+assert( ! db.getLastError() , "remove $in" );
+assert.eq( 97 , db.foo.count() , "remove $in count" );
+assert.eq( 48 , primary.foo.count() , "remove $in primary" );
+
+db.foo.remove( { num : { $gte : 90 } } );
+assert.eq( 87 , db.foo.count() , "remove range" );
+assert.eq( 39 , secondary.foo.count() , "remove range secondary" );
+
+// queries too
+assert.eq( 3 , db.foo.find( { num : { $in : [ 4 , 5 , 60 ] } } ).itcount() , "find $in" );
+assert.eq( 0 , db.foo.find( { num : { $gt : 5 , $lt : 3 } } ).itcount() , "find nothing" );
+
+s.stop();
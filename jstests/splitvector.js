@@ -0,0 +1,49 @@
+f = db.jstests_splitvector;
+f.drop();
+
+f.ensureIndex( {i:1} );
+
+s = "";
+while ( s.length < 100 )
+    s += "asdf";
+
+for( i = 0; i < 1000; ++i ) {
+    f.save( {i:i,s:s} );
+}
+
+function split( maxChunkSize, min, max ) {
+    return db.runCommand( {splitVector:"test.jstests_splitvector", keyPattern:{i:1}, min:min || {i:0}, max:max || {i:1000}, maxChunkSize:maxChunkSize} );
+}
+
+r = split( 1 );
+assert( r.ok );
+avg = r.avgObjSize;
+assert.eq( 1000, r.numObjects );
+
+// fits in one chunk, no split
+assert.eq( 0, split( avg * 2000 ).splitKeys.length );
+
+// split into pieces of half the max size
+r = split( avg * 200 );
+assert.eq( 9, r.splitKeys.length, tojson( r ) );
+for( i = 1; i < r.splitKeys.length; ++i ) {
+    assert.lt( r.splitKeys[ i - 1 ].i, r.splitKeys[ i ].i );
+}
+assert.lt( 0, r.splitKeys[ 0 ].i );
+
+// only the range asked for
+r = split( avg * 200, {i:0}, {i:500} );
+assert.eq( 4, r.splitKeys.length, tojson( r ) );
+assert.lt( r.splitKeys[ 3 ].i, 500 );
+
+assert.eq( false, db.runCommand( {splitVector:"test.jstests_splitvector", keyPattern:{i:1}, min:{i:0}, max:{i:1000}} ).ok );
+
+// never splits inside one key value
+f.drop();
+f.ensureIndex( {i:1} );
+for( i = 0; i < 1000; ++i ) {
+    f.save( {i:Math.floor( i / 500 ),s:s} );
+}
+r = split( avg * 200, {i:0}, {i:2} );
+assert.eq( 1, r.splitKeys.length, tojson( r ) );
+assert.eq( 1, r.splitKeys[ 0 ].i );
@@ -12,3 +12,6 @@ assert.eq( 1 , t.find( { $where : "return this.a == 2" } ).toArray().length , "B
 assert.eq( 1 , t.find( { $where : "this.a == 2" } ).toArray().length , "C" );
 
 assert.eq( 1 , t.find( "this.a == 2" ).toArray().length , "D" );
+
+assert.eq( 1 , t.find( { $where : "obj.a == 2" } ).toArray().length , "E" );
+assert.eq( 1 , t.find( { a : { $gt : 1 } , $where : "this.a < 3" } ).toArray().length , "F" );
@@ -0,0 +1,302 @@
+// balance.cpp
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stdafx.h"
+#include "../client/connpool.h"
+#include "../util/goodies.h"
+#include "../db/cmdline.h"
+
+#include "balance.h"
+#include "server.h"
+#include "config.h"
+#include "chunk.h"
+
+namespace mongo {
+
+    extern string ourHostname;
+
+    Balancer balancer;
+
+    static const char * LocksNS = "config.locks";
+    static const char * SettingsNS = "config.settings";
+
+    /* a lock whose holder hasn't touched it in this long is assumed abandoned */
+    static const long long LockTakeoverMillis = 15 * 60 * 1000;
+
+    Balancer::Balancer(){
+    }
+
+    int Balancer::imbalanceThreshold( int numChunks ){
+        if ( numChunks < 20 )
+            return 2;
+        if ( numChunks < 80 )
+            return 4;
+        return 8;
+    }
+
+    void Balancer::run(){
+        {
+            stringstream ss;
+            ss << ourHostname << ":" << cmdLine.port << ":" << time(0);
+            _myid = ss.str();
+        }
+        log(1) << "balancer id: " << _myid << endl;
+
+        int moved = 0;
+        while ( ! inShutdown() ){
+            sleepsecs( moved ? 1 : 10 );
+            moved = 0;
+
+            try {
+                ScopedDbConnection conn( configServer.modelServer() );
+
+                int moveDelayMillis = 1000;
+                if ( shouldBalance( conn.conn() , moveDelayMillis ) && lock( conn.conn() ) ){
+                    try {
+                        moved = balance( conn.conn() , moveDelayMillis );
+                    }
+                    catch ( ... ){
+                        unlock( conn.conn() );
+                        throw;
+                    }
+                    unlock( conn.conn() );
+                }
+
+                conn.done();
+            }
+            catch ( std::exception& e ){
+                log() << "balancer: round failed: " << e.what() << endl;
+            }
+        }
+    }
+
+    bool Balancer::shouldBalance( DBClientBase& conn , int& moveDelayMillis ){
+        BSONObj settings = conn.findOne( SettingsNS , BSON( "_id" << "balancer" ) );
+        if ( settings.isEmpty() )
+            return true;
+
+        if ( settings["stopped"].trueValue() ){
+            log(2) << "balancer: stopped" << endl;
+            return false;
+        }
+
+        if ( settings["moveDelayMillis"].isNumber() )
+            moveDelayMillis = settings["moveDelayMillis"].numberInt();
+
+        BSONObj window = settings.getObjectField( "activeWindow" );
+        if ( ! window.isEmpty() ){
+            string start = window.getStringField( "start" );
+            string stop = window.getStringField( "stop" );
+            if ( start.size() && stop.size() && ! inWindow( start , stop ) ){
+                log(2) << "balancer: outside of active window " << start << "-" << stop << endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    static int minutesOfDay( const string& hhmm ){
+        int h = 0 , m = 0;
+        if ( sscanf( hhmm.c_str() , "%d:%d" , &h , &m ) < 1 )
+            return -1;
+        return ( h % 24 ) * 60 + m;
+    }
+
+    bool Balancer::inWindow( const string& start , const string& stop ){
+        int from = minutesOfDay( start );
+        int to = minutesOfDay( stop );
+        if ( from < 0 || to < 0 ){
+            log() << "balancer: bad activeWindow " << start << "-" << stop << ", ignoring it" << endl;
+            return true;
+        }
+
+        time_t t = time(0);
+        struct tm now;
+#if defined(_WIN32)
+        localtime_s( &now , &t );
+#else
+        localtime_r( &t , &now );
+#endif
+        int cur = now.tm_hour * 60 + now.tm_min;
+
+        if ( from <= to )
+            return from <= cur && cur < to;
+        // wraps past midnight, e.g. 23:00 - 6:00
+        return cur >= from || cur < to;
+    }
+
+    bool Balancer::lock( DBClientBase& conn ){
+        // make sure there is a lock document to fight over; if it is already there this
+        // just fails with a duplicate key
+        conn.insert( LocksNS , BSON( "_id" << "balancer" << "state" << 0 ) );
+
+        BSONObj cur = conn.findOne( LocksNS , BSON( "_id" << "balancer" ) );
+        if ( cur.isEmpty() )
+            return false;
+
+        if ( cur["state"].numberInt() != 0 && strcmp( cur.getStringField( "who" ) , _myid.c_str() ) ){
+            long long age = (long long) jsTime() - (long long) cur["when"].date();
+            if ( age < LockTakeoverMillis ){
+                log(2) << "balancer: lock held by " << cur.getStringField( "who" ) << endl;
+                return false;
+            }
+            log() << "balancer: taking over lock from " << cur.getStringField( "who" )
+                  << ", not pinged in " << age / 1000 << " seconds" << endl;
+        }
+
+        // only succeeds if nobody changed the document since we read it
+        OID ts;
+        ts.init();
+        BSONObjBuilder set;
+        set.append( "state" , 1 );
+        set.append( "who" , _myid );
+        set.appendDate( "when" , jsTime() );
+        set.appendOID( "ts" , &ts );
+
+        BSONObjBuilder q;
+        q.append( "_id" , "balancer" );
+        q.append( cur["state"] );
+        if ( cur["ts"].type() == jstOID )
+            q.append( cur["ts"] );
+
+        conn.update( LocksNS , q.obj() , BSON( "$set" << set.obj() ) );
+        BSONObj res = conn.getLastErrorDetailed();
+        if ( res["n"].numberInt() != 1 ){
+            log(2) << "balancer: lost race for lock" << endl;
+            return false;
+        }
+
+        log(1) << "balancer: got lock" << endl;
+        return true;
+    }
+
+    void Balancer::ping( DBClientBase& conn ){
+        BSONObjBuilder set;
+        set.appendDate( "when" , jsTime() );
+        conn.update( LocksNS , BSON( "_id" << "balancer" << "who" << _myid ) , BSON( "$set" << set.obj() ) );
+    }
+
+    void Balancer::unlock( DBClientBase& conn ){
+        conn.update( LocksNS , BSON( "_id" << "balancer" << "who" << _myid ) , BSON( "$set" << BSON( "state" << 0 ) ) );
+    }
+
+    bool Balancer::pickChunk( const string& ns , const map< string , vector<BSONObj> >& chunksByShard ,
+                              BSONObj& chunkMin , string& from , string& to ){
+        int total = 0;
+        unsigned most = 0 , least = 0;
+        for ( map< string , vector<BSONObj> >::const_iterator i = chunksByShard.begin(); i != chunksByShard.end(); i++ ){
+            unsigned n = i->second.size();
+            total += n;
+            if ( from.empty() || n > most ){
+                from = i->first;
+                most = n;
+            }
+            if ( to.empty() || n < least ){
+                to = i->first;
+                least = n;
+            }
+        }
+
+        log(3) << "balancer: " << ns << " " << total << " chunks, most: " << from << " (" << most << ")"
+               << " least: " << to << " (" << least << ")" << endl;
+
+        if ( (int)( most - least ) < imbalanceThreshold( total ) )
+            return false;
+
+        chunkMin = chunksByShard.find( from )->second[0];
+        return true;
+    }
+
+    int Balancer::balance( DBClientBase& conn , int moveDelayMillis ){
+        vector<string> shards;
+        {
+            auto_ptr<DBClientCursor> c = conn.query( "config.shards" , BSONObj() );
+            while ( c->more() )
+                shards.push_back( c->next().getStringField( "host" ) );
+        }
+        if ( shards.size() < 2 )
+            return 0;
+
+        // ns -> shard -> chunk mins; every shard gets an entry so empty ones are counted
+        map< string , map< string , vector<BSONObj> > > collections;
+        {
+            auto_ptr<DBClientCursor> c = conn.query( "config.chunks" , BSONObj() );
+            while ( c->more() ){
+                BSONObj chunk = c->next();
+                map< string , vector<BSONObj> >& byShard = collections[ chunk.getStringField( "ns" ) ];
+                if ( byShard.empty() ){
+                    for ( unsigned i=0; i<shards.size(); i++ )
+                        byShard[ shards[i] ];
+                }
+                byShard[ chunk.getStringField( "shard" ) ].push_back( chunk.getObjectField( "min" ).getOwned() );
+            }
+        }
+
+        int moved = 0;
+        for ( map< string , map< string , vector<BSONObj> > >::iterator i = collections.begin(); i != collections.end(); i++ ){
+            if ( inShutdown() )
+                break;
+
+            const string& ns = i->first;
+            BSONObj chunkMin;
+            string from , to;
+            if ( ! pickChunk( ns , i->second , chunkMin , from , to ) )
+                continue;
+
+            DBConfig * config = grid.getDBConfig( ns , false );
+            if ( ! config || ! config->isSharded( ns ) ){
+                log(1) << "balancer: don't know " << ns << " is sharded yet, skipping" << endl;
+                continue;
+            }
+
+            // no split of this collection can commit between finding the chunk and moving it
+            boost::recursive_mutex::scoped_lock lk( ChunkManager::commitLock( ns ) );
+            ChunkManager * manager = config->getChunkManager( ns , true );
+            Chunk * chunk = 0;
+            for ( int j=0; j<manager->numChunks(); j++ ){
+                Chunk * c = manager->getChunk( j );
+                if ( c->getShard() == from && c->getMin().woCompare( chunkMin ) == 0 ){
+                    chunk = c;
+                    break;
+                }
+            }
+            if ( ! chunk ){
+                log(1) << "balancer: chunk " << chunkMin << " of " << ns << " moved under us, skipping" << endl;
+                continue;
+            }
+
+            log() << "balancer: moving " << ns << " " << chunkMin << " from " << from << " to " << to << endl;
+            string errmsg;
+            if ( ! chunk->moveAndCommit( to , errmsg ) ){
+                log() << "balancer: move of " << ns << " " << chunkMin << " failed: " << errmsg << endl;
+                continue;
+            }
+
+            lk.unlock();
+
+            moved++;
+            ping( conn );
+            if ( moveDelayMillis > 0 )
+                sleepmillis( moveDelayMillis );
+        }
+
+        return moved;
+    }
+
+} // namespace mongo
@@ -0,0 +1,68 @@
+// balance.h
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../stdafx.h"
+#include "../util/background.h"
+#include "../client/dbclient.h"
+
+namespace mongo {
+
+    /**
+     * evens out the number of chunks each shard has, a chunk at a time.
+     *
+     * every mongos runs one, but a round only goes ahead for whoever holds the "balancer"
+     * lock in config.locks, so only one of them is moving chunks at any time.
+     *
+     * config.settings { _id : "balancer" } controls it:
+     *   stopped : true                                 no balancing at all
+     *   activeWindow : { start : "23:00" , stop : "6:00" }   only between these (local) times
+     *   moveDelayMillis : <n>                          pause after each migration, default 1000
+     */
+    class Balancer : public BackgroundJob {
+    public:
+        Balancer();
+
+        /* how far apart the most and least loaded shards can be before we move a chunk */
+        static int imbalanceThreshold( int numChunks );
+
+    protected:
+        void run();
+
+    private:
+        /* @return number of chunks moved */
+        int balance( DBClientBase& conn , int moveDelayMillis );
+
+        /* picks the chunk to move for one collection.  @return false if it is balanced enough */
+        bool pickChunk( const string& ns , const map< string , vector<BSONObj> >& chunksByShard ,
+                        BSONObj& chunkMin , string& from , string& to );
+
+        bool shouldBalance( DBClientBase& conn , int& moveDelayMillis );
+        static bool inWindow( const string& start , const string& stop );
+
+        bool lock( DBClientBase& conn );
+        void ping( DBClientBase& conn );
+        void unlock( DBClientBase& conn );
+
+        string _myid;
+    };
+
+    extern Balancer balancer;
+
+} // namespace mongo
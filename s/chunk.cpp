@@ -42,9 +42,9 @@ namespace mongo {
     }
     
     bool Chunk::contains( const BSONObj& obj ){
-        return
-            _manager->getShardKey().compare( getMin() , obj ) <= 0 &&
-            _manager->getShardKey().compare( obj , getMax() ) < 0;
+        BSONObj k = _manager->getShardKey().extractKey( obj );
+        uassert( "object doesn't have shard key" , ! k.isEmpty() );
+        return getMin().woCompare( k ) <= 0 && k.woCompare( getMax() ) < 0;
     }
 
     BSONObj Chunk::pickSplitPoint(){
@@ -57,7 +57,8 @@ namespace mongo {
             sort = -1;
         }
         
-        if ( sort ){
+        // with a hashed key, the last object by value isn't the one at the end of the chunk
+        if ( sort && ! _manager->getShardKey().isHashed() ){
             ScopedDbConnection conn( getShard() );
             Query q;
             if ( sort == 1 )
@@ -103,39 +104,86 @@ namespace mongo {
     }
     
     Chunk * Chunk::split( const BSONObj& m ){
+        vector<BSONObj> splitPoints;
+        splitPoints.push_back( m );
+        return multiSplit( splitPoints );
+    }
+
+    vector<BSONObj> Chunk::pickSplitVector(){
+        ScopedDbConnection conn( getShard() );
+        BSONObj result;
+        if ( ! conn->runCommand( "admin" , BSON( "splitVector" << _ns
+                                                 << "keyPattern" << _manager->getShardKey().key()
+                                                 << "min" << getMin()
+                                                 << "max" << getMax()
+                                                 << "maxChunkSize" << (double)MaxChunkSize
+                                                 ) , result ) ){
+            stringstream ss;
+            ss << "splitVector command failed: " << result;
+            uassert( ss.str() , 0 );
+        }
+        conn.done();
+
+        vector<BSONObj> splitPoints;
+        BSONObjIterator i( result.getObjectField( "splitKeys" ) );
+        while ( i.more() ){
+            BSONElement e = i.next();
+            if ( e.eoo() )
+                break;
+            splitPoints.push_back( e.embeddedObject().getOwned() );
+        }
+        return splitPoints;
+    }
+
+    Chunk * Chunk::multiSplit( const vector<BSONObj>& m ){
         uassert( "can't split as shard that doesn't have a manager" , _manager );
-        
-        log(1) << " before split on: "  << m << "\n"
+        uassert( "no split points" , m.size() );
+
+        log(1) << " before split on " << m.size() << " points, first: " << m[0] << "\n"
                << "\t self  : " << toString() << endl;
 
+        boost::recursive_mutex::scoped_lock lk( ChunkManager::commitLock( _ns ) );
+        uassert( "chunks changed since they were loaded, reload and split again" , _manager->upToDate() );
+
         uassert( "locking namespace on server failed" , lockNamespaceOnServer( getShard() , _ns ) );
 
-        Chunk * s = new Chunk( _manager );
-        s->_ns = _ns;
-        s->_shard = _shard;
-        s->setMin(m.getOwned());
-        s->setMax(_max);
-        
-        s->_markModified();
+        BSONObj max = _max;
+        Chunk * s = 0;
+        for ( unsigned i=0; i<m.size(); i++ ){
+            s = new Chunk( _manager );
+            s->_ns = _ns;
+            s->_shard = _shard;
+            s->setMin( m[i].getOwned() );
+            s->setMax( i + 1 < m.size() ? m[i+1].getOwned() : max );
+            s->_markModified();
+            _manager->_chunks.push_back( s );
+        }
+
         _markModified();
-        
-        _manager->_chunks.push_back( s );
-        
-        setMax(m.getOwned());
-        
+        setMax( m[0].getOwned() );
+
         log(1) << " after split:\n" 
                << "\t left : " << toString() << "\n" 
                << "\t right: "<< s->toString() << endl;
         
-        
+        // one pass over the config server for all the pieces
         _manager->save();
+        _manager->committed();
+
+        configServer.logChange( "split" , _ns , BSON( "min" << getMin() << "max" << max << "points" << (int)m.size() ) );
         
         return s;
     }
 
-    bool Chunk::moveAndCommit( const string& to , string& errmsg ){
+    bool Chunk::moveAndCommit( const string& to , string& errmsg , bool waitForDelete ){
         uassert( "can't move shard to its current location!" , to != getShard() );
 
+        boost::recursive_mutex::scoped_lock lk( ChunkManager::commitLock( _ns ) );
+        if ( ! _manager->upToDate() ){
+            errmsg = "chunks changed since they were loaded, reload and move again";
+            return false;
+        }
+
         log() << "moving chunk ns: " << _ns << " moving chunk: " << toString() << " " << _shard << " -> " << to << endl;
         
         string from = _shard;
@@ -155,7 +203,10 @@ namespace mongo {
                                             BSON( "movechunk.start" << _ns << 
                                                   "from" << from <<
                                                   "to" << to <<
-                                                  "filter" << filter
+                                                  "filter" << filter <<
+                                                  "min" << _min <<
+                                                  "max" << _max <<
+                                                  "shardKeyPattern" << _manager->getShardKey().key()
                                                   ) ,
                                             startRes
                                             );
@@ -175,6 +226,7 @@ namespace mongo {
             randomChunkOnOldServer->_markModified();
         
         _manager->save();
+        _manager->committed();
         
         BSONObj finishRes;
         {
@@ -195,6 +247,8 @@ namespace mongo {
             b << "to" << to;
             b.appendTimestamp( "newVersion" , newVersion );
             b.append( startRes["finishToken"] );
+            b << "min" << _min << "max" << _max << "shardKeyPattern" << _manager->getShardKey().key();
+            b.appendBool( "waitForDelete" , waitForDelete );
         
             worked = fromconn->runCommand( "admin" ,
                                            b.done() , 
@@ -208,6 +262,8 @@ namespace mongo {
         }
         
         fromconn.done();
+
+        configServer.logChange( "moveChunk" , _ns , BSON( "min" << _min << "max" << _max << "from" << from << "to" << to ) );
         return true;
     }
     
@@ -224,15 +280,29 @@ namespace mongo {
             return false;
         }
 
-        long size = getPhysicalSize();
-        if ( size < MaxChunkSize )
+        // one walk of the shard key index both sizes the chunk and finds where to cut it
+        vector<BSONObj> splitPoints = pickSplitVector();
+        if ( splitPoints.empty() )
             return false;
         
-        log() << "autosplitting " << _ns << " size: " << size << " shard: " << toString() << endl;
-        Chunk * newShard = split();
+        // an autosplit is opportunistic: rather than wait on a migration of this collection, or
+        // split with a manager that missed one, leave it for a later write
+        boost::recursive_mutex::scoped_try_lock lk( ChunkManager::commitLock( _ns ) );
+        if ( ! lk || ! _manager->upToDate() )
+            return false;
 
-        moveIfShould( newShard );
-        
+        const ShardKeyPattern& key = _manager->getShardKey();
+        if ( ! key.isHashed() && ( key.globalMin().woCompare( getMin() ) == 0 || key.globalMax().woCompare( getMax() ) == 0 ) ){
+            // an end of the key space, which is where ascending keys pile up: cut off the
+            // extreme key so the new chunk is tiny and cheap to move
+            log() << "autosplitting " << _ns << " shard: " << toString() << endl;
+            Chunk * newShard = split();
+            moveIfShould( newShard );
+            return true;
+        }
+
+        log() << "autosplitting " << _ns << " into " << splitPoints.size() + 1 << " shard: " << toString() << endl;
+        multiSplit( splitPoints );
         return true;
     }
 
@@ -299,8 +369,8 @@ namespace mongo {
     
     bool Chunk::operator==( const Chunk& s ){
         return 
-            _manager->getShardKey().compare( _min , s._min ) == 0 &&
-            _manager->getShardKey().compare( _max , s._max ) == 0
+            _min.woCompare( s._min ) == 0 &&
+            _max.woCompare( s._max ) == 0
             ;
     }
 
@@ -391,8 +461,47 @@ namespace mongo {
 
     unsigned long long ChunkManager::NextSequenceNumber = 1;
 
+    namespace {
+        struct ChunkCommits {
+            ChunkCommits() : count( 0 ) { }
+            boost::recursive_mutex lock;
+            unsigned long long count;
+        };
+        boost::mutex chunkCommitsMutex;
+        map< string , shared_ptr<ChunkCommits> > chunkCommits;
+
+        ChunkCommits& commitsFor( const string& ns ){
+            boostlock lk( chunkCommitsMutex );
+            shared_ptr<ChunkCommits>& c = chunkCommits[ ns ];
+            if ( ! c )
+                c.reset( new ChunkCommits() );
+            return *c;
+        }
+    }
+
+    boost::recursive_mutex& ChunkManager::commitLock( const string& ns ){
+        return commitsFor( ns ).lock;
+    }
+
+    unsigned long long ChunkManager::commitCount( const string& ns ){
+        ChunkCommits& c = commitsFor( ns );
+        boostlock lk( chunkCommitsMutex );
+        return c.count;
+    }
+
+    bool ChunkManager::upToDate() const {
+        return commitCount( _ns ) == _commitsSeen;
+    }
+
+    void ChunkManager::committed(){
+        ChunkCommits& c = commitsFor( _ns );
+        boostlock lk( chunkCommitsMutex );
+        _commitsSeen = ++c.count;
+    }
+
     ChunkManager::ChunkManager( DBConfig * config , string ns , ShardKeyPattern pattern , bool unique ) : 
         _config( config ) , _ns( ns ) , _key( pattern ) , _unique( unique ){
+        _commitsSeen = commitCount( ns ); // before reading, so a commit racing the load makes us stale
         Chunk temp(0);
         
         ScopedDbConnection conn( temp.modelServer() );
@@ -410,6 +519,9 @@ namespace mongo {
         }
         conn.done();
         
+        if ( _chunks.size() == 0 && _key.isHashed() )
+            presplitHashed();
+
         if ( _chunks.size() == 0 ){
             Chunk * c = new Chunk( this );
             c->_ns = ns;
@@ -426,6 +538,133 @@ namespace mongo {
         _sequenceNumber = ++NextSequenceNumber;
     }
     
+    void ChunkManager::presplitHashed(){
+        vector<string> shards;
+        grid.getAllShards( shards );
+        if ( shards.size() < 2 )
+            return;
+
+        // the chunks on other shards start out empty, so only for a collection with nothing in it
+        {
+            ScopedDbConnection conn( _config->getPrimary() );
+            unsigned long long n = conn->count( _ns );
+            conn.done();
+            if ( n )
+                return;
+        }
+
+        // hashes are spread evenly over the signed 64 bit range, so cut it into equal pieces,
+        // a couple per shard so the balancer has something to even out later
+        const char * field = _key.key().firstElement().fieldName();
+        unsigned numChunks = shards.size() * 2;
+        unsigned long long step = 0xffffffffffffffffULL / numChunks;
+        BSONObj min = _key.globalMin();
+        for ( unsigned i=0; i<numChunks; i++ ){
+            BSONObj max = _key.globalMax();
+            if ( i + 1 < numChunks ){
+                BSONObjBuilder b;
+                b.append( field , (long long)( 0x8000000000000000ULL + step * ( i + 1 ) ) );
+                max = b.obj();
+            }
+
+            Chunk * c = new Chunk( this );
+            c->_ns = _ns;
+            c->setMin( min );
+            c->setMax( max );
+            c->_shard = shards[ i % shards.size() ];
+            c->_markModified();
+            _chunks.push_back( c );
+
+            min = max;
+        }
+
+        log() << "presplit hashed " << _ns << " into " << numChunks << " chunks over " << shards.size() << " shards" << endl;
+    }
+
+    ChunkManager::ChunkManager( const ChunkManager& from ) :
+        _config( from._config ) , _ns( from._ns ) , _key( from._key ) , _unique( from._unique ) , 
+        _maxMarkers( from._maxMarkers ) , _commitsSeen( from._commitsSeen ){
+        for ( vector<Chunk*>::const_iterator i=from._chunks.begin(); i != from._chunks.end(); i++ ){
+            const Chunk * old = *i;
+            Chunk * c = new Chunk( this );
+            c->_id = old->_id;
+            c->_ns = old->_ns;
+            c->_min = old->_min;
+            c->_max = old->_max;
+            c->_shard = old->_shard;
+            c->_lastmod = old->_lastmod;
+            c->_modified = old->_modified;
+            c->_dataWritten = old->_dataWritten;
+            _chunks.push_back( c );
+        }
+        _sequenceNumber = ++NextSequenceNumber;
+    }
+
+    ChunkManager * ChunkManager::reload(){
+        ShardChunkVersion since = getVersion();
+        unsigned long long seen = commitCount( _ns );
+
+        for ( vector<Chunk*>::iterator i=_chunks.begin(); i != _chunks.end(); i++ )
+            if ( (*i)->_id.isEmpty() )
+                return 0; // never saved, so we can't match it up
+
+        BSONObjBuilder q;
+        q.append( "ns" , _ns );
+        {
+            BSONObjBuilder gt( q.subobjStart( "lastmod" ) );
+            gt.appendTimestamp( "$gt" , since );
+            gt.done();
+        }
+
+        Chunk temp(0);
+        ScopedDbConnection conn( temp.modelServer() );
+
+        vector<BSONObj> changes;
+        auto_ptr<DBClientCursor> cursor = conn->query( temp.getNS() , q.obj() );
+        while ( cursor->more() ){
+            BSONObj d = cursor->next();
+            if ( d["isMaxMarker"].trueValue() )
+                continue;
+            changes.push_back( d.getOwned() );
+        }
+
+        unsigned long long total = conn->count( temp.getNS() , BSON( "ns" << _ns << "isMaxMarker" << BSON( "$ne" << true ) ) );
+        conn.done();
+
+        ChunkManager * m = this;
+        if ( changes.size() ){
+            m = new ChunkManager( *this );
+
+            map< BSONObj , Chunk* , BSONObjCmpDefaultOrder > byId;
+            for ( vector<Chunk*>::iterator i=m->_chunks.begin(); i != m->_chunks.end(); i++ )
+                byId[ (*i)->_id ] = *i;
+
+            for ( vector<BSONObj>::iterator i=changes.begin(); i != changes.end(); i++ ){
+                BSONObj id = (*i)["_id"].wrap().getOwned();
+                Chunk *& c = byId[ id ];
+                if ( ! c ){
+                    c = new Chunk( m );
+                    c->_id = id;
+                    m->_chunks.push_back( c );
+                }
+                c->unserialize( *i );
+            }
+        }
+
+        if ( total != m->_chunks.size() ){
+            log() << "chunks of " << _ns << " don't add up after incremental reload, have " << m->_chunks.size()
+                  << " config has " << total << endl;
+            if ( m != this )
+                delete m;
+            return 0;
+        }
+
+        // what the config server has covers every commit made before we asked it
+        m->_commitsSeen = seen;
+        log( changes.size() ? 0 : 1 ) << "reloaded " << changes.size() << " changed chunks of " << _ns << endl;
+        return m;
+    }
+
     ChunkManager::~ChunkManager(){
         for ( vector<Chunk*>::iterator i=_chunks.begin(); i != _chunks.end(); i++ ){
             delete( *i );
@@ -461,11 +700,18 @@ namespace mongo {
     }
 
     int ChunkManager::getChunksForQuery( vector<Chunk*>& chunks , const BSONObj& query ){
+        BoundList bounds = _key.keyBounds( query );
+        if ( bounds.empty() ){
+            // nothing can match, but someone still has to say so
+            chunks.push_back( _chunks[0] );
+            return 1;
+        }
+
         int added = 0;
         
         for ( vector<Chunk*>::iterator i=_chunks.begin(); i != _chunks.end(); i++  ){
             Chunk * c = *i;
-            if ( _key.relevantForQuery( query , c ) ){
+            if ( _key.relevant( bounds , c->getMin() , c->getMax() ) ){
                 chunks.push_back( c );
                 added++;
             }
@@ -473,6 +719,13 @@ namespace mongo {
         return added;
     }
 
+    void ChunkManager::getShardsForQuery( set<string>& shards , const BSONObj& query ){
+        vector<Chunk*> chunks;
+        getChunksForQuery( chunks , query );
+        for ( vector<Chunk*>::iterator i=chunks.begin(); i != chunks.end(); i++ )
+            shards.insert( (*i)->getShard() );
+    }
+
     void ChunkManager::getAllServers( set<string>& allServers ){
         for ( vector<Chunk*>::iterator i=_chunks.begin(); i != _chunks.end(); i++  ){
             allServers.insert( (*i)->getShard() );
@@ -549,6 +802,8 @@ namespace mongo {
         }
 
 
+        configServer.logChange( "dropCollection" , _ns );
+
         log(1) << "ChunkManager::drop : " << _ns << "\t DONE" << endl;        
     }
     
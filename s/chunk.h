@@ -85,6 +85,19 @@ namespace mongo {
         Chunk * split();
         Chunk * split( const BSONObj& middle );
 
+        /**
+         * @return keys that cut this chunk into pieces of about half of MaxChunkSize,
+         *  empty if it isn't over MaxChunkSize.  one pass over the shard key index on the shard
+         */
+        vector<BSONObj> pickSplitVector();
+
+        /**
+         * splits at all the points, which must be in order and inside this chunk, and saves
+         * the lot to the config server together
+         * @return the last new chunk
+         */
+        Chunk * multiSplit( const vector<BSONObj>& splitPoints );
+
         /**
          * @return size of shard in bytes
          *  talks to mongod to do this
@@ -106,7 +119,10 @@ namespace mongo {
          */
         bool moveIfShould( Chunk * newShard = 0 );
 
-        bool moveAndCommit( const string& to , string& errmsg );
+        /**
+         * @param waitForDelete if false the old shard deletes its copy in the background
+         */
+        bool moveAndCommit( const string& to , string& errmsg , bool waitForDelete = false );
 
         virtual const char * getNS(){ return "config.chunks"; }
         virtual void serialize(BSONObjBuilder& to);
@@ -184,6 +200,11 @@ namespace mongo {
          */
         int getChunksForQuery( vector<Chunk*>& chunks , const BSONObj& query );
 
+        /**
+         * the shards holding chunks that getChunksForQuery would return
+         */
+        void getShardsForQuery( set<string>& shards , const BSONObj& query );
+
         void getAllServers( set<string>& allServers );
 
         void save();
@@ -202,8 +223,40 @@ namespace mongo {
         }
 
         void drop();
+
+        /**
+         * fetches the chunks that changed on the config server since our highest version and
+         * merges them into a copy of this manager.  this one is left alone, as requests on
+         * other threads may be reading it.
+         * @return this if nothing changed, otherwise the new manager.  0 if what we have doesn't
+         *         add up (e.g. the collection was dropped and sharded again), in which case the
+         *         manager has to be rebuilt from scratch
+         */
+        ChunkManager * reload();
+
+        /* in this process, splits and moves of a collection's chunks commit one at a time
+           under this lock, and only through a manager loaded since the last one.  otherwise
+           a manager that missed a move could split the moved chunk and write its old shard
+           back, or the other way round.
+        */
+        static boost::recursive_mutex& commitLock( const string& ns );
+
+        /* nothing was committed since this manager was loaded.  commitLock held */
+        bool upToDate() const;
         
     private:
+        /* this manager just committed a change.  commitLock held */
+        void committed();
+
+        /* how many commits there had been to ns when a manager loading it started */
+        static unsigned long long commitCount( const string& ns );
+
+        /* a copy with chunks of its own, for reload() to merge changes into */
+        ChunkManager( const ChunkManager& from );
+
+        /* spreads the first chunks of a new, empty hashed collection over all the shards */
+        void presplitHashed();
+
         DBConfig * _config;
         string _ns;
         ShardKeyPattern _key;
@@ -213,6 +266,7 @@ namespace mongo {
         map<string,unsigned long long> _maxMarkers;
 
         unsigned long long _sequenceNumber;
+        unsigned long long _commitsSeen;
         
         friend class Chunk;
         static unsigned long long NextSequenceNumber;
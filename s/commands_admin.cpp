@@ -19,7 +19,6 @@
 /* TODO
    _ concurrency control.
    _ limit() works right?
-   _ KillCursors
 
    later
    _ secondary indexes
@@ -34,6 +33,7 @@
 #include "config.h"
 #include "chunk.h"
 #include "strategy.h"
+#include "cursors.h"
 
 namespace mongo {
 
@@ -71,6 +71,18 @@ namespace mongo {
             }
         } netstat;
 
+        class CursorInfoCmd : public GridAdminCmd {
+        public:
+            CursorInfoCmd() : GridAdminCmd("cursorInfo") { }
+            virtual void help( stringstream& help ) const {
+                help << " example: { cursorInfo : 1 }";
+            }
+            bool run(const char *ns, BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool){
+                cursorCache.appendInfo( result );
+                return true;
+            }
+        } cursorInfoCmd;
+
         class ListGridCommands : public GridAdminCmd {
         public:
             ListGridCommands() : GridAdminCmd("gridcommands") { }
@@ -178,8 +190,10 @@ namespace mongo {
 
                 ScopedDbConnection fromconn( config->getPrimary() );
 
+                string from = config->getPrimary();
                 config->setPrimary( to );
                 config->save( true );
+                configServer.logChange( "movePrimary" , dbname , BSON( "from" << from << "to" << to ) );
 
                 log() << " dropping " << dbname << " from old" << endl;
 
@@ -218,6 +232,7 @@ namespace mongo {
 
                 config->enableSharding();
                 config->save( true );
+                configServer.logChange( "enableSharding" , dbname );
 
                 return true;
             }
@@ -258,6 +273,9 @@ namespace mongo {
                 } else if (key.nFields() > 1){
                     errmsg = "compound shard keys not supported yet";
                     return false;
+                } else if ( isHashedKeyPattern( key ) && cmdObj["unique"].trueValue() ){
+                    errmsg = "a hashed shard key can't be unique";
+                    return false;
                 }
 
                 if ( ns.find( ".system." ) != string::npos ){
@@ -290,6 +308,7 @@ namespace mongo {
 
                 config->shardCollection( ns , key , cmdObj["unique"].trueValue() );
                 config->save( true );
+                configServer.logChange( "shardCollection" , ns , BSON( "key" << key ) );
 
                 result << "collectionsharded" << ns;
                 return true;
@@ -459,7 +478,7 @@ namespace mongo {
                     return false;
                 }
 
-                if ( ! c.moveAndCommit( to , errmsg ) )
+                if ( ! c.moveAndCommit( to , errmsg , true ) )
                     return false;
 
                 return true;
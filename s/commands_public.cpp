@@ -23,6 +23,7 @@
 #include "../client/connpool.h"
 #include "../client/parallel.h"
 #include "../db/commands.h"
+#include "../scripting/engine.h"
 
 #include "config.h"
 #include "chunk.h"
@@ -55,6 +56,45 @@ namespace mongo {
                 conn.done();
                 return ok;
             }
+
+            /* one filter per shard, covering every chunk of the query's it holds, so a command
+               fanned out over these runs once on each shard.  adjacent chunks are merged.
+            */
+            void getShardRanges( ChunkManager * cm , const BSONObj& query , vector< pair<string,BSONObj> >& ranges ){
+                vector<Chunk*> chunks;
+                cm->getChunksForQuery( chunks , query );
+
+                map< string , vector<Chunk*> > byShard;
+                for ( vector<Chunk*>::iterator i = chunks.begin() ; i != chunks.end() ; i++ )
+                    byShard[ (*i)->getShard() ].push_back( *i );
+
+                for ( map< string , vector<Chunk*> >::iterator i = byShard.begin() ; i != byShard.end() ; i++ ){
+                    vector<Chunk*>& v = i->second;
+                    sort( v.begin() , v.end() , ChunkMinLess() );
+
+                    vector< pair<BSONObj,BSONObj> > runs;
+                    unsigned j = 0;
+                    while ( j < v.size() ){
+                        BSONObj min = v[j]->getMin();
+                        BSONObj max = v[j]->getMax();
+                        while ( j + 1 < v.size() && max.woCompare( v[j+1]->getMin() ) == 0 )
+                            max = v[++j]->getMax();
+                        j++;
+                        runs.push_back( make_pair( min , max ) );
+                    }
+
+                    BSONObjBuilder b;
+                    cm->getShardKey().getFilter( b , runs );
+                    ranges.push_back( make_pair( i->first , b.obj() ) );
+                }
+            }
+
+        private:
+            struct ChunkMinLess {
+                bool operator()( Chunk * l , Chunk * r ) const {
+                    return l->getMin().woCompare( r->getMin() ) < 0;
+                }
+            };
         };
         
         class NotAllowedOnShardedCollectionCmd : public PublicGridCommand {
@@ -159,13 +199,24 @@ namespace mongo {
                 ChunkManager * cm = conf->getChunkManager( fullns );
                 massert( "how could chunk manager be null!" , cm );
                 
-                vector<Chunk*> chunks;
-                cm->getChunksForQuery( chunks , filter );
+                vector< pair<string,BSONObj> > ranges;
+                getShardRanges( cm , filter , ranges );
+
+                list< shared_ptr<Future::CommandResult> > futures;
+                for ( vector< pair<string,BSONObj> >::iterator i = ranges.begin() ; i != ranges.end() ; i++ ){
+                    BSONObj q = ClusteredCursor::concatQuery( i->second , filter );
+                    futures.push_back( Future::spawnCommand( i->first , dbName , BSON( "count" << collection << "query" << q ) ) );
+                }
                 
                 unsigned long long total = 0;
-                for ( vector<Chunk*>::iterator i = chunks.begin() ; i != chunks.end() ; i++ ){
-                    Chunk * c = *i;
-                    total += c->countObjects( filter );
+                for ( list< shared_ptr<Future::CommandResult> >::iterator i=futures.begin(); i!=futures.end(); i++ ){
+                    shared_ptr<Future::CommandResult> res = *i;
+                    if ( ! res->join() ){
+                        errmsg = "count failed on " + res->getServer() + ": ";
+                        errmsg += res->result().toString();
+                        return false;
+                    }
+                    total += (unsigned long long)res->result()["n"].number();
                 }
                 
                 result.append( "n" , (double)total );
@@ -184,12 +235,180 @@ namespace mongo {
         } convertToCappedCmd;
 
 
-        class GroupCmd : public NotAllowedOnShardedCollectionCmd  {
+        /* each shard groups its own ranges and mongos merges the partial results by key.
+           a key seen on more than one shard needs a 'combine : function( a , b )' that folds
+           b's state into a (or returns the merged state).  finalize runs at mongos once everything
+           is merged.
+        */
+        class GroupCmd : public PublicGridCommand {
         public:
-            GroupCmd() : NotAllowedOnShardedCollectionCmd("group"){}
-            
-            virtual string getFullNS( const string& dbName , const BSONObj& cmdObj ){
-                return dbName + "." + cmdObj.firstElement().embeddedObjectUserCheck()["ns"].valuestrsafe();
+            GroupCmd() : PublicGridCommand("group"){}
+            virtual void help( stringstream &help ) const {
+                help << "see http://www.mongodb.org/display/DOCS/Aggregation\n"
+                     << "on a sharded collection keys spanning shards are merged with combine : function( a , b )";
+            }
+
+            BSONObj fixForShards( const BSONObj& p , const BSONObj& cond ){
+                BSONObjBuilder b;
+                BSONObjIterator i( p );
+                while ( i.more() ){
+                    BSONElement e = i.next();
+                    string fn = e.fieldName();
+                    if ( fn == "cond" ||
+                         fn == "condition" ||
+                         fn == "query" ||
+                         fn == "q" ||
+                         fn == "finalize" ||
+                         fn == "combine" ){
+                        // cond is rewritten per shard, the rest runs here
+                    }
+                    else {
+                        b.append( e );
+                    }
+                }
+                b.append( "cond" , cond );
+                return BSON( "group" << b.obj() );
+            }
+
+            bool run(const char *ns, BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool){
+                
+                string dbName = getDBName( ns );
+                const BSONObj& p = cmdObj.firstElement().embeddedObjectUserCheck();
+                string fullns = dbName + "." + p["ns"].valuestrsafe();
+
+                DBConfig * conf = grid.getDBConfig( dbName , false );
+                
+                if ( ! conf || ! conf->isShardingEnabled() || ! conf->isSharded( fullns ) ){
+                    return passthrough( conf , cmdObj , result );
+                }
+                
+                ChunkManager * cm = conf->getChunkManager( fullns );
+                massert( "how could chunk manager be null!" , cm );
+
+                if ( ! p["$keyf"].eoo() ){
+                    errmsg = "can't use $keyf on a sharded collection";
+                    return false;
+                }
+
+                BSONObj keyPattern;
+                if ( p["key"].type() == Object )
+                    keyPattern = p["key"].embeddedObjectUserCheck();
+
+                BSONObj cond;
+                if ( p["cond"].type() == Object )
+                    cond = p["cond"].embeddedObject();
+                else if ( p["condition"].type() == Object )
+                    cond = p["condition"].embeddedObject();
+                else
+                    cond = getQuery( p );
+
+                vector< pair<string,BSONObj> > ranges;
+                getShardRanges( cm , cond , ranges );
+
+                list< shared_ptr<Future::CommandResult> > futures;
+                for ( vector< pair<string,BSONObj> >::iterator i = ranges.begin() ; i != ranges.end() ; i++ ){
+                    BSONObj shardCond = ClusteredCursor::concatQuery( i->second , cond );
+                    futures.push_back( Future::spawnCommand( i->first , dbName , fixForShards( p , shardCond ) ) );
+                }
+
+                auto_ptr<Scope> s;
+                ScriptingFunction combine = 0;
+
+                vector<BSONObj> merged;
+                map<BSONObj,int,BSONObjCmp> keys;
+                double count = 0;
+
+                for ( list< shared_ptr<Future::CommandResult> >::iterator i=futures.begin(); i!=futures.end(); i++ ){
+                    shared_ptr<Future::CommandResult> res = *i;
+                    if ( ! res->join() ){
+                        errmsg = "group failed on " + res->getServer() + ": ";
+                        errmsg += res->result().toString();
+                        return false;
+                    }
+                    count += res->result()["count"].number();
+
+                    BSONObjIterator j( res->result()["retval"].embeddedObjectUserCheck() );
+                    while ( j.more() ){
+                        BSONObj obj = j.next().embeddedObjectUserCheck().getOwned();
+                        BSONObj key = obj.extractFields( keyPattern , true );
+
+                        map<BSONObj,int,BSONObjCmp>::iterator k = keys.find( key );
+                        if ( k == keys.end() ){
+                            uassert( "group() can't handle more than 10000 unique keys" , merged.size() < 10000 );
+                            keys[key] = merged.size();
+                            merged.push_back( obj );
+                            continue;
+                        }
+
+                        if ( ! combine ){
+                            if ( p["combine"].eoo() ){
+                                errmsg = "group on a sharded collection needs a combine function when a key spans shards";
+                                return false;
+                            }
+                            s = scope( errmsg );
+                            if ( ! s.get() )
+                                return false;
+                            s->exec( "$combine = " + p["combine"].ascode() , "combine define" , false , true , true , 100 );
+                            combine = s->createFunction(
+                                "function(){ "
+                                "  var ret = $combine( $a , $b ); "
+                                "  if ( ret !== undefined ) "
+                                "    $a = ret; "
+                                "}" );
+                        }
+
+                        s->setObject( "$a" , merged[k->second] , false );
+                        s->setObject( "$b" , obj , true );
+                        if ( s->invoke( combine , BSONObj() , 0 , true ) ){
+                            errmsg = "combine invoke failed: " + s->getError();
+                            return false;
+                        }
+                        merged[k->second] = s->getObject( "$a" );
+                    }
+                }
+
+                if ( p["finalize"].type() ){
+                    if ( ! s.get() ){
+                        s = scope( errmsg );
+                        if ( ! s.get() )
+                            return false;
+                    }
+                    s->exec( "$finalize = " + p["finalize"].ascode() , "finalize define" , false , true , true , 100 );
+                    ScriptingFunction g = s->createFunction(
+                        "function(){ "
+                        "  var ret = $finalize( $a ); "
+                        "  if ( ret !== undefined ) "
+                        "    $a = ret; "
+                        "}" );
+                    for ( unsigned i=0; i<merged.size(); i++ ){
+                        s->setObject( "$a" , merged[i] , false );
+                        if ( s->invoke( g , BSONObj() , 0 , true ) ){
+                            errmsg = "finalize invoke failed: " + s->getError();
+                            return false;
+                        }
+                        merged[i] = s->getObject( "$a" );
+                    }
+                }
+
+                BSONObjBuilder b;
+                for ( unsigned i=0; i<merged.size(); i++ )
+                    b.append( b.numStr( i ).c_str() , merged[i] );
+
+                result.appendArray( "retval" , b.obj() );
+                result.append( "count" , count );
+                result.append( "keys" , (int)merged.size() );
+                return true;
+            }
+
+        private:
+            auto_ptr<Scope> scope( string& errmsg ){
+                auto_ptr<Scope> s;
+                if ( ! globalScriptEngine ){
+                    errmsg = "no script engine available to merge group results";
+                    return s;
+                }
+                s.reset( globalScriptEngine->createScope() );
+                return s;
             }
             
         } groupCmd;
@@ -215,26 +434,31 @@ namespace mongo {
                 ChunkManager * cm = conf->getChunkManager( fullns );
                 massert( "how could chunk manager be null!" , cm );
                 
-                vector<Chunk*> chunks;
-                cm->getChunksForQuery( chunks , BSONObj() );
+                BSONObj query = getQuery( cmdObj );
+
+                vector< pair<string,BSONObj> > ranges;
+                getShardRanges( cm , query , ranges );
+
+                list< shared_ptr<Future::CommandResult> > futures;
+                for ( vector< pair<string,BSONObj> >::iterator i = ranges.begin() ; i != ranges.end() ; i++ ){
+                    BSONObjBuilder b;
+                    b.append( "distinct" , collection );
+                    b.append( cmdObj["key"] );
+                    b.append( "query" , ClusteredCursor::concatQuery( i->second , query ) );
+                    futures.push_back( Future::spawnCommand( i->first , dbName , b.obj() ) );
+                }
                 
                 set<BSONObj,BSONObjCmp> all;
                 int size = 32;
                 
-                for ( vector<Chunk*>::iterator i = chunks.begin() ; i != chunks.end() ; i++ ){
-                    Chunk * c = *i;
-
-                    ScopedDbConnection conn( c->getShard() );
-                    BSONObj res;
-                    bool ok = conn->runCommand( conf->getName() , cmdObj , res );
-                    conn.done();
-                    
-                    if ( ! ok ){
-                        result.appendElements( res );
+                for ( list< shared_ptr<Future::CommandResult> >::iterator i=futures.begin(); i!=futures.end(); i++ ){
+                    shared_ptr<Future::CommandResult> res = *i;
+                    if ( ! res->join() ){
+                        result.appendElements( res->result() );
                         return false;
                     }
                     
-                    BSONObjIterator it( res["values"].embeddedObjectUserCheck() );
+                    BSONObjIterator it( res->result()["values"].embeddedObjectUserCheck() );
                     while ( it.more() ){
                         BSONElement nxt = it.next();
                         BSONObjBuilder temp(32);
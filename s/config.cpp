@@ -19,6 +19,7 @@
 #include "stdafx.h"
 #include "../util/message.h"
 #include "../util/unittest.h"
+#include "../util/background.h"
 #include "../client/connpool.h"
 #include "../client/model.h"
 #include "../db/pdfile.h"
@@ -32,6 +33,9 @@ namespace mongo {
 
     int ConfigServer::VERSION = 2;
 
+    static const char * ChangeLogNS = "config.changelog";
+    static const int ChangeLogSize = 10 * 1024 * 1024;
+
     /* --- DBConfig --- */
 
     string DBConfig::modelServer() {
@@ -39,6 +43,11 @@ namespace mongo {
     }
     
     bool DBConfig::isSharded( const string& ns ){
+        boostlock lk( _lock );
+        return _isSharded( ns );
+    }
+
+    bool DBConfig::_isSharded( const string& ns ){
         if ( ! _shardingEnabled )
             return false;
         return _sharded.find( ns ) != _sharded.end();
@@ -60,17 +69,19 @@ namespace mongo {
         if ( ! _shardingEnabled )
             throw UserException( "db doesn't have sharding enabled" );
         
-        ChunkManager * info = _shards[ns];
-        if ( info )
-            return info;
+        boostlock lk( _lock );
+
+        map<string,ChunkManager*>::iterator i = _shards.find( ns );
+        if ( i != _shards.end() )
+            return i->second;
         
-        if ( isSharded( ns ) )
+        if ( _isSharded( ns ) )
             throw UserException( "already sharded" );
 
         log() << "enable sharding on: " << ns << " with shard key: " << fieldsAndOrder << endl;
         _sharded[ns] = CollectionInfo( fieldsAndOrder , unique );
 
-        info = new ChunkManager( this , ns , fieldsAndOrder , unique );
+        ChunkManager * info = new ChunkManager( this , ns , fieldsAndOrder , unique );
         _shards[ns] = info;
         return info;
 
@@ -82,7 +93,10 @@ namespace mongo {
             return false;
         }
         
-        ChunkManager * info = _shards[ns];
+        boostlock lk( _lock );
+
+        map<string,ChunkManager*>::iterator j = _shards.find( ns );
+        ChunkManager * info = j == _shards.end() ? 0 : j->second;
         map<string,CollectionInfo>::iterator i = _sharded.find( ns );
 
         if ( info == 0 && i == _sharded.end() ){
@@ -93,21 +107,91 @@ namespace mongo {
         uassert( "info but no sharded" , i != _sharded.end() );
         
         _sharded.erase( i );
-        _shards.erase( ns ); // TODO: clean this up, maybe switch to shared_ptr
+        _shards.erase( ns );
+        _retire( info );
         return true;
     }
 
+    void DBConfig::_retire( ChunkManager * m ){
+        time_t now = time(0);
+        while ( _retired.size() && _retired.front().first + RetiredChunkManagerSecs < now ){
+            delete _retired.front().second;
+            _retired.pop_front();
+        }
+        _retired.push_back( make_pair( now , m ) );
+    }
+
     ChunkManager* DBConfig::getChunkManager( const string& ns , bool reload ){
-        ChunkManager* m = _shards[ns];
-        if ( m && ! reload )
-            return m;
+        ChunkManager* m = 0;
+        CollectionInfo info;
+        {
+            boostlock lk( _lock );
+            map<string,ChunkManager*>::iterator i = _shards.find( ns );
+            if ( i != _shards.end() )
+                m = i->second;
+            if ( m && ! reload )
+                return m;
+
+            uassert( (string)"not sharded:" + ns , _isSharded( ns ) );
+            info = _sharded[ns];
+        }
+
+        // the config server is asked without the lock held.  changes come back in a new
+        // manager; the old one stays as it was for whoever is still using it
+        ChunkManager* n = 0;
+        if ( m ){
+            // usually only a chunk or two has moved or split, so just fetch those
+            n = m->reload();
+            if ( n == m ){
+                // nothing newer than our version, yet we're out of date: what we missed was
+                // committed with a lower version, and an incremental fetch will never see it
+                log() << "no newer chunks for " << ns << ", rebuilding" << endl;
+                n = 0;
+            }
+            else if ( ! n )
+                log() << "reloading shard info for: " << ns << endl;
+        }
+        if ( ! n )
+            n = new ChunkManager( this , ns , info.key , info.unique );
+
+        boostlock lk( _lock );
+
+        if ( ! _isSharded( ns ) ){
+            // dropped while we were loading
+            if ( n != m )
+                delete n;
+            uassert( (string)"not sharded:" + ns , 0 );
+        }
+
+        ChunkManager*& cur = _shards[ns];
+        if ( cur && cur != m && cur->getVersion() >= n->getVersion() ){
+            // someone else reloaded meanwhile, and got at least as far
+            if ( n != m )
+                delete n;
+            return cur;
+        }
+        if ( cur && cur != n )
+            _retire( cur );
+        cur = n;
+        return n;
+    }
+
+    bool DBConfig::hasChunkManager( const string& ns ){
+        boostlock lk( _lock );
+        return _shards.find( ns ) != _shards.end();
+    }
+
+    void DBConfig::reloadChunkManagers(){
+        vector<string> loaded;
+        {
+            boostlock lk( _lock );
+            for ( map<string,ChunkManager*>::iterator i=_shards.begin(); i != _shards.end(); i++ )
+                loaded.push_back( i->first );
+        }
 
-        uassert( (string)"not sharded:" + ns , isSharded( ns ) );
-        if ( m && reload )
-            log() << "reloading shard info for: " << ns << endl;
-        m = new ChunkManager( this , ns , _sharded[ ns ].key , _sharded[ns].unique );
-        _shards[ns] = m;
-        return m;
+        for ( vector<string>::iterator i=loaded.begin(); i != loaded.end(); i++ )
+            if ( isSharded( *i ) )
+                getChunkManager( *i , true );
     }
 
     void DBConfig::serialize(BSONObjBuilder& to){
@@ -115,6 +199,7 @@ namespace mongo {
         to.appendBool("partitioned", _shardingEnabled );
         to.append("primary", _primary );
         
+        boostlock lk( _lock );
         if ( _sharded.size() > 0 ){
             BSONObjBuilder a;
             for ( map<string,CollectionInfo>::reverse_iterator i=_sharded.rbegin(); i != _sharded.rend(); i++){
@@ -128,29 +213,48 @@ namespace mongo {
     }
     
     void DBConfig::unserialize(const BSONObj& from){
-        _name = from.getStringField("name");
-        _shardingEnabled = from.getBoolField("partitioned");
-        _primary = from.getStringField("primary");
-        
-        _sharded.clear();
-        BSONObj sharded = from.getObjectField( "sharded" );
-        if ( ! sharded.isEmpty() ){
-            BSONObjIterator i(sharded);
+        map<string,CollectionInfo> sharded;
+        BSONObj s = from.getObjectField( "sharded" );
+        if ( ! s.isEmpty() ){
+            BSONObjIterator i(s);
             while ( i.more() ){
                 BSONElement e = i.next();
                 uassert( "sharded things have to be objects" , e.type() == Object );
                 BSONObj c = e.embeddedObject();
                 uassert( "key has to be an object" , c["key"].type() == Object );
-                _sharded[e.fieldName()] = CollectionInfo( c["key"].embeddedObject() , 
-                                                          c["unique"].trueValue() );
+                sharded[e.fieldName()] = CollectionInfo( c["key"].embeddedObject() , 
+                                                         c["unique"].trueValue() );
             }
         }
+
+        boostlock lk( _lock );
+
+        _name = from.getStringField("name");
+        _shardingEnabled = from.getBoolField("partitioned");
+        _primary = from.getStringField("primary");
+        _sharded.swap( sharded );
+
+        // a collection that isn't sharded any more has no use for its manager.  it's dropped
+        // from the map but not freed, as a request may still be using it
+        for ( map<string,ChunkManager*>::iterator i=_shards.begin(); i != _shards.end(); ){
+            if ( _sharded.find( i->first ) == _sharded.end() )
+                _shards.erase( i++ );
+            else
+                i++;
+        }
     }
     
     void DBConfig::save( bool check ){
         Model::save( check );
-        for ( map<string,ChunkManager*>::iterator i=_shards.begin(); i != _shards.end(); i++)
-            i->second->save();
+
+        vector<ChunkManager*> managers;
+        {
+            boostlock lk( _lock );
+            for ( map<string,ChunkManager*>::iterator i=_shards.begin(); i != _shards.end(); i++)
+                managers.push_back( i->second );
+        }
+        for ( vector<ChunkManager*>::iterator i=managers.begin(); i != managers.end(); i++ )
+            (*i)->save();
     }
 
     bool DBConfig::reload(){
@@ -228,6 +332,8 @@ namespace mongo {
         
         log(1) << "\t dropped primary db for: " << _name << endl;
 
+        configServer.logChange( "dropDatabase" , _name );
+
         return true;
     }
 
@@ -235,21 +341,27 @@ namespace mongo {
         num = 0;
         set<string> seen;
         while ( true ){
-            map<string,ChunkManager*>::iterator i = _shards.begin();
-
-            if ( i == _shards.end() )
-                break;
+            string ns;
+            ChunkManager * m;
+            {
+                boostlock lk( _lock );
+                map<string,ChunkManager*>::iterator i = _shards.begin();
+                if ( i == _shards.end() )
+                    break;
+                ns = i->first;
+                m = i->second;
+            }
 
-            if ( seen.count( i->first ) ){
+            if ( seen.count( ns ) ){
                 errmsg = "seen a collection twice!";
                 return false;
             }
 
-            seen.insert( i->first );
-            log(1) << "\t dropping sharded collection: " << i->first << endl;
+            seen.insert( ns );
+            log(1) << "\t dropping sharded collection: " << ns << endl;
 
-            i->second->getAllServers( allServers );
-            i->second->drop();
+            m->getAllServers( allServers );
+            m->drop();
             
             num++;
             uassert( "_dropShardedCollections too many collections - bailing" , num < 100000 );
@@ -260,12 +372,8 @@ namespace mongo {
     
     /* --- Grid --- */
     
-    string Grid::pickShardForNewDB(){
+    void Grid::getAllShards( vector<string>& all ) const{
         ScopedDbConnection conn( configServer.getPrimary() );
-        
-        // TODO: this is temporary
-        
-        vector<string> all;
         auto_ptr<DBClientCursor> c = conn->query( "config.shards" , Query() );
         while ( c->more() ){
             BSONObj s = c->next();
@@ -273,6 +381,13 @@ namespace mongo {
             // look at s["maxSize"] if exists
         }
         conn.done();
+    }
+
+    string Grid::pickShardForNewDB(){
+        // TODO: this is temporary
+        
+        vector<string> all;
+        getAllShards( all );
         
         if ( all.size() == 0 )
             return "";
@@ -348,6 +463,119 @@ namespace mongo {
         return result["optime"]._numberLong();
     }
 
+    void Grid::gotChange( const BSONObj& change ){
+        if ( change["mongos"].type() == jstOID && serverID == change["mongos"].__oid() )
+            return; // ours, so already reflected
+
+        string what = change["what"].valuestrsafe();
+        string ns = change["ns"].valuestrsafe();
+        string database = ns.substr( 0 , ns.find( '.' ) );
+
+        DBConfig * config = 0;
+        {
+            boostlock l( _lock );
+            map<string,DBConfig*>::iterator i = _databases.find( database );
+            if ( i == _databases.end() || ! i->second )
+                return; // never looked at, so nothing to bring up to date
+            config = i->second;
+        }
+
+        log(1) << "changelog: " << what << " " << ns << endl;
+
+        if ( what == "dropDatabase" ){
+            removeDB( database );
+            return;
+        }
+
+        if ( what == "split" || what == "moveChunk" ){
+            if ( config->hasChunkManager( ns ) && config->isSharded( ns ) )
+                config->getChunkManager( ns , true );
+            return;
+        }
+
+        // the database entry itself changed.  reloading it lets go of the manager of a
+        // collection that's no longer sharded
+        config->reload();
+    }
+
+    void Grid::reloadAll(){
+        vector<DBConfig*> all;
+        {
+            boostlock l( _lock );
+            for ( map<string,DBConfig*>::iterator i=_databases.begin(); i!=_databases.end(); i++ )
+                if ( i->second )
+                    all.push_back( i->second );
+        }
+
+        for ( vector<DBConfig*>::iterator i=all.begin(); i!=all.end(); i++ ){
+            (*i)->reload();
+            (*i)->reloadChunkManagers();
+        }
+    }
+
+    /**
+     * follows config.changelog with a tailable cursor.  what's there when we start is history.
+     * if the cursor is lost, the new one resumes after the last change seen; if that's gone
+     * from the capped collection too, everything cached is reloaded.
+     */
+    class ChangeLogListener : public BackgroundJob {
+    protected:
+        void run(){
+            BSONObj last; // _id of the last change seen, applied or skipped
+            bool started = false; // whether what was there before we started has been passed over
+
+            while ( ! inShutdown() ){
+                try {
+                    ScopedDbConnection conn( configServer.modelServer() );
+                    auto_ptr<DBClientCursor> c = conn->query( ChangeLogNS , Query().sort( BSON( "$natural" << 1 ) ) , 
+                                                              0 , 0 , 0 , Option_CursorTailable | Option_AwaitData );
+
+                    BSONObj resumeAfter = last;
+                    bool found = false; // past what we've seen before
+                    while ( ! inShutdown() ){
+                        if ( ! c->more() ){
+                            if ( ! found ){
+                                if ( started && last.woCompare( resumeAfter ) != 0 ){
+                                    // where we were isn't there any more, or there was nowhere and
+                                    // changes came in while we had no cursor
+                                    log() << "changelog: lost our place, reloading all sharding info" << endl;
+                                    grid.reloadAll();
+                                }
+                                found = started = true;
+                            }
+                            if ( c->isDead() )
+                                break;
+                            continue; // AwaitData has the config server hold the getMore for a while
+                        }
+
+                        BSONObj change = c->next();
+                        BSONObj id = change["_id"].wrap().getOwned();
+                        if ( ! found ){
+                            if ( ! resumeAfter.isEmpty() && id.woCompare( resumeAfter ) == 0 )
+                                found = true;
+                            last = id;
+                            continue;
+                        }
+
+                        grid.gotChange( change );
+                        last = id;
+                    }
+
+                    c.reset();
+                    conn.done();
+                }
+                catch ( std::exception& e ){
+                    log() << "changelog: listener error: " << e.what() << endl;
+                }
+                sleepsecs( 1 );
+            }
+        }
+    } changeLogListener;
+
+    void startChangeLogListener(){
+        changeLogListener.go();
+    }
+
     /* --- ConfigServer ---- */
 
     ConfigServer::ConfigServer() {
@@ -459,6 +687,33 @@ namespace mongo {
         return -8;
     }
 
+    void ConfigServer::logChange( const string& what , const string& ns , const BSONObj& detail ){
+        static bool createdChangeLog = false;
+        try {
+            ScopedDbConnection conn( _primary );
+            if ( ! createdChangeLog ){
+                // just fails if it's there already
+                conn->createCollection( ChangeLogNS , ChangeLogSize , true );
+                createdChangeLog = true;
+            }
+
+            BSONObjBuilder b;
+            b.appendOID( "_id" , 0 , true );
+            b.append( "server" , ourHostname );
+            b.appendOID( "mongos" , &serverID );
+            b.appendDate( "time" , jsTime() );
+            b.append( "what" , what );
+            b.append( "ns" , ns );
+            b.append( "details" , detail );
+            conn->insert( ChangeLogNS , b.obj() );
+            conn.done();
+        }
+        catch ( std::exception& e ){
+            // the change is made, the other mongoses will just have to find out the slow way
+            log() << "couldn't log change: " << what << " " << ns << " " << e.what() << endl;
+        }
+    }
+
     string ConfigServer::getHost( string name , bool withPort ){
         if ( name.find( ":" ) ){
             if ( withPort )
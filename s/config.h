@@ -72,7 +72,23 @@ namespace mongo {
          */
         bool isSharded( const string& ns );
         
+        /**
+         * @param reload the caller has reason to think what we have is out of date.  only the
+         *        chunks changed since our version are fetched; if there are none, the manager is
+         *        rebuilt from scratch instead, as a change can commit with a lower version than
+         *        one we've already seen
+         */
         ChunkManager* getChunkManager( const string& ns , bool reload = false );
+
+        /**
+         * @return whether a ChunkManager for ns has been loaded
+         */
+        bool hasChunkManager( const string& ns );
+
+        /**
+         * brings every loaded ChunkManager up to date with the config server
+         */
+        void reloadChunkManagers();
         
         /**
          * @return the correct for shard for the ns
@@ -115,6 +131,8 @@ namespace mongo {
          */
         bool removeSharding( const string& ns );
 
+        bool _isSharded( const string& ns );
+
         string _name; // e.g. "alleyinsider"
         string _primary; // e.g. localhost , mongo.foo.com:9999
         bool _shardingEnabled;
@@ -122,6 +140,18 @@ namespace mongo {
         map<string,CollectionInfo> _sharded; // { "alleyinsider.blog.posts" : { ts : 1 }  , ... ] - all ns that are sharded
         map<string,ChunkManager*> _shards; // this will only have entries for things that have been looked at
 
+        /* guards _sharded and _shards: the changelog listener updates them while requests read them.
+           a ChunkManager is never changed once it's in _shards, a reload puts a new one in its place
+        */
+        boost::mutex _lock;
+
+        /* a manager taken out of _shards may still be in use by requests that looked it up
+           earlier, so it's only freed RetiredChunkManagerSecs later.  _lock held
+        */
+        void _retire( ChunkManager * m );
+        list< pair<time_t,ChunkManager*> > _retired;
+        enum { RetiredChunkManagerSecs = 10 * 60 };
+
         friend class Grid;
         friend class ChunkManager;
     };
@@ -145,10 +175,23 @@ namespace mongo {
         void removeDB( string db );
 
         string pickShardForNewDB();
+
+        /* hosts of all the shards in config.shards */
+        void getAllShards( vector<string>& all ) const;
         
         bool knowAboutShard( string name ) const;
 
         unsigned long long getNextOpTime() const;
+
+        /**
+         * brings what's cached up to date with a config.changelog entry
+         */
+        void gotChange( const BSONObj& change );
+
+        /**
+         * reloads every cached database and chunk manager, for when changes may have been missed
+         */
+        void reloadAll();
     private:
         map<string,DBConfig*> _databases;
         boost::mutex _lock; // TODO: change to r/w lock
@@ -185,11 +228,21 @@ namespace mongo {
          * @return 0 = ok, otherwise error #
          */
         int checkConfigVersion();
+
+        /**
+         * records a change to the sharding metadata in config.changelog, a capped collection
+         * every mongos tails so it can update its caches before being told they're stale.
+         * @param what e.g. "split" , "moveChunk" , "shardCollection" , "dropCollection"
+         */
+        void logChange( const string& what , const string& ns , const BSONObj& detail = BSONObj() );
         
         static int VERSION;
         
     private:
         string getHost( string name , bool withPort );
     };
+
+    /* tails config.changelog, applying other mongoses' changes to grid */
+    void startChangeLogListener();
     
 } // namespace mongo
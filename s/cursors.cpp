@@ -4,6 +4,7 @@
 #include "cursors.h"
 #include "../client/connpool.h"
 #include "../db/queryutil.h"
+#include "../util/background.h"
 
 namespace mongo {
     
@@ -19,6 +20,10 @@ namespace mongo {
         _totalSent = 0;
         _done = false;
 
+        _idleAgeMillis = 0;
+        _hasPending = false;
+        _lastBatchBytes = 0;
+
         do {
             _id = security.getNonce();
         } while ( _id == 0 );
@@ -33,25 +38,31 @@ namespace mongo {
 
     bool ShardedClientCursor::sendNextBatch( Request& r , int ntoreturn ){
         uassert( "cursor already done" , ! _done );
+        _idleAgeMillis = 0;
                 
-        int maxSize = 1024 * 1024;
-        if ( _totalSent > 0 )
-            maxSize *= 3;
+        int maxSize = _totalSent > 0 ? MaxBatchBytes : FirstBatchBytes;
         
-        BufBuilder b(32768);
+        // a batch is usually about as big as the last one, so start there rather than growing into it
+        BufBuilder b( max( 32768 , min( _lastBatchBytes + 1024 , maxSize ) ) );
         
         int num = 0;
         bool sendMore = true;
 
-        while ( _cursor->more() ){
-            BSONObj o = _cursor->next();
+        while ( _hasPending || _cursor->more() ){
+            BSONObj o = _hasPending ? _pending : _cursor->next();
+            _hasPending = false;
+            _pending = BSONObj();
+
+            if ( num > 0 && b.len() + o.objsize() > maxSize ){
+                // doesn't fit, it starts the next batch
+                _pending = o;
+                _hasPending = true;
+                break;
+            }
 
             b.append( (void*)o.objdata() , o.objsize() );
             num++;
             
-            if ( b.len() > maxSize )
-                break;
-
             if ( num == ntoreturn ){
                 // soft limit aka batch size
                 break;
@@ -64,11 +75,12 @@ namespace mongo {
             }
         }
 
-        bool hasMore = sendMore && _cursor->more();
+        bool hasMore = sendMore && ( _hasPending || _cursor->more() );
         log(6) << "\t hasMore:" << hasMore << " wouldSendMoreIfHad: " << sendMore << " id:" << _id << " totalSent: " << _totalSent << endl;
         
         replyToQuery( 0 , r.p() , r.m() , b.buf() , b.len() , num , _totalSent , hasMore ? _id : 0 );
         _totalSent += num;
+        _lastBatchBytes = b.len();
         _done = ! hasMore;
         
         return hasMore;
@@ -83,19 +95,107 @@ namespace mongo {
     }
 
     ShardedClientCursor* CursorCache::get( long long id ){
-        map<long long,ShardedClientCursor*>::iterator i = _cursors.find( id );
-        if ( i == _cursors.end() ){
+        Bucket& b = bucket( id );
+        boostlock lk( b.m );
+        map<long long,ShardedClientCursor*>::iterator i = b.cursors.find( id );
+        if ( i == b.cursors.end() ){
             OCCASIONALLY log() << "Sharded CursorCache missing cursor id: " << id << endl;
             return 0;
         }
-        return i->second;
+        ShardedClientCursor * c = i->second;
+        b.cursors.erase( i );
+        return c;
     }
     
     void CursorCache::store( ShardedClientCursor * cursor ){
-        _cursors[cursor->getId()] = cursor;
+        ShardedClientCursor * evicted = 0;
+        {
+            Bucket& b = bucket( cursor->getId() );
+            boostlock lk( b.m );
+            if ( b.cursors.size() >= MaxCursors / NumBuckets ){
+                map<long long,ShardedClientCursor*>::iterator oldest = b.cursors.begin();
+                for ( map<long long,ShardedClientCursor*>::iterator i = b.cursors.begin(); i != b.cursors.end(); i++ ){
+                    if ( i->second->idleTime() > oldest->second->idleTime() )
+                        oldest = i;
+                }
+                evicted = oldest->second;
+                b.cursors.erase( oldest );
+            }
+            b.cursors[cursor->getId()] = cursor;
+        }
+
+        if ( evicted ){
+            log() << "too many open cursors, killing " << evicted->getId() << " idle:" << evicted->idleTime() << "ms" << endl;
+            delete evicted;
+        }
     }
+
     void CursorCache::remove( long long id ){
-        _cursors.erase( id );
+        ShardedClientCursor * c = get( id );
+        if ( c )
+            delete c;
+    }
+
+    void CursorCache::gotKillCursors( Message& m ){
+        int *x = (int *) m.data->_data;
+        x++; // reserved
+        int n = *x++;
+        uassert( "sent 0 cursors to kill" , n >= 1 );
+        uassert( "bad kill cursors size" , m.data->dataLen() == 8 + ( 8 * n ) );
+
+        long long * ids = (long long *) x;
+        for ( int i=0; i<n; i++ ){
+            log(4) << "killing cursor: " << ids[i] << endl;
+            remove( ids[i] );
+        }
+    }
+
+    void CursorCache::idleTimeReport( unsigned millis ){
+        for ( int i=0; i<NumBuckets; i++ ){
+            vector<ShardedClientCursor*> toDelete;
+            {
+                Bucket& b = _buckets[i];
+                boostlock lk( b.m );
+                for ( map<long long,ShardedClientCursor*>::iterator j = b.cursors.begin(); j != b.cursors.end(); ){
+                    map<long long,ShardedClientCursor*>::iterator k = j++;
+                    if ( k->second->shouldTimeout( millis ) ){
+                        toDelete.push_back( k->second );
+                        b.cursors.erase( k );
+                    }
+                }
+            }
+            // deleting closes the shard cursors, which isn't something to do holding the lock
+            for ( unsigned j=0; j<toDelete.size(); j++ ){
+                log(1) << "killing old cursor " << toDelete[j]->getId() << " idle:" << toDelete[j]->idleTime() << "ms" << endl;
+                delete toDelete[j];
+            }
+        }
+    }
+
+    void CursorCache::appendInfo( BSONObjBuilder& result ){
+        int total = 0;
+        for ( int i=0; i<NumBuckets; i++ ){
+            boostlock lk( _buckets[i].m );
+            total += _buckets[i].cursors.size();
+        }
+        result.append( "totalOpen" , total );
+    }
+
+    class CursorReaper : public BackgroundJob {
+    protected:
+        void run(){
+            Timer t;
+            while ( ! inShutdown() ){
+                sleepsecs( 4 );
+                unsigned millis = t.millis();
+                t.reset();
+                cursorCache.idleTimeReport( millis );
+            }
+        }
+    } cursorReaper;
+
+    void startCursorReaper(){
+        cursorReaper.go();
     }
 
     CursorCache cursorCache;
@@ -13,7 +13,7 @@
 
 namespace mongo {
 
-    class ShardedClientCursor {
+    class ShardedClientCursor : boost::noncopyable {
     public:
         ShardedClientCursor( QueryMessage& q , ClusteredCursor * cursor );
         virtual ~ShardedClientCursor();
@@ -25,7 +25,21 @@ namespace mongo {
          */
         bool sendNextBatch( Request& r ){ return sendNextBatch( r , _ntoreturn ); }
         bool sendNextBatch( Request& r , int ntoreturn );
-        
+
+        /**
+         * @param millis amount of idle time passed since the last call
+         * @return true if the client has abandoned it
+         */
+        bool shouldTimeout( unsigned millis ){
+            _idleAgeMillis += millis;
+            return _idleAgeMillis > TimeoutMillis;
+        }
+        unsigned idleTime() const { return _idleAgeMillis; }
+
+        enum { TimeoutMillis = 10 * 60 * 1000 };        // same as mongod's ClientCursor
+        enum { FirstBatchBytes = 1024 * 1024 ,          // the first reply comes back quickly
+               MaxBatchBytes = 4 * 1024 * 1024 };       // every later one is filled up to this
+
     protected:
         
         ClusteredCursor * _cursor;
@@ -37,20 +51,57 @@ namespace mongo {
         bool _done;
 
         long long _id;
+
+        unsigned _idleAgeMillis;
+        bool _hasPending;
+        BSONObj _pending;       // pulled but didn't fit in the last batch
+        int _lastBatchBytes;    // to size the next batch's buffer
     };
     
+    /**
+     * the open client cursors of this mongos.  split into buckets by id, each with its own lock,
+     * so requests on different cursors don't wait on each other.
+     *
+     * a cursor is checked out by get() while a request uses it, and checked back in by store(), so
+     * the reaper only ever sees idle cursors.  cursors left idle for ShardedClientCursor::TimeoutMillis
+     * are deleted, which also releases their shard connections.
+     */
     class CursorCache {
     public:
         CursorCache();
         ~CursorCache();
         
+        /* takes the cursor out of the cache.  store() it again if it isn't finished */
         ShardedClientCursor * get( long long id );
         void store( ShardedClientCursor* cursor );
         void remove( long long id );
 
+        /* OP_KILL_CURSORS from a client */
+        void gotKillCursors( Message& m );
+
+        /* called every few seconds by the reaper.  millis is the time passed since the last call */
+        void idleTimeReport( unsigned millis );
+
+        enum { NumBuckets = 16 };
+        enum { MaxCursors = 10000 };    // beyond this the longest idle cursors make way
+
+        void appendInfo( BSONObjBuilder& result );
+
     private:
-        map<long long,ShardedClientCursor*> _cursors;
+        struct Bucket {
+            boost::mutex m;
+            map<long long,ShardedClientCursor*> cursors;
+        };
+
+        Bucket& bucket( long long id ){
+            return _buckets[ (unsigned long long) id % NumBuckets ];
+        }
+
+        Bucket _buckets[ NumBuckets ];
     };
     
     extern CursorCache cursorCache;
+
+    /* deletes cursors left idle too long */
+    void startCursorReaper();
 }
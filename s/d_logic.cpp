@@ -25,23 +25,178 @@
 #include "stdafx.h"
 #include <map>
 #include <string>
+#include <boost/thread/tss.hpp>
 
 #include "../db/commands.h"
 #include "../db/jsobj.h"
 #include "../db/dbmessage.h"
+#include "../db/db.h"
+#include "../db/btree.h"
+#include "../db/queryoptimizer.h"
+#include "../db/repl.h"
+#include "../db/instance.h"
+#include "../db/client.h"
 
 #include "../client/connpool.h"
 
 #include "../util/queue.h"
+#include "../util/background.h"
+
+#include "d_logic.h"
 
 using namespace std;
 
 namespace mongo {
     
-    typedef map<string,unsigned long long> NSVersions;
-    
-    NSVersions globalVersions;
-    boost::thread_specific_ptr<NSVersions> clientShardVersions;
+    /* a namespace's shard version on this mongod.  a change makes a new one rather than
+       writing over the old, and the old ones are never freed, as a connection may still be
+       looking at them.  they're tiny and only change on setShardVersion and migrations.
+    */
+    struct ShardVersionRec {
+        ShardVersionRec( unsigned long long v ) : version( v ){}
+        const unsigned long long version;
+    };
+
+    struct GlobalShardVersion {
+        GlobalShardVersion( unsigned h , const string& n , GlobalShardVersion * nx ) : hash( h ) , ns( n ) , current( 0 ) , next( nx ){}
+        const unsigned hash;
+        const string ns;
+        const ShardVersionRec * volatile current;
+        GlobalShardVersion * const next;
+    };
+
+    /* ns -> version, read without a lock on every message.  same scheme as
+       NamespaceDetailsTransient: a bucket chain only grows by pushing a fully built node on
+       its head, under _mutex, and nodes are never unlinked.
+    */
+    class GlobalShardVersions {
+    public:
+        /** @return ns's node, 0 if it's never had a version.  no lock, no allocation */
+        static GlobalShardVersion * find( const char * ns ){
+            unsigned h = hashNs( ns );
+            for ( GlobalShardVersion * n = _buckets[ h % NBuckets ]; n; n = n->next )
+                if ( n->hash == h && n->ns == ns )
+                    return n;
+            return 0;
+        }
+
+        static unsigned long long get( const char * ns ){
+            GlobalShardVersion * n = find( ns );
+            if ( ! n )
+                return 0;
+            return n->current->version;
+        }
+
+        static void set( const string& ns , unsigned long long version ){
+            boostlock lk( _mutex );
+            unsigned h = hashNs( ns.c_str() );
+            GlobalShardVersion * volatile &head = _buckets[ h % NBuckets ];
+            GlobalShardVersion * n = head;
+            for ( ; n; n = n->next )
+                if ( n->hash == h && n->ns == ns )
+                    break;
+            
+            ShardVersionRec * v = new ShardVersionRec( version );
+            if ( n ){
+                memoryBarrier();
+                n->current = v;
+                return;
+            }
+
+            n = new GlobalShardVersion( h , ns , head );
+            n->current = v;
+            memoryBarrier();
+            head = n;
+        }
+
+    private:
+        static unsigned hashNs( const char * ns ){
+            unsigned x = 0;
+            for( const char *p = ns; *p; ++p )
+                x = x * 131 + *p;
+            return x;
+        }
+
+        enum { NBuckets = 256 };
+        static GlobalShardVersion * volatile _buckets[ NBuckets ];
+        static boost::mutex _mutex;
+    };
+
+    GlobalShardVersion * volatile GlobalShardVersions::_buckets[ GlobalShardVersions::NBuckets ];
+    boost::mutex GlobalShardVersions::_mutex;
+
+    ShardedConnectionInfo * ShardedConnectionInfo::get( bool create ){
+        Client * c = currentClient.get();
+        if ( ! c )
+            return 0;
+        if ( ! c->sharded && create ){
+            log(1) << "entering shard mode for connection" << endl;
+            c->sharded = new ShardedConnectionInfo();
+        }
+        return c->sharded;
+    }
+
+    ShardedConnectionInfo::Entry * ShardedConnectionInfo::find( const char * ns ){
+        for ( vector<Entry>::iterator i=_entries.begin(); i!=_entries.end(); i++ )
+            if ( strcmp( i->ns.c_str() , ns ) == 0 )
+                return &(*i);
+        return 0;
+    }
+
+    ShardedConnectionInfo::Entry& ShardedConnectionInfo::findOrAdd( const string& ns ){
+        Entry * e = find( ns.c_str() );
+        if ( e )
+            return *e;
+        _entries.push_back( Entry( ns ) );
+        return _entries.back();
+    }
+
+    unsigned long long ShardedConnectionInfo::getVersion( const char * ns ){
+        Entry * e = find( ns );
+        return e ? e->version : 0;
+    }
+
+    void ShardedConnectionInfo::setVersion( const string& ns , unsigned long long version ){
+        Entry& e = findOrAdd( ns );
+        e.version = version;
+        e.okAt = 0;
+    }
+
+    bool ShardedConnectionInfo::versionOk( const char * ns , string& errmsg ){
+        Entry * e = find( ns );
+        if ( e && e->global && e->okAt == e->global->current )
+            return true;
+        
+        GlobalShardVersion * global = e && e->global ? e->global : GlobalShardVersions::find( ns );
+        if ( ! global )
+            return true;
+
+        const ShardVersionRec * current = global->current;
+        unsigned long long version = current->version;
+        unsigned long long clientVersion = e ? e->version : 0;
+                
+        if ( version == 0 && clientVersion > 0 ){
+            stringstream ss;
+            ss << "version: " << version << " clientVersion: " << clientVersion;
+            errmsg = ss.str();
+            return false;
+        }
+        
+        if ( clientVersion >= version ){
+            Entry& ok = e ? *e : findOrAdd( ns );
+            ok.global = global;
+            ok.okAt = current;
+            return true;
+        }
+
+        if ( clientVersion == 0 ){
+            errmsg = "client in sharded mode, but doesn't have version set for this collection";
+            return false;
+        }
+
+        errmsg = (string)"your version is too old  ns: " + ns;
+        return false;
+    }
 
     string shardConfigServer;
 
@@ -169,13 +324,7 @@ namespace mongo {
                 return false;
             }
 
-            NSVersions * versions = clientShardVersions.get();
-            
-            if ( ! versions ){
-                log(1) << "entering shard mode for connection" << endl;
-                versions = new NSVersions();
-                clientShardVersions.reset( versions );
-            }
+            ShardedConnectionInfo * info = ShardedConnectionInfo::get( true );
             
             string ns = cmdObj["setShardVersion"].valuestrsafe();
             if ( ns.size() == 0 ){
@@ -183,12 +332,12 @@ namespace mongo {
                 return false;
             }
 
-            unsigned long long& oldVersion = (*versions)[ns];
-            unsigned long long& globalVersion = globalVersions[ns];
+            unsigned long long oldVersion = info->getVersion( ns.c_str() );
+            unsigned long long globalVersion = GlobalShardVersions::get( ns.c_str() );
             
             if ( version == 0 && globalVersion == 0 ){
                 // this connection is cleaning itself
-                oldVersion = 0;
+                info->setVersion( ns , 0 );
                 return 1;
             }
 
@@ -204,8 +353,8 @@ namespace mongo {
                 result.appendTimestamp( "beforeDrop" , globalVersion );
                 // only setting global version on purpose
                 // need clients to re-find meta-data
-                globalVersion = 0;
-                oldVersion = 0;
+                GlobalShardVersions::set( ns , 0 );
+                info->setVersion( ns , 0 );
                 return 1;
             }
 
@@ -230,8 +379,8 @@ namespace mongo {
             }
 
             result.appendTimestamp( "oldVersion" , oldVersion );
-            oldVersion = version;
-            globalVersion = version;
+            info->setVersion( ns , version );
+            GlobalShardVersions::set( ns , version );
 
             result.append( "ok" , 1 );
             return 1;
@@ -256,17 +405,205 @@ namespace mongo {
             
             result.append( "configServer" , shardConfigServer.c_str() );
 
-            result.appendTimestamp( "global" , globalVersions[ns] );
-            if ( clientShardVersions.get() )
-                result.appendTimestamp( "mine" , (*clientShardVersions.get())[ns] );
-            else 
-                result.appendTimestamp( "mine" , 0 );
+            result.appendTimestamp( "global" , GlobalShardVersions::get( ns.c_str() ) );
+            ShardedConnectionInfo * info = ShardedConnectionInfo::get( false );
+            result.appendTimestamp( "mine" , info ? info->getVersion( ns.c_str() ) : 0 );
             
             return true;
         }
         
     } getShardVersion;
     
+    /**
+     * the chunk being migrated off this shard, if any.
+     *
+     * movechunk.start remembers where the chunk's documents are; the recipient then pulls
+     * them with movechunk.getbatch in disk order rather than key order, so the copy reads
+     * the data files mostly sequentially.  a document deleted or moved by an update before
+     * it is sent is dropped from the list and looked up again by _id.
+     * everything here happens under the db write lock.
+     */
+    class MigrateFromStatus {
+    public:
+        MigrateFromStatus() : _active( false ){}
+
+        bool active() const { return _active; }
+        const string& ns() const { return _ns; }
+
+        void start( const string& ns , const set<DiskLoc>& locs ){
+            assert( ! _active );
+            _ns = ns;
+            _locs = locs;
+            _reload.clear();
+            _active = true;
+        }
+
+        void done(){
+            _active = false;
+            _locs.clear();
+            _reload.clear();
+        }
+
+        void aboutToDelete( const char * ns , const DiskLoc& dl ){
+            if ( ! _active || _ns != ns )
+                return;
+            set<DiskLoc>::iterator i = _locs.find( dl );
+            if ( i == _locs.end() )
+                return;
+            _locs.erase( i );
+            BSONElement id = dl.obj()["_id"];
+            if ( ! id.eoo() )
+                _reload.push_back( id.wrap() );
+        }
+
+        /* appends documents until about maxBytes. @return number appended, 0 when done */
+        int nextBatch( BSONObjBuilder& a , int maxBytes ){
+            int n = 0 , bytes = 0;
+            while ( _reload.size() && bytes < maxBytes ){
+                BSONObj o;
+                if ( Helpers::findById( _ns.c_str() , _reload.back() , o ) ){
+                    a.append( BSONObjBuilder::numStr( n ).c_str() , o );
+                    bytes += o.objsize();
+                    n++;
+                }
+                _reload.pop_back();
+            }
+            while ( _locs.size() && bytes < maxBytes ){
+                set<DiskLoc>::iterator i = _locs.begin();
+                BSONObj o = i->obj();
+                a.append( BSONObjBuilder::numStr( n ).c_str() , o );
+                bytes += o.objsize();
+                n++;
+                _locs.erase( i );
+            }
+            return n;
+        }
+
+    private:
+        bool _active;
+        string _ns;
+        set<DiskLoc> _locs;
+        list<BSONObj> _reload;
+    } migrateFromStatus;
+
+    void aboutToDeleteForSharding( const char * ns , const DiskLoc& dl ){
+        migrateFromStatus.aboutToDelete( ns , dl );
+    }
+
+    /**
+     * deletes a migrated chunk's documents after the move has committed, a batch at a
+     * time, letting go of the lock in between so the shard keeps serving while it runs.
+     */
+    class RangeDeleter : public BackgroundJob {
+    public:
+        enum { BatchSize = 128 , PauseMillis = 20 };
+
+        RangeDeleter( const string& ns , const BSONObj& keyPattern , const BSONObj& min , const BSONObj& max )
+            : _ns( ns ) , _keyPattern( keyPattern.getOwned() ) , _min( min.getOwned() ) , _max( max.getOwned() ){
+            boostlock lk( _pendingMutex );
+            _pending[ns]++;
+        }
+
+        ~RangeDeleter(){
+            boostlock lk( _pendingMutex );
+            _pending[_ns]--;
+        }
+
+        /* call without the db lock */
+        long long deleteAll(){
+            long long n = 0;
+            int removed;
+            while ( ( removed = deleteSome() ) > 0 ){
+                n += removed;
+                sleepmillis( PauseMillis );
+            }
+            log() << "moveChunk deleted " << n << " documents of " << _ns << " from " << _min << " to " << _max << endl;
+            return n;
+        }
+
+        /* @return if a range of ns is still waiting to be deleted here */
+        static bool pending( const string& ns ){
+            boostlock lk( _pendingMutex );
+            map<string,int>::iterator i = _pending.find( ns );
+            return i != _pending.end() && i->second > 0;
+        }
+
+    protected:
+        void run(){
+            Client::initThread( "rangedeleter" );
+            try {
+                deleteAll();
+            }
+            catch ( std::exception& e ){
+                log() << "moveChunk range delete of " << _ns << " from " << _min << " to " << _max << " failed: " << e.what() << endl;
+            }
+            cc().shutdown();
+        }
+
+    private:
+        int deleteSome(){
+            dblock lk;
+            setClient( _ns.c_str() );
+
+            string errmsg;
+            IndexDetails * idx = indexDetailsForRange( _ns.c_str() , errmsg , _min , _max , _keyPattern );
+            if ( ! idx ){
+                log() << "moveChunk range delete of " << _ns << ": " << errmsg << endl;
+                return 0;
+            }
+            NamespaceDetails * d = nsdetails( _ns.c_str() );
+
+            vector<DiskLoc> locs;
+            for ( BtreeCursor c( d , d->idxNo( *idx ) , *idx , _min , _max , false , 1 ); c.ok() && locs.size() < BatchSize; c.advance() )
+                locs.push_back( c.currLoc() );
+
+            for ( unsigned i=0; i<locs.size(); i++ ){
+                BSONObj id = locs[i].obj()["_id"].wrap();
+                theDataFileMgr.deleteRecord( _ns.c_str() , locs[i].rec() , locs[i] );
+                logOp( "d" , _ns.c_str() , id );
+            }
+            return locs.size();
+        }
+
+        string _ns;
+        BSONObj _keyPattern;
+        BSONObj _min;
+        BSONObj _max;
+
+        static boost::mutex _pendingMutex;
+        static map<string,int> _pending;
+    };
+
+    boost::mutex RangeDeleter::_pendingMutex;
+    map<string,int> RangeDeleter::_pending;
+
+    bool rangeDeletePending( const string& ns ){
+        return RangeDeleter::pending( ns );
+    }
+
+    class MoveShardGetBatchCommand : public MongodShardCommand {
+    public:
+        MoveShardGetBatchCommand() : MongodShardCommand( "movechunk.getbatch" ){}
+        virtual void help( stringstream& help ) const {
+            help << "should not be calling this directly" << endl;
+        }
+
+        bool run(const char *cmdns, BSONObj& cmdObj, string& errmsg, BSONObjBuilder& result, bool){
+            string ns = cmdObj["movechunk.getbatch"].valuestrsafe();
+            if ( ! migrateFromStatus.active() || migrateFromStatus.ns() != ns ){
+                errmsg = "not migrating " + ns;
+                return false;
+            }
+
+            setClient( ns.c_str() );
+            BSONObjBuilder a( result.subarrayStart( "objects" ) );
+            migrateFromStatus.nextBatch( a , 1024 * 1024 * 2 );
+            a.done();
+            return true;
+        }
+
+    } moveShardGetBatchCmd;
+
     class MoveShardStartCommand : public MongodShardCommand {
     public:
         MoveShardStartCommand() : MongodShardCommand( "movechunk.start" ){}
@@ -305,6 +642,42 @@ namespace mongo {
             
             log() << "got movechunk.start: " << cmdObj << endl;
             
+            // a mongos that sends the chunk's bounds gets the bulk copy: the recipient pulls
+            // batches from us with movechunk.getbatch instead of running a query
+            BSONObj min = cmdObj.getObjectField( "min" );
+            BSONObj max = cmdObj.getObjectField( "max" );
+            BSONObj keyPattern = cmdObj.getObjectField( "shardKeyPattern" );
+            bool bulk = ! min.isEmpty() && ! max.isEmpty() && ! keyPattern.isEmpty();
+            
+            if ( bulk ){
+                if ( migrateFromStatus.active() ){
+                    errmsg = "already migrating a chunk of " + migrateFromStatus.ns();
+                    return false;
+                }
+                
+                setClient( ns.c_str() );
+                IndexDetails * idx = indexDetailsForRange( ns.c_str() , errmsg , min , max , keyPattern );
+                if ( ! idx )
+                    return false;
+                NamespaceDetails * d = nsdetails( ns.c_str() );
+                
+                NamespaceDetailsTransient& t = NamespaceDetailsTransient::get_w( ns.c_str() );
+                if ( ! t.cllNS().empty() ){
+                    errmsg = "changes to " + ns + " are already being logged";
+                    return false;
+                }
+                
+                // the change log starts under the same lock as the snapshot of the chunk,
+                // so every write lands in one or the other
+                set<DiskLoc> locs;
+                for ( BtreeCursor c( d , d->idxNo( *idx ) , *idx , min , max , false , 1 ); c.ok(); c.advance() )
+                    locs.insert( c.currLoc() );
+                t.cllStart();
+                setClient( ns.c_str() );
+                
+                migrateFromStatus.start( ns , locs );
+                log() << "movechunk.start: " << locs.size() << " documents to copy" << endl;
+            }
             
             BSONObj res;
             bool ok;
@@ -316,7 +689,8 @@ namespace mongo {
                 ok = conn->runCommand( "admin" , 
                                             BSON( "startCloneCollection" << ns <<
                                                   "from" << from <<
-                                                  "query" << filter 
+                                                  "query" << filter <<
+                                                  "bulk" << bulk
                                                   ) , 
                                             res );
                 conn.done();
@@ -324,6 +698,15 @@ namespace mongo {
             
             log() << "   movechunk.start res: " << res << endl;
             
+            if ( bulk ){
+                // the bulk copy is over either way; from here the recipient catches up from the change log
+                migrateFromStatus.done();
+                if ( ! ok ){
+                    setClient( ns.c_str() );
+                    NamespaceDetailsTransient::get_w( ns.c_str() ).cllInvalidate();
+                }
+            }
+            
             if ( ok ){
                 result.append( res["finishToken"] );
             }
@@ -377,13 +760,8 @@ namespace mongo {
             }
             
             // now we're locked
-            globalVersions[ns] = newVersion;
-            NSVersions * versions = clientShardVersions.get();
-            if ( ! versions ){
-                versions = new NSVersions();
-                clientShardVersions.reset( versions );
-            }
-            (*versions)[ns] = newVersion;
+            GlobalShardVersions::set( ns , newVersion );
+            ShardedConnectionInfo::get( true )->setVersion( ns , newVersion );
             
             BSONObj res;
             bool ok;
@@ -408,6 +786,24 @@ namespace mongo {
             // wait until cursors are clean
             cout << "WARNING: deleting data before ensuring no more cursors TODO" << endl;
             
+            BSONObj min = cmdObj.getObjectField( "min" );
+            BSONObj max = cmdObj.getObjectField( "max" );
+            BSONObj keyPattern = cmdObj.getObjectField( "shardKeyPattern" );
+            if ( ! min.isEmpty() && ! max.isEmpty() && ! keyPattern.isEmpty() ){
+                // the chunk is committed elsewhere, so nobody needs these documents now.
+                // either way they go a batch at a time, so the shard isn't locked up meanwhile
+                if ( cmdObj["waitForDelete"].trueValue() ){
+                    dbtemprelease unlock;
+                    RangeDeleter( ns , keyPattern , min , max ).deleteAll();
+                }
+                else {
+                    RangeDeleter * d = new RangeDeleter( ns , keyPattern , min , max );
+                    d->deleteSelf = true;
+                    d->go();
+                }
+                return true;
+            }
+            
             dbtemprelease unlock;
 
             DBDirectClient client;
@@ -423,60 +819,34 @@ namespace mongo {
         if ( shardConfigServer.empty() )
             return false;
         
-
-        unsigned long long version = globalVersions[ns];
-        if ( version == 0 )
-            return false;
-        
-        NSVersions * versions = clientShardVersions.get();
-        if ( ! versions )
+        if ( GlobalShardVersions::get( ns.c_str() ) == 0 )
             return false;
         
-        return true;
+        return ShardedConnectionInfo::get( false ) != 0;
+    }
+
+    bool shardVersionOk( const string& ns , string& errmsg ){
+        return shardVersionOk( ns.c_str() , errmsg );
     }
 
     /**
      * @ return true if not in sharded mode
                      or if version for this client is ok
      */
-    bool shardVersionOk( const string& ns , string& errmsg ){
+    bool shardVersionOk( const char * ns , string& errmsg ){
         if ( shardConfigServer.empty() ){
             return true;
         }
 
-        NSVersions::iterator i = globalVersions.find( ns );
-        if ( i == globalVersions.end() )
-            return true;
-        
-        NSVersions * versions = clientShardVersions.get();
-        if ( ! versions ){
+        ShardedConnectionInfo * info = ShardedConnectionInfo::get( false );
+        if ( ! info ){
             // this means the client has nothing sharded
             // so this allows direct connections to do whatever they want
             // which i think is the correct behavior
             return true;
         }
 
-        unsigned long long clientVersion = (*versions)[ns];
-        unsigned long long version = i->second;
-                
-        if ( version == 0 && clientVersion > 0 ){
-            stringstream ss;
-            ss << "version: " << version << " clientVersion: " << clientVersion;
-            errmsg = ss.str();
-            return false;
-        }
-        
-        if ( clientVersion >= version )
-            return true;
-        
-
-        if ( clientVersion == 0 ){
-            errmsg = "client in sharded mode, but doesn't have version set for this collection";
-            return false;
-        }
-
-        errmsg = (string)"your version is too old  ns: " + ns;
-        return false;
+        return info->versionOk( ns , errmsg );
     }
 
 
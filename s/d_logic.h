@@ -6,6 +6,45 @@
 
 namespace mongo {
 
+    struct DbResponse;
+    struct GlobalShardVersion;
+    struct ShardVersionRec;
+
+    /**
+     * the shard versions one connection has set, kept in its Client.
+     * looked at on every message, so it's a short vector searched with strcmp rather than a map,
+     * and once a namespace has been seen nothing is allocated to check it again.
+     */
+    class ShardedConnectionInfo : boost::noncopyable {
+    public:
+        /**
+         * @return the current connection's info, 0 if it isn't in sharded mode and create is false
+         */
+        static ShardedConnectionInfo * get( bool create );
+
+        unsigned long long getVersion( const char * ns );
+        void setVersion( const string& ns , unsigned long long version );
+
+        /**
+         * @return true if this connection's version of ns is current
+         */
+        bool versionOk( const char * ns , string& errmsg );
+
+    private:
+        struct Entry {
+            Entry( const string& n ) : ns( n ) , version( 0 ) , global( 0 ) , okAt( 0 ){}
+            string ns;
+            unsigned long long version;
+            GlobalShardVersion * global;
+            // the global version this was last found ok against.  global versions are immutable
+            // and never freed, so while global still points here it's still ok
+            const ShardVersionRec * okAt;
+        };
+        Entry * find( const char * ns );
+        Entry& findOrAdd( const string& ns );
+        vector<Entry> _entries;
+    };
+
     /**
      * @return true if we have any shard info for the ns
      */
@@ -15,9 +54,20 @@ namespace mongo {
      * @return true if the current threads shard version is ok, or not in sharded version
      */
     bool shardVersionOk( const string& ns , string& errmsg );
+    bool shardVersionOk( const char * ns , string& errmsg );
 
     /**
      * @return true if we took care of the message and nothing else should be done
      */
     bool handlePossibleShardedMessage( Message &m, DbResponse &dbresponse );
+
+    /**
+     * call before a record is deleted, so a chunk migration in progress doesn't read it
+     */
+    void aboutToDeleteForSharding( const char * ns , const DiskLoc& dl );
+
+    /**
+     * @return true if a migrated away range of ns is still being deleted here
+     */
+    bool rangeDeletePending( const string& ns );
 }
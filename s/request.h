@@ -3,6 +3,7 @@
 #pragma once
 
 #include "../stdafx.h"
+#include <boost/thread/tss.hpp>
 #include "../util/message.h"
 #include "../db/dbmessage.h"
 #include "config.h"
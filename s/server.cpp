@@ -21,11 +21,14 @@
 #include "../util/unittest.h"
 #include "../client/connpool.h"
 #include "../util/message_server.h"
+#include "../scripting/engine.h"
 
 #include "server.h"
 #include "request.h"
 #include "config.h"
 #include "chunk.h"
+#include "balance.h"
+#include "cursors.h"
 
 namespace mongo {
     
@@ -70,6 +73,17 @@ namespace mongo {
     public:
         virtual ~ShardedMessageHandler(){}
         virtual void process( Message& m , AbstractMessagingPort* p ){
+            if ( m.data->operation() == dbKillCursors ){
+                // no namespace, so no Request
+                try {
+                    cursorCache.gotKillCursors( m );
+                }
+                catch ( DBException& e ){
+                    log() << "killCursors failed: " << e.what() << endl;
+                }
+                return;
+            }
+
             Request r( m , p );
             if ( logLevel > 5 ){
                 log(5) << "client id: " << hex << r.getClientId() << "\t" << r.getns() << "\t" << dec << r.op() << endl;
@@ -92,6 +106,7 @@ namespace mongo {
     void init(){
         serverID.init();
         setupSIGTRAPforGDB();
+        ScriptEngine::setup(); // for merging sharded group results
     }
 
     void start() {
@@ -100,6 +115,9 @@ namespace mongo {
         //l.listen();
         ShardedMessageHandler handler;
         MessageServer * server = createServer( cmdLine.port , &handler );
+        balancer.go();
+        startCursorReaper();
+        startChangeLogListener();
         server->run();
     }
 
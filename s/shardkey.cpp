@@ -19,6 +19,7 @@
 #include "stdafx.h"
 #include "chunk.h"
 #include "../db/jsobj.h"
+#include "../db/queryutil.h"
 #include "../util/unittest.h"
 
 /**
@@ -49,8 +50,9 @@ namespace mongo {
         }
     }
 
-    ShardKeyPattern::ShardKeyPattern( BSONObj p ) : pattern( p.getOwned() ) {
+    ShardKeyPattern::ShardKeyPattern( BSONObj p ) : pattern( p.getOwned() ) , _hashed( isHashedKeyPattern( pattern ) ) {
         pattern.getFieldNames(patternfields);
+        uassert( "a hashed shard key can only have one field" , ! _hashed || patternfields.size() == 1 );
 
         BSONObjBuilder min;
         minForPat(min, pattern);
@@ -81,75 +83,57 @@ namespace mongo {
         return true;
     }
 
-    /** @return true if shard s is relevant for query q.
-
-    Example:
-     q:     { x : 3 }
-     *this: { x : 1 }
-     s:     x:2..x:7
-       -> true
-    */
-
-    bool ShardKeyPattern::relevant(const BSONObj& query, const BSONObj& L, const BSONObj& R) { 
-        BSONObj q = extractKey( query );
-        if( q.isEmpty() )
-            return true;
-
-        BSONElement e = q.firstElement();
-        assert( !e.eoo() ) ;
-
-        if( e.type() == RegEx ) {
-            /* todo: if starts with ^, we could be smarter here */
-            return true;
-        }
-
-        if( e.type() == Object ) { 
-            BSONObjIterator j(e.embeddedObject());
-            BSONElement LE = L.firstElement(); // todo compound keys
-            BSONElement RE = R.firstElement(); // todo compound keys
-            while( 1 ) { 
-                BSONElement f = j.next();
-                if( f.eoo() ) 
-                    break;
-                int op = f.getGtLtOp();
-                switch( op ) { 
-                    case BSONObj::LT:
-                        if( f.woCompare(LE, false) <= 0 )
-                            return false;
-                        break;
-                    case BSONObj::LTE:
-                        if( f.woCompare(LE, false) < 0 )
-                            return false;
-                        break;
-                    case BSONObj::GT:
-                    case BSONObj::GTE:
-                        if( f.woCompare(RE, false) >= 0 )
-                            return false;
-                        break;
-                    case BSONObj::opIN:
-                    case BSONObj::NE:
-                    case BSONObj::opSIZE:
-                        massert("not implemented yet relevant()", false);
-                    case BSONObj::Equality:
-                        goto normal;
-                    default:
-                        massert("bad operator in relevant()?", false);
+    BoundList ShardKeyPattern::keyBounds( const BSONObj& query ) const {
+        FieldRangeSet frs( "" , query );
+        BoundList ret;
+        if ( ! frs.matchPossible() )
+            return ret;
+
+        if ( _hashed ){
+            // only exact values can be hashed to find their chunks, anything else could be anywhere
+            const vector<FieldInterval>& intervals = frs.range( patternfields.begin()->c_str() ).intervals();
+            for ( vector<FieldInterval>::const_iterator i=intervals.begin(); i!=intervals.end(); i++ ){
+                if ( i->lower_.bound_.woCompare( i->upper_.bound_ , false ) != 0 ){
+                    ret.clear();
+                    ret.push_back( make_pair( minKey , maxKey ) );
+                    return ret;
                 }
+                BSONObj h = BSON( "" << i->lower_.bound_.hash64() );
+                ret.push_back( make_pair( h , h ) );
             }
-            return true;
+            return ret;
         }
-normal:
-        return L.woCompare(q) <= 0 && R.woCompare(q) > 0;
+
+        // chunk bounds are ordered field by field ascending, whatever the pattern's directions
+        BSONObjBuilder ascending;
+        BSONObjIterator i( pattern );
+        while ( i.more() )
+            ascending.append( i.next().fieldName() , 1 );
+        return frs.indexBounds( ascending.obj() , 1 );
     }
 
-    bool ShardKeyPattern::relevantForQuery( const BSONObj& query , Chunk * chunk ){
-        massert("not done for compound patterns", patternfields.size() == 1);
+    bool ShardKeyPattern::relevant( const BoundList& bounds , const BSONObj& min , const BSONObj& max ) const {
+        for ( BoundList::const_iterator i=bounds.begin(); i!=bounds.end(); i++ ){
+            if ( i->first.woCompare( max , BSONObj() , false ) < 0 &&
+                 i->second.woCompare( min , BSONObj() , false ) >= 0 )
+                return true;
+        }
+        return false;
+    }
 
-        bool rel = relevant(query, chunk->getMin(), chunk->getMax());
-        if( ! hasShardKey( query ) )
-            assert(rel);
+    bool ShardKeyPattern::isExactKey( const BSONObj& query ) const {
+        BSONObj k = extractKey( query );
+        if ( k.isEmpty() )
+            return false;
+        BoundList bounds = keyBounds( query );
+        return 
+            bounds.size() == 1 &&
+            k.woCompare( bounds[0].first , BSONObj() , false ) == 0 &&
+            k.woCompare( bounds[0].second , BSONObj() , false ) == 0;
+    }
 
-        return rel;
+    bool ShardKeyPattern::relevantForQuery( const BSONObj& query , Chunk * chunk ){
+        return relevant( keyBounds( query ) , chunk->getMin() , chunk->getMax() );
     }
 
     /**
@@ -158,6 +142,17 @@ normal:
     */
     void ShardKeyPattern::getFilter( BSONObjBuilder& b , const BSONObj& min, const BSONObj& max ){
         massert("not done for compound patterns", patternfields.size() == 1);
+        if ( _hashed ){
+            // min and max are hashes already, mongod hashes each object's value to compare
+            const char * field = patternfields.begin()->c_str();
+            BSONObjBuilder temp( b.subobjStart( field ) );
+            BSONObjBuilder range( temp.subarrayStart( "$hashed" ) );
+            range.appendAs( min[field] , "0" );
+            range.appendAs( max[field] , "1" );
+            range.done();
+            temp.done();
+            return;
+        }
         BSONObjBuilder temp;
         temp.appendAs( extractKey(min).firstElement(), "$gte" );
         temp.appendAs( extractKey(max).firstElement(), "$lt" );
@@ -165,6 +160,32 @@ normal:
         b.append( patternfields.begin()->c_str(), temp.obj() );
     }    
 
+    void ShardKeyPattern::getFilter( BSONObjBuilder& b , const vector< pair<BSONObj,BSONObj> >& ranges ){
+        massert("not done for compound patterns", patternfields.size() == 1);
+        massert("no ranges", ranges.size());
+        if ( ranges.size() == 1 ){
+            getFilter( b , ranges[0].first , ranges[0].second );
+            return;
+        }
+
+        const char * field = patternfields.begin()->c_str();
+        BSONObjBuilder temp( b.subobjStart( field ) );
+        if ( ! _hashed ){
+            // the outer bounds are there so mongod can use the shard key index
+            temp.appendAs( extractKey( ranges.front().first ).firstElement() , "$gte" );
+            temp.appendAs( extractKey( ranges.back().second ).firstElement() , "$lt" );
+        }
+        BSONObjBuilder list( temp.subarrayStart( _hashed ? "$hashed" : "$ranges" ) );
+        for ( unsigned i=0; i<ranges.size(); i++ ){
+            BSONObjBuilder r( list.subarrayStart( list.numStr( i ).c_str() ) );
+            r.appendAs( ranges[i].first[field] , "0" );
+            r.appendAs( ranges[i].second[field] , "1" );
+            r.done();
+        }
+        list.done();
+        temp.done();
+    }
+
     /**
       Example
       sort:   { ts: -1 }
@@ -182,6 +203,9 @@ normal:
         //   pattern { a : -1, b : 1, c : 1 }
         //     -> -1
 
+        if ( _hashed )
+            return 0; // hash order says nothing about value order
+
         int dir = 0;
 
         BSONObjIterator s(sort);
@@ -223,7 +247,7 @@ normal:
     /* things to test for compound : 
        x hasshardkey 
        _ getFilter (hard?)
-       _ relevantForQuery
+       x relevantForQuery
        x canOrder
        \ middle (deprecating?)
     */
@@ -256,6 +280,27 @@ normal:
             assert( k.relevantForQuery(fromjson("{foo:9,key:{$gt:10}}"), &c) );
             assert( !k.relevantForQuery(fromjson("{foo:9,key:{$gt:22}}"), &c) );
             assert( k.relevantForQuery(fromjson("{foo:9}"), &c) );
+            assert( k.relevantForQuery(fromjson("{key:{$in:[1,5,40]}}"), &c) );
+            assert( !k.relevantForQuery(fromjson("{key:{$in:[1,40]}}"), &c) );
+            assert( !k.relevantForQuery(fromjson("{key:{$gt:5,$lt:3}}"), &c) );
+
+            assert( k.isExactKey(fromjson("{foo:9,key:4}")) );
+            assert( !k.isExactKey(fromjson("{key:{$in:[4]}}")) );
+            assert( !k.isExactKey(fromjson("{key:{$gte:4,$lte:4}}")) );
+            assert( !k.isExactKey(fromjson("{foo:9}")) );
+        }
+        void rfqcompound() {
+            ShardKeyPattern k( fromjson("{a:1,b:1}") );
+            Chunk c(0);
+            c.unserialize( fromjson("{ ns : \"test.foo\" , min : {a:2,b:5} , max : {a:2,b:10} , server : \"localhost:30001\" }") );
+            assert( k.relevantForQuery( fromjson("{a:2,b:7}") , &c ) );
+            assert( k.relevantForQuery( fromjson("{a:2}") , &c ) );
+            assert( !k.relevantForQuery( fromjson("{a:3}") , &c ) );
+            assert( !k.relevantForQuery( fromjson("{a:2,b:{$in:[1,12]}}") , &c ) );
+            assert( k.relevantForQuery( fromjson("{a:{$in:[1,2]},b:6}") , &c ) );
+            assert( !k.relevantForQuery( fromjson("{a:{$in:[1,3]},b:6}") , &c ) );
+            assert( k.isExactKey( fromjson("{b:6,a:2}") ) );
+            assert( !k.isExactKey( fromjson("{a:2}") ) );
         }
         void getfilt() { 
             ShardKeyPattern k( BSON( "key" << 1 ) );
@@ -263,6 +308,14 @@ normal:
             k.getFilter(b, fromjson("{z:3,key:30}"), fromjson("{key:90}"));
             BSONObj x = fromjson("{ key: { $gte: 30, $lt: 90 } }");
             assert( x.woEqual(b.obj()) );
+
+            vector< pair<BSONObj,BSONObj> > ranges;
+            ranges.push_back( make_pair( fromjson("{key:30}") , fromjson("{key:40}") ) );
+            ranges.push_back( make_pair( fromjson("{key:60}") , fromjson("{key:90}") ) );
+            BSONObjBuilder c;
+            k.getFilter( c , ranges );
+            x = fromjson("{ key: { $gte: 30, $lt: 90, $ranges: [ [ 30, 40 ], [ 60, 90 ] ] } }");
+            assert( x.woEqual(c.obj()) );
         }
         void testCanOrder() { 
             ShardKeyPattern k( fromjson("{a:1,b:-1,c:1}") );
@@ -279,8 +332,45 @@ normal:
             assert( k.extractKey( fromjson("{a:1,b:2,c:3}") ).woEqual(x) );
             assert( k.extractKey( fromjson("{b:2,c:3,a:1}") ).woEqual(x) );
         }
+        void hashedtest() {
+            ShardKeyPattern k( fromjson("{key:\"hashed\"}") );
+            assert( k.isHashed() );
+            assert( k.canOrder( fromjson("{key:1}") ) == 0 );
+
+            // equal values of any numeric type end up in the same place
+            BSONObj h = k.extractKey( fromjson("{foo:1,key:5}") );
+            assert( h.firstElement().type() == NumberLong );
+            assert( h.woEqual( k.extractKey( fromjson("{key:5.0}") ) ) );
+            assert( h.woEqual( k.extractKey( BSON( "key" << 5LL ) ) ) );
+            assert( ! h.woEqual( k.extractKey( fromjson("{key:6}") ) ) );
+            assert( ! h.woEqual( k.extractKey( fromjson("{key:\"5\"}") ) ) );
+            assert( k.extractKey( fromjson("{foo:5}") ).isEmpty() );
+
+            BSONObjBuilder b;
+            k.getFilter( b , k.globalMin() , h );
+            BSONObj filter = b.obj();
+            BSONObj f = filter.getObjectField( "key" ).getObjectField( "$hashed" );
+            assert( f["0"].type() == MinKey );
+            assert( f["1"].numberLong() == h.firstElement().numberLong() );
+
+            Chunk c(0);
+            BSONObjBuilder z;
+            z.append( "ns" , "alleyinsider.fs.chunks" );
+            z.append( "min" , k.globalMin() );
+            z.append( "max" , h );
+            z.append( "server" , "localhost:30001" );
+            c.unserialize( z.obj() );
+            assert( ! k.relevantForQuery( fromjson("{key:5}") , &c ) );
+            assert( k.relevantForQuery( fromjson("{key:6}") , &c ) == ( k.extractKey( fromjson("{key:6}") ).woCompare( h ) < 0 ) );
+            assert( k.relevantForQuery( fromjson("{key:{$gt:5}}") , &c ) );
+            assert( k.relevantForQuery( fromjson("{foo:5}") , &c ) );
+            assert( ! k.relevantForQuery( fromjson("{key:{$in:[5]}}") , &c ) );
+            assert( k.relevantForQuery( fromjson("{key:{$in:[5,6]}}") , &c ) == k.relevantForQuery( fromjson("{key:6}") , &c ) );
+            assert( k.isExactKey( fromjson("{key:5}") ) );
+        }
         void run(){
             extractkeytest();
+            hashedtest();
 
             ShardKeyPattern k( BSON( "key" << 1 ) );
             
@@ -313,6 +403,7 @@ normal:
             testCanOrder();
             getfilt();
             rfq();
+            rfqcompound();
             // add middle multitype tests
         }
     } shardKeyTest;
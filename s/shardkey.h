@@ -26,6 +26,10 @@ namespace mongo {
 
     /* A ShardKeyPattern is a pattern indicating what data to extract from the object to make the shard key from.
        Analogous to an index key pattern.
+
+       { field : "hashed" } shards on the hash64() of the field instead of its value, so that
+       ascending values (timestamps, ObjectIds) are spread over all the chunks.  the shard key
+       of an object is then { field : NumberLong(hash) }, and chunk bounds are hashes.
     */
     class ShardKeyPattern {
     public:
@@ -54,6 +58,8 @@ namespace mongo {
             return isGlobalMin( k ) || isGlobalMax( k );
         }
 
+        bool isHashed() const { return _hashed; }
+
         /** compare shard keys from the objects specified
            l < r negative
            l == r 0
@@ -71,8 +77,18 @@ namespace mongo {
         /**
            returns a query that filters results only for the range desired, i.e. returns 
              { "field" : { $gte: keyval(min), $lt: keyval(max) } }
+           or for a hashed key
+             { "field" : { $hashed : [ keyval(min), keyval(max) ] } }
         */
         void getFilter( BSONObjBuilder& b , const BSONObj& min, const BSONObj& max );
+
+        /**
+           the same for several ranges, in order and not overlapping, in one filter:
+             { "field" : { $gte : keyval(first min) , $lt : keyval(last max) , $ranges : [ [ min , max ] , ... ] } }
+           or for a hashed key
+             { "field" : { $hashed : [ [ min , max ] , ... ] } }
+        */
+        void getFilter( BSONObjBuilder& b , const vector< pair<BSONObj,BSONObj> >& ranges );
         
         /** @return true if shard s is relevant for query q.
 
@@ -83,6 +99,23 @@ namespace mongo {
                -> true
          */
         bool relevantForQuery( const BSONObj& q , Chunk * s );
+
+        /**
+           @return the ranges of shard key values that objects matching query can have, worked
+           out by a FieldRangeSet, so $in lists and compound prefixes narrow things down too.
+           each range is inclusive at both ends and its fields are unnamed.
+           an empty list means nothing can match.
+         */
+        BoundList keyBounds( const BSONObj& query ) const;
+
+        /**
+           @return true if query pins every field of the shard key to one value,
+           e.g. { num : 5 } but not { num : { $gte : 5 , $lte : 5 } } or { num : { $in : [ 5 ] } }
+         */
+        bool isExactKey( const BSONObj& query ) const;
+
+        /** @return true if any of bounds overlaps the chunk [min,max) */
+        bool relevant( const BoundList& bounds , const BSONObj& min , const BSONObj& max ) const;
         
         /**
            Returns if the given sort pattern can be ordered by the shard key pattern.
@@ -113,15 +146,24 @@ namespace mongo {
         }
     private:
         BSONObj pattern;
+        bool _hashed;
         BSONObj gMin;
         BSONObj gMax;
 
         /* question: better to have patternfields precomputed or not?  depends on if we use copy contructor often. */
         set<string> patternfields;
-        bool relevant(const BSONObj& query, const BSONObj& L, const BSONObj& R);
     };
 
     inline BSONObj ShardKeyPattern::extractKey(const BSONObj& from) const { 
+        if ( _hashed ){
+            const char * field = pattern.firstElement().fieldName();
+            BSONElement e = from.getFieldDotted( field );
+            if ( e.eoo() )
+                return BSONObj();
+            BSONObjBuilder b;
+            b.append( field , e.hash64() );
+            return b.obj();
+        }
         return from.extractFields(pattern);
     }
 
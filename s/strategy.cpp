@@ -61,7 +61,59 @@ namespace mongo {
         dbcon.done();
     }
 
+    static void sendInserts( DBClientBase * conn , const char * ns , const vector<BSONObj> * objs , string * err ){
+        try {
+            conn->insert( ns , *objs );
+        }
+        catch ( std::exception& e ){
+            *err = e.what();
+        }
+    }
+
+    void Strategy::insert( const char * ns , const map< string , vector<BSONObj> >& byServer ){
+        typedef map< string , vector<BSONObj> >::const_iterator I;
+        
+        /* connections are handed out and versions checked here, on the request's own thread, so
+           they're recorded against this client for getlasterror.  only the sends go in parallel.
+        */
+        vector< shared_ptr<ScopedDbConnection> > conns;
+        long long bytes = 0;
+        for ( I i = byServer.begin(); i != byServer.end(); i++ ){
+            shared_ptr<ScopedDbConnection> c( new ScopedDbConnection( i->first ) );
+            checkShardVersion( c->conn() , ns );
+            conns.push_back( c );
+            for ( unsigned j=0; j<i->second.size(); j++ )
+                bytes += i->second[j].objsize();
+        }
+
+        // a thread per shard costs more than it saves for small batches
+        if ( conns.size() == 1 || bytes < 256 * 1024 ){
+            int n = 0;
+            for ( I i = byServer.begin(); i != byServer.end(); i++ , n++ )
+                conns[n]->conn().insert( ns , i->second );
+        }
+        else {
+            vector<string> errors( conns.size() );
+            boost::thread_group threads;
+            int n = 0;
+            for ( I i = byServer.begin(); i != byServer.end(); i++ , n++ )
+                threads.create_thread( boost::bind( sendInserts , &conns[n]->conn() , ns , &i->second , &errors[n] ) );
+            threads.join_all();
+
+            n = 0;
+            for ( I i = byServer.begin(); i != byServer.end(); i++ , n++ ){
+                if ( ! errors[n].empty() )
+                    throw UserException( (string)"insert to " + i->first + " failed: " + errors[n] );
+            }
+        }
+
+        for ( unsigned n=0; n<conns.size(); n++ )
+            conns[n]->done();
+    }
+
+    // clustered cursors check versions from their prefetch threads, so these are locked
     map<DBClientBase*,unsigned long long> checkShardVersionLastSequence;
+    boost::mutex checkShardVersionMutex;
 
     class WriteBackListener : public BackgroundJob {
     protected:
@@ -128,9 +180,11 @@ namespace mongo {
     private:
         string _addr;
         static map<string,WriteBackListener*> _cache;
+        static boost::mutex _cacheLock;
 
     public:
         static void init( DBClientBase& conn ){
+            boostlock lk( _cacheLock );
             WriteBackListener*& l = _cache[conn.getServerAddress()];
             if ( l )
                 return;
@@ -141,6 +195,7 @@ namespace mongo {
     };
 
     map<string,WriteBackListener*> WriteBackListener::_cache;
+    boost::mutex WriteBackListener::_cacheLock;
     
 
     void checkShardVersion( DBClientBase& conn , const string& ns , bool authoritative ){
@@ -161,8 +216,14 @@ namespace mongo {
             version = manager->getVersion( conn.getServerAddress() );
         }
 
-        unsigned long long & sequenceNumber = checkShardVersionLastSequence[ &conn ];        
-        if ( officialSequenceNumber == sequenceNumber )
+        // a reload that found nothing new keeps the sequence number, so authoritative
+        // requests have to go through regardless
+        unsigned long long sequenceNumber;
+        {
+            boostlock lk( checkShardVersionMutex );
+            sequenceNumber = checkShardVersionLastSequence[ &conn ];
+        }
+        if ( officialSequenceNumber == sequenceNumber && ! authoritative )
             return;
         
         log(2) << " have to set shard version for conn: " << &conn << " ns:" << ns << " my last seq: " << sequenceNumber << "  current: " << officialSequenceNumber << endl;
@@ -171,7 +232,8 @@ namespace mongo {
         if ( setShardVersion( conn , ns , version , authoritative , result ) ){
             // success!
             log(1) << "      setShardVersion success!" << endl;
-            sequenceNumber = officialSequenceNumber;
+            boostlock lk( checkShardVersionMutex );
+            checkShardVersionLastSequence[ &conn ] = officialSequenceNumber;
             return;
         }
 
@@ -21,6 +21,9 @@ namespace mongo {
         void doQuery( Request& r , string server );
         
         void insert( string server , const char * ns , const BSONObj& obj );
+
+        /* one multi-document insert to each server, sent to them concurrently when there's enough to make it worthwhile */
+        void insert( const char * ns , const map< string , vector<BSONObj> >& byServer );
         
     };
 
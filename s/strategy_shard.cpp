@@ -64,7 +64,7 @@ namespace mongo {
             
             ShardedClientCursor * cc = new ShardedClientCursor( q , cursor );
             if ( ! cc->sendNextBatch( r ) ){
-                delete( cursor );
+                delete( cc );
                 return;
             }
             log(6) << "storing cursor : " << cc->getId() << endl;
@@ -77,6 +77,7 @@ namespace mongo {
 
             log(6) << "want cursor : " << id << endl;
 
+            // checked out of the cache while we use it
             ShardedClientCursor * cursor = cursorCache.get( id );
             if ( ! cursor ){
                 log(6) << "\t invalid cursor :(" << endl;
@@ -84,17 +85,28 @@ namespace mongo {
                 return;
             }
             
-            if ( cursor->sendNextBatch( r , ntoreturn ) ){
-                log(6) << "\t cursor finished: " << id << endl;
+            bool more;
+            try {
+                more = cursor->sendNextBatch( r , ntoreturn );
+            }
+            catch ( ... ){
+                delete( cursor );
+                throw;
+            }
+
+            if ( more ){
+                cursorCache.store( cursor );
                 return;
             }
             
+            log(6) << "\t cursor finished: " << id << endl;
             delete( cursor );
-            cursorCache.remove( id );
         }
         
         void _insert( Request& r , DbMessage& d, ChunkManager* manager ){
-            
+            map< string , vector<BSONObj> > byShard;
+            map< Chunk* , long > written;
+
             while ( d.moreJSObjs() ){
                 BSONObj o = d.nextJsObj();
                 if ( ! manager->hasShardKey( o ) ){
@@ -118,10 +130,15 @@ namespace mongo {
                 
                 Chunk& c = manager->findChunk( o );
                 log(4) << "  server:" << c.getShard() << " " << o << endl;
-                insert( c.getShard() , r.getns() , o );
-                
-                c.splitIfShould( o.objsize() );
-            }            
+                byShard[ c.getShard() ].push_back( o );
+                written[ &c ] += o.objsize();
+            }
+
+            insert( r.getns() , byShard );
+
+            // once per chunk for the whole message rather than once per document
+            for ( map< Chunk* , long >::iterator i = written.begin(); i != written.end(); i++ )
+                i->first->splitIfShould( i->second );
         }
 
         void _update( Request& r , DbMessage& d, ChunkManager* manager ){
@@ -143,15 +160,26 @@ namespace mongo {
                 throw UserException( "can't upsert something without shard key" );
 
             bool save = false;
-            if ( ! manager->hasShardKey( query ) ){
+            string target;
+            if ( ! manager->getShardKey().isExactKey( query ) ){
                 if ( multi ){
                 }
-                else if ( query.nFields() != 1 || strcmp( query.firstElement().fieldName() , "_id" ) ){
-                    throw UserException( "can't do update with query that doesn't have the shard key" );
-                }
                 else {
-                    save = true;
-                    chunkFinder = toupdate;
+                    // no exact key, but if everything the query could match lives on one shard, send it there.
+                    // not for upserts though, what they insert has to go where its own key says
+                    set<string> shards;
+                    if ( ! upsert )
+                        manager->getShardsForQuery( shards , query );
+                    if ( shards.size() == 1 ){
+                        target = *shards.begin();
+                    }
+                    else if ( query.nFields() != 1 || strcmp( query.firstElement().fieldName() , "_id" ) ){
+                        throw UserException( "can't do update with query that doesn't have the shard key" );
+                    }
+                    else {
+                        save = true;
+                        chunkFinder = toupdate;
+                    }
                 }
             }
 
@@ -160,22 +188,23 @@ namespace mongo {
                 if ( toupdate.firstElement().fieldName()[0] == '$' ){
                     // TODO: check for $set, etc.. on shard key
                 }
+                else if ( target.size() ){
+                    if ( manager->hasShardKey( toupdate ) && manager->findChunk( toupdate ).getShard() != target )
+                        throw UserException( "change would move shards!" );
+                }
                 else if ( manager->hasShardKey( toupdate ) && manager->getShardKey().compare( query , toupdate ) ){
                     throw UserException( "change would move shards!" );
                 }
             }
             
             if ( multi ){
-                vector<Chunk*> chunks;
-                manager->getChunksForQuery( chunks , chunkFinder );
-                set<string> seen;
-                for ( vector<Chunk*>::iterator i=chunks.begin(); i!=chunks.end(); i++){
-                    Chunk * c = *i;
-                    if ( seen.count( c->getShard() ) )
-                        continue;
-                    doWrite( dbUpdate , r , c->getShard() );
-                    seen.insert( c->getShard() );
-                }
+                set<string> shards;
+                manager->getShardsForQuery( shards , chunkFinder );
+                for ( set<string>::iterator i=shards.begin(); i!=shards.end(); i++ )
+                    doWrite( dbUpdate , r , *i );
+            }
+            else if ( target.size() ){
+                doWrite( dbUpdate , r , target );
             }
             else {
                 Chunk& c = manager->findChunk( chunkFinder );
@@ -193,25 +222,19 @@ namespace mongo {
             uassert( "bad delete message" , d.moreJSObjs() );
             BSONObj pattern = d.nextJsObj();
 
-            vector<Chunk*> chunks;
-            manager->getChunksForQuery( chunks , pattern );
-            cout << "delete : " << pattern << " \t " << chunks.size() << " justOne: " << justOne << endl;
-            if ( chunks.size() == 1 ){
-                doWrite( dbDelete , r , chunks[0]->getShard() );
+            set<string> shards;
+            manager->getShardsForQuery( shards , pattern );
+            log(3) << "delete : " << pattern << " \t " << shards.size() << " justOne: " << justOne << endl;
+            if ( shards.size() == 1 ){
+                doWrite( dbDelete , r , *shards.begin() );
                 return;
             }
             
             if ( justOne && ! pattern.hasField( "_id" ) )
                 throw UserException( "can only delete with a non-shard key pattern if can delete as many as we find" );
             
-            set<string> seen;
-            for ( vector<Chunk*>::iterator i=chunks.begin(); i!=chunks.end(); i++){
-                Chunk * c = *i;
-                if ( seen.count( c->getShard() ) )
-                    continue;
-                seen.insert( c->getShard() );
-                doWrite( dbDelete , r , c->getShard() );
-            }
+            for ( set<string>::iterator i=shards.begin(); i!=shards.end(); i++ )
+                doWrite( dbDelete , r , *i );
         }
         
         virtual void writeOp( int op , Request& r ){
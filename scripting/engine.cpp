@@ -16,6 +16,7 @@
  */
 
 #include "stdafx.h"
+#include <boost/thread/tss.hpp>
 #include "engine.h"
 #include "../util/file.h"
 #include "../client/dbclient.h"
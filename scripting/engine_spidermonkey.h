@@ -18,6 +18,7 @@
 #pragma once
 
 #include "engine.h"
+#include <boost/thread/tss.hpp>
 
 // START inc hacking
 
@@ -49,6 +49,8 @@ namespace mongo {
         return Boolean::New( false );
     }
     
+    Local<v8::Object> mongoToLZV8( const BSONObj& m , bool readOnly );
+
     Local< v8::Value > newFunction( const char *code ) {
         stringstream codeSS;
         codeSS << "____MontoToV8_newFunction_temp = " << code;
@@ -80,18 +82,19 @@ namespace mongo {
             }
         }
 
+        // plain objects are wrapped and converted lazily, field by field, as the script
+        // reads them.  arrays are still converted up front, see below.
+        if ( ! array )
+            return mongoToLZV8( m , readOnly );
+
         Local< v8::ObjectTemplate > readOnlyObjects;
         // Hoping template construction is fast...
         Local< v8::ObjectTemplate > internalFieldObjects = v8::ObjectTemplate::New();
         internalFieldObjects->SetInternalFieldCount( 1 );
 
-        Local<v8::Object> o;
-        if ( array ) {
-            // NOTE Looks like it's impossible to add interceptors to non array objects in v8.
-            o = v8::Array::New();
-        } else if ( !readOnly ) {
-            o = v8::Object::New();
-        } else {
+        // NOTE Looks like it's impossible to add interceptors to non array objects in v8.
+        Local<v8::Object> o = v8::Array::New();
+        if ( readOnly ) {
             // NOTE Our readOnly implemention relies on undocumented ObjectTemplate
             // functionality that may be fragile, but it still seems like the best option
             // for now -- fwiw, the v8 docs are pretty sparse.  I've determined experimentally
@@ -112,7 +115,6 @@ namespace mongo {
             readOnlyObjects->SetInternalFieldCount( 1 );
             readOnlyObjects->SetNamedPropertyHandler( 0 );
             readOnlyObjects->SetIndexedPropertyHandler( 0 );
-            o = readOnlyObjects->NewInstance();
         }
         
         mongo::BSONObj sub;
@@ -242,7 +244,7 @@ namespace mongo {
         
         }
 
-        if ( !array && readOnly ) {
+        if ( readOnly ) {
             readOnlyObjects->SetNamedPropertyHandler( 0, NamedReadOnlySet, 0, NamedReadOnlyDelete );
             readOnlyObjects->SetIndexedPropertyHandler( 0, IndexedReadOnlySet, 0, IndexedReadOnlyDelete );            
         }
@@ -250,7 +252,7 @@ namespace mongo {
         return o;
     }
 
-    Handle<v8::Value> mongoToV8Element( const BSONElement &f ) {
+    Handle<v8::Value> mongoToV8Element( const BSONElement &f , bool readOnly ) {
         Local< v8::ObjectTemplate > internalFieldObjects = v8::ObjectTemplate::New();
         internalFieldObjects->SetInternalFieldCount( 1 );
 
@@ -276,7 +278,7 @@ namespace mongo {
             
         case mongo::Array:
         case mongo::Object:
-            return mongoToV8( f.embeddedObject() , f.type() == mongo::Array );
+            return mongoToV8( f.embeddedObject() , f.type() == mongo::Array , readOnly );
             
         case mongo::Date:
             return v8::Date::New( f.date() );
@@ -474,13 +476,30 @@ namespace mongo {
         cout << "don't know how to convert to mongo field [" << name << "]\t" << value << endl;
     }
 
+    bool isWrapper( v8::Handle<v8::Object> o );
+    bool wrapperUnmodified( v8::Handle<v8::Object> o , BSONObj& out );
+    BSONElement wrapperId( v8::Handle<v8::Object> o );
+
     BSONObj v8ToMongo( v8::Handle<v8::Object> o ){
+        bool wrapper = isWrapper( o );
+        if ( wrapper ){
+            BSONObj untouched;
+            if ( wrapperUnmodified( o , untouched ) )
+                return untouched;
+        }
+
         BSONObjBuilder b;
 
         v8::Handle<v8::String> idName = v8::String::New( "_id" );
         if ( o->HasRealNamedProperty( idName ) ){
             v8ToMongoElement( b , idName , "_id" , o->Get( idName ) );
         }
+        else if ( wrapper ){
+            // the script never read _id, it's still only in the BSON
+            BSONElement id = wrapperId( o );
+            if ( ! id.eoo() )
+                b.append( id );
+        }
     
         Local<v8::Array> names = o->GetPropertyNames();
         for ( unsigned int i=0; i<names->Length(); i++ ){
@@ -503,10 +522,16 @@ namespace mongo {
 
     // --- object wrapper ---
 
+    /* a javascript object backed by a BSONObj.  a field is converted the first time the
+       script reads it; nested objects come back as wrappers themselves, arrays are
+       converted whole.  writes and deletes land on the javascript object (deletes are
+       remembered in _removed) and never touch the BSON, so if the script only reads,
+       v8ToMongo can hand back the original object without walking it.
+    */
     class WrapperHolder {
     public:
         WrapperHolder( const BSONObj * o , bool readOnly , bool iDelete )
-            : _o(o), _readOnly( readOnly ), _iDelete( iDelete ) {
+            : _o(o), _readOnly( readOnly ), _iDelete( iDelete ), _modified( false ), _missingIsNull( true ) {
         }
         
         ~WrapperHolder(){
@@ -516,52 +541,210 @@ namespace mongo {
             _o = 0;
         }
 
-        v8::Handle<v8::Value> get( v8::Local<v8::String> name ){
-            const string& s = toSTLString( name );
+        /* an empty handle means "not ours", and v8 carries on with the real properties
+           and the prototype chain
+        */
+        v8::Handle<v8::Value> get( const string& s ){
+            if ( _removed.count( s ) )
+                return v8::Handle<v8::Value>();
             const BSONElement& e = _o->getField( s );
-            return mongoToV8Element(e);
+            if ( e.eoo() )
+                return v8::Handle<v8::Value>();
+            return mongoToV8Element( e , _readOnly );
         }
 
         const BSONObj * _o;
         bool _readOnly;
         bool _iDelete;
+        bool _modified;
+        bool _missingIsNull; // $where's this has always read missing fields as null
+        set<string> _removed;
+        set<string> _cached; // fields converted to objects and stored on the javascript object
     };
 
     WrapperHolder * createWrapperHolder( const BSONObj * o , bool readOnly , bool iDelete ){
         return new WrapperHolder( o , readOnly , iDelete );
     }
 
-#define WRAPPER_STRING (v8::String::New( "_wrapper" ) )
-
     WrapperHolder * getWrapper( v8::Handle<v8::Object> o ){
-        Handle<v8::Value> t = o->GetRealNamedProperty( WRAPPER_STRING );
+        Local<v8::Value> t = o->GetInternalField( 0 );
         assert( t->IsExternal() );
-        Local<External> c = External::Cast( *t );
-        WrapperHolder * w = (WrapperHolder*)(c->Value());
+        WrapperHolder * w = (WrapperHolder*)(External::Cast( *t )->Value());
         assert( w );
         return w;
     }
 
+    bool isWrapper( v8::Handle<v8::Object> o ){
+        return getObjectWrapperTemplate()->HasInstance( o );
+    }
+
+    BSONElement wrapperId( v8::Handle<v8::Object> o ){
+        WrapperHolder * w = getWrapper( o );
+        if ( w->_removed.count( "_id" ) )
+            return BSONElement();
+        return w->_o->getField( "_id" );
+    }
+
+    /* true if the script left the object as it found it.  reading a nested object
+       stores it on the parent so changes to it stick; those count only if the
+       nested value itself no longer matches the BSON.
+    */
+    bool wrapperUnmodified( v8::Handle<v8::Object> o , BSONObj& out ){
+        WrapperHolder * w = getWrapper( o );
+        if ( w->_modified )
+            return false;
+        // v8ToMongo always puts _id first
+        BSONElement id = w->_o->getField( "_id" );
+        if ( ! id.eoo() && strcmp( w->_o->firstElement().fieldName() , "_id" ) )
+            return false;
+
+        for ( set<string>::iterator i = w->_cached.begin(); i != w->_cached.end(); ++i ){
+            v8::Local<v8::String> name = v8::String::New( i->c_str() );
+            v8::Local<v8::Value> v = o->Get( name );
+            if ( v->IsObject() && isWrapper( v->ToObject() ) ){
+                BSONObj sub;
+                if ( ! wrapperUnmodified( v->ToObject() , sub ) )
+                    return false;
+                continue;
+            }
+            // arrays and the like were converted whole, compare them back
+            BSONObjBuilder b;
+            v8ToMongoElement( b , name , *i , v );
+            BSONObj now = b.obj();
+            if ( now.firstElement().woCompare( w->_o->getField( *i ) ) )
+                return false;
+        }
+
+        out = w->_o->getOwned();
+        return true;
+    }
+
+    void wrapperWeakCallback( v8::Persistent<v8::Value> p , void * w ){
+        delete (WrapperHolder*)w;
+        p.Dispose();
+    }
+
+    void attachWrapper( v8::Handle<v8::Object> o , WrapperHolder * w ){
+        o->SetInternalField( 0 , External::New( w ) );
+        v8::Persistent<v8::Object>::New( o ).MakeWeak( w , wrapperWeakCallback );
+    }
 
     Handle<Value> wrapperCons(const Arguments& args){
         if ( ! ( args.Length() == 1 && args[0]->IsExternal() ) )
             return v8::ThrowException( v8::String::New( "wrapperCons needs 1 External arg" ) );
 
-        args.This()->Set( WRAPPER_STRING , args[0] );
+        attachWrapper( args.This() , (WrapperHolder*)(External::Cast( *args[0] )->Value()) );
         
         return v8::Undefined();
     }
 
+    v8::Handle<v8::Value> wrapperGet( v8::Handle<v8::Object> self , v8::Handle<v8::Value> key , const string& s ){
+        WrapperHolder * w = getWrapper( self );
+        v8::Handle<v8::Value> v = w->get( s );
+        if ( v.IsEmpty() ){
+            if ( w->_missingIsNull )
+                return v8::Null();
+            return v;
+        }
+        if ( v->IsObject() ){
+            // hang on to it so changes the script makes to it stick
+            self->ForceSet( key , v );
+            w->_cached.insert( s );
+        }
+        return v;
+    }
+
     v8::Handle<v8::Value> wrapperGetHandler( v8::Local<v8::String> name, const v8::AccessorInfo &info){
-        return getWrapper( info.This() )->get( name );
+        // already converted, or written by the script
+        if ( info.This()->HasRealNamedProperty( name ) )
+            return v8::Handle<v8::Value>();
+        return wrapperGet( info.This() , name , toSTLString( name ) );
+    }
+
+    v8::Handle<v8::Value> wrapperSetHandler( v8::Local<v8::String> name, v8::Local<v8::Value> value, const v8::AccessorInfo &info){
+        WrapperHolder * w = getWrapper( info.This() );
+        if ( w->_readOnly )
+            return NamedReadOnlySet( name , value , info );
+        w->_removed.erase( toSTLString( name ) );
+        w->_modified = true;
+        return v8::Handle<v8::Value>();
+    }
+
+    v8::Handle<v8::Boolean> wrapperDeleteHandler( v8::Local<v8::String> name, const v8::AccessorInfo &info){
+        WrapperHolder * w = getWrapper( info.This() );
+        if ( w->_readOnly )
+            return NamedReadOnlyDelete( name , info );
+        w->_removed.insert( toSTLString( name ) );
+        w->_modified = true;
+        return v8::Handle<v8::Boolean>();
+    }
+
+    v8::Handle<v8::Array> wrapperEnumerateHandler( const v8::AccessorInfo &info ){
+        WrapperHolder * w = getWrapper( info.This() );
+        v8::Local<v8::Array> names = v8::Array::New();
+        int n = 0;
+        for ( BSONObjIterator i( *w->_o ); i.more(); ){
+            BSONElement e = i.next();
+            if ( w->_removed.count( e.fieldName() ) )
+                continue;
+            names->Set( v8::Integer::New( n++ ) , v8::String::New( e.fieldName() ) );
+        }
+        return names;
+    }
+
+    // v8 sends numeric field names ( { "0" : ... } ) through the indexed handlers
+
+    string indexName( uint32_t index ){
+        stringstream ss;
+        ss << index;
+        return ss.str();
+    }
+
+    v8::Handle<v8::Value> wrapperIndexedGetHandler( uint32_t index, const v8::AccessorInfo &info){
+        if ( info.This()->HasRealIndexedProperty( index ) )
+            return v8::Handle<v8::Value>();
+        return wrapperGet( info.This() , v8::Integer::New( index ) , indexName( index ) );
+    }
+
+    v8::Handle<v8::Value> wrapperIndexedSetHandler( uint32_t index, v8::Local<v8::Value> value, const v8::AccessorInfo &info){
+        WrapperHolder * w = getWrapper( info.This() );
+        if ( w->_readOnly )
+            return IndexedReadOnlySet( index , value , info );
+        w->_removed.erase( indexName( index ) );
+        w->_modified = true;
+        return v8::Handle<v8::Value>();
+    }
+
+    v8::Handle<v8::Boolean> wrapperIndexedDeleteHandler( uint32_t index, const v8::AccessorInfo &info){
+        WrapperHolder * w = getWrapper( info.This() );
+        if ( w->_readOnly )
+            return IndexedReadOnlyDelete( index , info );
+        w->_removed.insert( indexName( index ) );
+        w->_modified = true;
+        return v8::Handle<v8::Boolean>();
     }
 
     v8::Handle<v8::FunctionTemplate> getObjectWrapperTemplate(){
-        v8::Local<v8::FunctionTemplate> t = FunctionTemplate::New( wrapperCons );
-        t->InstanceTemplate()->SetNamedPropertyHandler( wrapperGetHandler );
+        static v8::Persistent<v8::FunctionTemplate> t;
+        if ( t.IsEmpty() ){
+            t = v8::Persistent<v8::FunctionTemplate>::New( FunctionTemplate::New( wrapperCons ) );
+            t->InstanceTemplate()->SetInternalFieldCount( 1 );
+            t->InstanceTemplate()->SetNamedPropertyHandler( wrapperGetHandler , wrapperSetHandler , 0 ,
+                                                            wrapperDeleteHandler , wrapperEnumerateHandler );
+            t->InstanceTemplate()->SetIndexedPropertyHandler( wrapperIndexedGetHandler , wrapperIndexedSetHandler , 0 ,
+                                                              wrapperIndexedDeleteHandler );
+        }
         return t;
     }
 
+    Local<v8::Object> mongoToLZV8( const BSONObj& m , bool readOnly ){
+        Local<v8::Object> o = getObjectWrapperTemplate()->InstanceTemplate()->NewInstance();
+        WrapperHolder * w = createWrapperHolder( new BSONObj( m.getOwned() ) , readOnly , true );
+        w->_missingIsNull = false;
+        attachWrapper( o , w );
+        return o;
+    }
+
     // --- random utils ----
 
     v8::Function * getNamedCons( const char * name ){
@@ -30,7 +30,7 @@ namespace mongo {
 
     void v8ToMongoElement( BSONObjBuilder & b , v8::Handle<v8::String> name , 
                            const string sname , v8::Handle<v8::Value> value );
-    v8::Handle<v8::Value> mongoToV8Element( const BSONElement &f );
+    v8::Handle<v8::Value> mongoToV8Element( const BSONElement &f , bool readOnly = false );
     
     v8::Function * getNamedCons( const char * name );
     v8::Function * getObjectIdCons();
@@ -178,7 +178,7 @@ DBCollection.prototype._genIndexName = function( keys ){
         name += k + "_";
 
         var v = keys[k];
-        if ( typeof v == "number" )
+        if ( typeof v == "number" || typeof v == "string" )
             name += v;
     }
     return name;
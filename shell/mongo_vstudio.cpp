@@ -140,7 +140,7 @@ const char * jsconcatcode =
  "name += \"_\";\n"
  "name += k + \"_\";\n"
  "var v = keys[k];\n"
- "if ( typeof v == \"number\" )\n"
+ "if ( typeof v == \"number\" || typeof v == \"string\" )\n"
  "name += v;\n"
  "}\n"
  "return name;\n"
@@ -1326,12 +1326,16 @@ const char * jsconcatcode =
  "}\n"
  "var admin = this.admin = this.s.getDB( \"admin\" );\n"
  "this.config = this.s.getDB( \"config\" );\n"
+ "this.setBalancer( false );\n"
  "this._serverNames.forEach(\n"
  "function(z){\n"
  "admin.runCommand( { addshard : z } );\n"
  "}\n"
  ");\n"
  "}\n"
+ "ShardingTest.prototype.setBalancer = function( on ){\n"
+ "this.config.settings.update( { _id : \"balancer\" } , { $set : { stopped : ! on } } , true );\n"
+ "}\n"
  "ShardingTest.prototype.getDB = function( name ){\n"
  "return this.s.getDB( name );\n"
  "}\n"
@@ -137,6 +137,9 @@ ShardingTest = function( testName , numServers , verboseLevel , numMongos ){
     var admin = this.admin = this.s.getDB( "admin" );
     this.config = this.s.getDB( "config" );
 
+    // tests move chunks themselves unless they ask for the balancer
+    this.setBalancer( false );
+
     this._serverNames.forEach(
         function(z){
             admin.runCommand( { addshard : z , allowLocal : true } );
@@ -144,6 +147,10 @@ ShardingTest = function( testName , numServers , verboseLevel , numMongos ){
     );
 }
 
+ShardingTest.prototype.setBalancer = function( on ){
+    this.config.settings.update( { _id : "balancer" } , { $set : { stopped : ! on } } , true );
+}
+
 ShardingTest.prototype.getDB = function( name ){
     return this.s.getDB( name );
 }
@@ -16,48 +16,128 @@
  *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/* mongobridge forwards mongo wire traffic from --port to --dest.  requests and replies move
+   on separate threads, so a client that pipelines requests isn't held to one round trip at a
+   time.  every request is timed from when the bridge sends it on to when the reply comes back,
+   and grouped by op, namespace and query shape (see OpStats); the table is served over http on
+   --http, by default --port + 1000.  GET /reset clears it.
+*/
+
 #include "stdafx.h"
 #include "../util/message.h"
+#include "../util/miniwebserver.h"
 #include "../client/dbclient.h"
+#include "opstats.h"
 
 using namespace mongo;
 using namespace std;
 
 int port = 0;
+int httpPort = 0;
 string destUri;
 
-class Forwarder {
+OpStats opStats;
+
+/* one client connection and its connection to the destination */
+class Bridge {
 public:
-    Forwarder( MessagingPort &mp ) : mp_( mp ) {
+    Bridge( MessagingPort &mp ) : mp_( mp ) {
     }
-    void operator()() const {
-        DBClientConnection dest;
+
+    /* client -> destination */
+    void requests() {
         string errmsg;
-        while( !dest.connect( destUri, errmsg ) )
+        while( !dest_.connect( destUri, errmsg ) )
             sleepmillis( 500 );
+        boost::thread t( boost::bind( &Bridge::replies, this ) );
+
         Message m;
         while( 1 ) {
             m.reset();
             if ( !mp_.recv( m ) ) {
                 cout << "end connection " << mp_.farEnd.toString() << endl;
-                mp_.shutdown();
                 break;
             }
 
-            int oldId = m.data->id;
-            if ( m.data->operation() == dbQuery || m.data->operation() == dbMsg || m.data->operation() == dbGetMore ) {
-                Message response;
-                dest.port().call( m, response );
-                mp_.reply( m, response, oldId );
-            } else {
-                dest.port().say( m, oldId );
+            Pending p;
+            p.clientId = m.data->id;
+            p.key = OpStats::classify( m );
+            p.bytes = m.data->len;
+            int op = m.data->operation();
+            try {
+                if ( op == dbQuery || op == dbMsg || op == dbGetMore ) {
+                    boostlock lk( pendingMutex_ );
+                    p.start = curTimeMicros64();
+                    dest_.port().say( m, p.clientId );
+                    pending_[ m.data->id ] = p; // say() gave it a new id, which the reply will refer to
+                }
+                else {
+                    dest_.port().say( m, p.clientId );
+                    opStats.record( p.key, -1, p.bytes, 0 );
+                }
+            }
+            catch ( SocketException& ) {
+                cout << "lost destination for " << mp_.farEnd.toString() << endl;
+                break;
             }
         }
+
+        mp_.shutdown();
+        dest_.port().shutdown();
+        t.join();
     }
+
+    /* destination -> client */
+    void replies() {
+        Message response;
+        while( 1 ) {
+            response.reset();
+            if ( !dest_.port().recv( response ) )
+                break;
+            unsigned long long now = curTimeMicros64();
+
+            Pending p;
+            {
+                boostlock lk( pendingMutex_ );
+                map< int, Pending >::iterator i = pending_.find( response.data->responseTo );
+                if ( i == pending_.end() ) {
+                    cout << "reply to unknown request " << (unsigned) response.data->responseTo << ", dropping it" << endl;
+                    continue;
+                }
+                p = i->second;
+                pending_.erase( i );
+            }
+            opStats.record( p.key, (int) ( now - p.start ), p.bytes, response.data->len );
+
+            try {
+                mp_.say( response, p.clientId );
+            }
+            catch ( SocketException& ) {
+                break;
+            }
+        }
+        mp_.shutdown();
+    }
+
 private:
+    struct Pending {
+        int clientId;
+        string key;
+        int bytes;
+        unsigned long long start;
+    };
+
     MessagingPort &mp_;
+    DBClientConnection dest_;
+    boost::mutex pendingMutex_;
+    map< int, Pending > pending_; // by the id we sent it to the destination with
 };
 
+void bridgeConnection( MessagingPort *mp ) {
+    Bridge b( *mp );
+    b.requests();
+}
+
 set<MessagingPort*> ports;
 
 class MyListener : public Listener {
@@ -65,13 +145,34 @@ public:
     MyListener( int port ) : Listener( "", port ) {}
     virtual void accepted(MessagingPort *mp) {
         ports.insert( mp );
-        Forwarder f( *mp );
-        boost::thread t( f );
+        boost::thread t( boost::bind( bridgeConnection, mp ) );
     }
 };
 
 auto_ptr< MyListener > listener;
 
+class StatsServer : public MiniWebServer {
+public:
+    virtual void doRequest( const char *rq, string url, string& responseMsg, int& responseCode,
+                            vector<string>& headers, const SockAddr &from ) {
+        if ( url == "/reset" )
+            opStats.reset();
+        responseCode = 200;
+        headers.push_back( "Content-Type: text/plain" );
+        responseMsg = opStats.report();
+    }
+};
+
+void statsServerThread() {
+    StatsServer server;
+    if ( !server.init( "", httpPort ) ) {
+        cout << "couldn't listen for http on port " << httpPort << endl;
+        return;
+    }
+    cout << "latency stats on http port " << httpPort << endl;
+    server.run();
+}
+
 #if !defined(_WIN32) 
 void cleanup( int sig ) {
     close( listener->socket() );
@@ -94,9 +195,10 @@ inline void setupSignals() {}
 #endif
 
 void helpExit() {
-    cout << "usage mongobridge --port <port> --dest <destUri>" << endl;
+    cout << "usage mongobridge --port <port> --dest <destUri> [--http <port>]" << endl;
     cout << "    port: port to listen for mongo messages" << endl;
     cout << "    destUri: uri of remote mongod instance" << endl;
+    cout << "    http: port to serve latency stats on, default port + 1000" << endl;
     ::exit( -1 );
 }
 
@@ -108,19 +210,25 @@ void check( bool b ) {
 int main( int argc, char **argv ) {
     setupSignals();
 
-    check( argc == 5 );
+    check( argc == 5 || argc == 7 );
 
-    for( int i = 1; i < 5; ++i ) {
+    for( int i = 1; i < argc; ++i ) {
         check( i % 2 != 0 );
         if ( strcmp( argv[ i ], "--port" ) == 0 ) {
             port = strtol( argv[ ++i ], 0, 10 );
         } else if ( strcmp( argv[ i ], "--dest" ) == 0 ) {
             destUri = argv[ ++i ];
+        } else if ( strcmp( argv[ i ], "--http" ) == 0 ) {
+            httpPort = strtol( argv[ ++i ], 0, 10 );
         } else {
             check( false );
         }
     }
     check( port != 0 && !destUri.empty() );
+    if ( httpPort == 0 )
+        httpPort = port + 1000;
+
+    boost::thread stats( statsServerThread );
 
     listener.reset( new MyListener( port ) );
     listener->init();
@@ -18,6 +18,7 @@
 
 #include "../stdafx.h"
 #include "../client/dbclient.h"
+#include "../util/queue.h"
 #include "tool.h"
 
 #include <fcntl.h>
@@ -27,23 +28,49 @@ using namespace mongo;
 namespace po = boost::program_options;
 
 class Dump : public Tool {
+    /* collections are dumped by a pool of --numThreads workers, each with its own
+       connection, pulling from a queue that is filled before any of them start.
+    */
+    typedef pair<string,path> Job;
+
+    BlockingQueue<Job> _jobs;
+    int _numThreads;
+    bool _tableScan;
+
+    boost::mutex _mutex; // guards cout and _errors
+    int _errors;
+
 public:
     Dump() : Tool( "dump" , "*" ){
         add_options()
             ("out,o", po::value<string>()->default_value("dump"), "output directory")
+            ("numThreads", po::value<int>(), "number of collections to dump at once. default: 4")
+            ("forceTableScan", "read each collection in extent order rather than with a snapshot query.  faster, but an object moved during the dump can be missed or seen twice")
             ;
+        _numThreads = 4;
+        _tableScan = false;
+        _errors = 0;
     }
 
-    void doCollection( const string coll , path outputFile ) {
-        cout << "\t" << coll << " to " << outputFile.string() << endl;
+    void doCollection( DBClientBase& c , const string coll , path outputFile ) {
+        {
+            boostlock lk( _mutex );
+            cout << "\t" << coll << " to " << outputFile.string() << endl;
+        }
         
         ofstream out;
         out.open( outputFile.string().c_str() , ios_base::out | ios_base::binary  );
         uassert( "couldn't open file" , out.good() );
 
-        ProgressMeter m( conn( true ).count( coll.c_str() , BSONObj() , Option_SlaveOk ) );
+        ProgressMeter m( c.count( coll.c_str() , BSONObj() , Option_SlaveOk ) );
 
-        auto_ptr<DBClientCursor> cursor = conn( true ).query( coll.c_str() , Query().snapshot() , 0 , 0 , 0 , Option_SlaveOk | Option_NoCursorTimeout );
+        Query q;
+        if ( _tableScan )
+            q.hint( BSON( "$natural" << 1 ) );
+        else
+            q.snapshot();
+
+        auto_ptr<DBClientCursor> cursor = c.query( coll.c_str() , q , 0 , 0 , 0 , Option_SlaveOk | Option_NoCursorTimeout );
 
         while ( cursor->more() ) {
             BSONObj obj = cursor->next();
@@ -51,7 +78,10 @@ public:
             m.hit();
         }
 
-        cout << "\t\t " << m.done() << " objects" << endl;
+        {
+            boostlock lk( _mutex );
+            cout << "\t\t " << coll << " " << m.done() << " objects" << endl;
+        }
 
         out.close();
     }
@@ -75,17 +105,36 @@ public:
             if ( _coll.length() > 0 && db + "." + _coll != name && _coll != name )
                 continue;
 
-            doCollection( name.c_str() , outdir / ( filename + ".bson" ) );
+            _jobs.push( Job( name , outdir / ( filename + ".bson" ) ) );
 
         }
 
     }
 
+    void work( DBClientBase * c ){
+        Job job;
+        while ( _jobs.tryPop( job ) ){
+            try {
+                doCollection( *c , job.first , job.second );
+            }
+            catch ( std::exception& e ){
+                boostlock lk( _mutex );
+                cerr << "error dumping " << job.first << ": " << e.what() << endl;
+                _errors++;
+            }
+        }
+    }
+
     int run(){
 
         path root( getParam("out") );
         string db = _db;
 
+        _numThreads = max( 1 , getParam( "numThreads" , _numThreads ) );
+        _tableScan = hasParam( "forceTableScan" );
+        if ( isDirect() )
+            _numThreads = 1;
+
         if ( db == "*" ){
             cout << "all dbs" << endl;
             auth( "admin" );
@@ -110,7 +159,18 @@ public:
             auth( db );
             go( db , root / db );
         }
-        return 0;
+
+        vector< shared_ptr<DBClientBase> > conns;
+        for ( int i=1; i<_numThreads; i++ )
+            conns.push_back( shared_ptr<DBClientBase>( newConn() ) );
+
+        boost::thread_group threads;
+        for ( unsigned i=0; i<conns.size(); i++ )
+            threads.create_thread( boost::bind( &Dump::work , this , conns[i].get() ) );
+        work( &conn( true ) );
+        threads.join_all();
+
+        return _errors ? -1 : 0;
     }
 
 };
@@ -19,6 +19,7 @@
 #include "stdafx.h"
 #include "client/dbclient.h"
 #include "db/json.h"
+#include "util/queue.h"
 
 #include "tool.h"
 
@@ -39,6 +40,39 @@ class Import : public Tool {
     const char * _sep;
     bool _ignoreBlanks;
     bool _headerLine;
+
+    /* the import is a pipeline: one reader thread cuts the input into blocks of lines,
+       _numParsers threads turn those into batches of BSON objects, and _numInserters
+       threads (each with its own connection) send each batch as a single insert message.
+       the queues between the stages are bounded so a slow stage holds the others back
+       rather than buffering the whole file.
+    */
+    typedef shared_ptr< vector<char> > Block;     // nul terminated lines, back to back.  empty ptr means done
+    typedef shared_ptr< vector<BSONObj> > Batch;  // empty ptr means done
+
+    enum { LinesPerBlock = 1000 , MaxBatchBytes = 8 * 1024 * 1024 };
+
+    string _ns;
+    int _numParsers;
+    int _numInserters;
+    int _batchSize;
+
+    BlockingQueue<Block> * _blocks;
+    BlockingQueue<Batch> * _batches;
+
+    boost::mutex _statsMutex;
+    long long _read;
+    long long _inserted;
+    int _errors;
+    int _parsersLeft;
+
+    void _error( const string& what , const char * line = 0 ){
+        boostlock lk( _statsMutex );
+        cout << "exception:" << what << endl;
+        if ( line )
+            cout << line << endl;
+        _errors++;
+    }
     
     void _append( BSONObjBuilder& b , const string& fieldName , const string& data ){
         if ( b.appendAsNumber( fieldName , data ) )
@@ -110,6 +144,131 @@ class Import : public Tool {
         return b.obj();
     }
     
+    void readLines( istream * in , long long fileSize ){
+        try {
+            ProgressMeter pm( fileSize );
+            const int BUF_SIZE = 1024 * 1024 * 4;
+            vector<char> lineBuf( BUF_SIZE + 128 );
+            char * line = &lineBuf[0];
+
+            time_t start = time(0);
+            Block block( new vector<char>() );
+            int lines = 0;
+
+            while ( *in ){
+                in->getline( line , BUF_SIZE );
+                uassert( "unknown error reading file" , ( in->rdstate() & ios_base::badbit ) == 0 );
+                log(1) << "got line:" << line << endl;
+
+                char * buf = line;
+                while( isspace( buf[0] ) ) buf++;
+            
+                int len = strlen( buf );
+                if ( ! len )
+                    continue;
+            
+                if ( in->rdstate() == ios_base::eofbit )
+                    break;
+                assert( in->rdstate() == 0 );
+
+                if ( _headerLine ){
+                    // has to be done before any parser sees a line, as it fills in _fields
+                    try {
+                        parseLine( buf );
+                    }
+                    catch ( std::exception& e ){
+                        _error( e.what() , buf );
+                    }
+                    _headerLine = false;
+                }
+                else {
+                    block->insert( block->end() , buf , buf + len + 1 );
+                    if ( ++lines >= LinesPerBlock ){
+                        _blocks->push( block );
+                        block.reset( new vector<char>() );
+                        lines = 0;
+                    }
+                }
+
+                long long num;
+                {
+                    boostlock lk( _statsMutex );
+                    num = ++_read;
+                }
+                if ( pm.hit( len + 1 ) ){
+                    cout << "\t\t\t" << num << "\t" << ( num / ( time(0) - start ) ) << "/second" << endl;
+                }
+            }
+
+            if ( lines )
+                _blocks->push( block );
+        }
+        catch ( std::exception& e ){
+            _error( e.what() );
+        }
+
+        for ( int i=0; i<_numParsers; i++ )
+            _blocks->push( Block() );
+    }
+
+    void parseBlocks(){
+        Batch batch( new vector<BSONObj>() );
+        int bytes = 0;
+
+        while ( true ){
+            Block block = _blocks->blockingPop();
+            if ( ! block )
+                break;
+
+            char * line = &(*block)[0];
+            char * end = line + block->size();
+            while ( line < end ){
+                int len = strlen( line );
+                try {
+                    BSONObj o = parseLine( line );
+                    batch->push_back( o );
+                    bytes += o.objsize();
+                }
+                catch ( std::exception& e ){
+                    _error( e.what() , line );
+                }
+                line += len + 1;
+
+                if ( (int)batch->size() >= _batchSize || bytes >= MaxBatchBytes ){
+                    _batches->push( batch );
+                    batch.reset( new vector<BSONObj>() );
+                    bytes = 0;
+                }
+            }
+        }
+
+        if ( batch->size() )
+            _batches->push( batch );
+
+        boostlock lk( _statsMutex );
+        if ( --_parsersLeft == 0 ){
+            for ( int i=0; i<_numInserters; i++ )
+                _batches->push( Batch() );
+        }
+    }
+
+    void insertBatches( DBClientBase * c ){
+        while ( true ){
+            Batch batch = _batches->blockingPop();
+            if ( ! batch )
+                break;
+
+            try {
+                c->insert( _ns , *batch );
+                boostlock lk( _statsMutex );
+                _inserted += batch->size();
+            }
+            catch ( std::exception& e ){
+                _error( e.what() );
+            }
+        }
+    }
+    
 public:
     Import() : Tool( "import" ){
         addFieldOptions();
@@ -119,13 +278,26 @@ public:
             ("file",po::value<string>() , "file to import from; if not specified stdin is used" )
             ("drop", "drop collection first " )
             ("headerline","CSV,TSV only - use first line as headers")
+            ("numParsers",po::value<int>(), "number of threads turning lines into objects. default: 2" )
+            ("numInserters",po::value<int>(), "number of connections inserting in parallel. default: 2" )
+            ("batchSize",po::value<int>(), "objects sent per insert message. default: 100" )
+            ("maintainInsertionOrder", "insert in the same order as the input (one parser and one inserter)" )
             ;
         addPositionArg( "file" , 1 );
         _type = JSON;
         _ignoreBlanks = false;
         _headerLine = false;
+        _numParsers = 2;
+        _numInserters = 2;
+        _batchSize = 100;
+        _blocks = 0;
+        _batches = 0;
+        _read = 0;
+        _inserted = 0;
+        _errors = 0;
+        _parsersLeft = 0;
     }
-    
+
     int run(){
         string filename = getParam( "file" );
         long long fileSize = -1;
@@ -143,22 +315,20 @@ public:
             fileSize = file_size( filename );
         }
 
-        string ns;
-
         try {
-            ns = getNS();
+            _ns = getNS();
         } catch (...) {
             printHelp(cerr);
             return -1;
         }
         
-        log(1) << "ns: " << ns << endl;
+        log(1) << "ns: " << _ns << endl;
         
         auth();
 
         if ( hasParam( "drop" ) ){
-            cout << "dropping: " << ns << endl;
-            conn().dropCollection( ns.c_str() );
+            cout << "dropping: " << _ns << endl;
+            conn().dropCollection( _ns.c_str() );
         }
 
         if ( hasParam( "ignoreBlanks" ) ){
@@ -189,52 +359,58 @@ public:
                 needFields();
         }
 
-        int errors = 0;
-        
-        int num = 0;
-        
-        time_t start = time(0);
+        _numParsers = max( 1 , getParam( "numParsers" , _numParsers ) );
+        _numInserters = max( 1 , getParam( "numInserters" , _numInserters ) );
+        _batchSize = max( 1 , getParam( "batchSize" , _batchSize ) );
+        if ( hasParam( "maintainInsertionOrder" ) ){
+            _numParsers = 1;
+            _numInserters = 1;
+        }
+        if ( isDirect() ){
+            // only the main thread is set up to touch the data files
+            _numInserters = 1;
+        }
 
         log(1) << "filesize: " << fileSize << endl;
-        ProgressMeter pm( fileSize );
-        const int BUF_SIZE = 1024 * 1024 * 4;
-        char line[ (1024 * 1024 * 4) + 128];
-        while ( *in ){
-            in->getline( line , BUF_SIZE );
-            uassert( "unknown error reading file" , ( in->rdstate() & ios_base::badbit ) == 0 );
-            log(1) << "got line:" << line << endl;
-
-            char * buf = line;
-            while( isspace( buf[0] ) ) buf++;
-            
-            int len = strlen( buf );
-            if ( ! len )
-                continue;
-            
-            if ( in->rdstate() == ios_base::eofbit )
-                break;
-            assert( in->rdstate() == 0 );
 
-            try {
-                BSONObj o = parseLine( buf );
-                if ( _headerLine )
-                    _headerLine = false;
-                else
-                    conn().insert( ns.c_str() , o );
-            }
-            catch ( std::exception& e ){
-                cout << "exception:" << e.what() << endl;
-                cout << buf << endl;
-                errors++;
-            }
+        BlockingQueue<Block> blocks( 2 * _numParsers );
+        BlockingQueue<Batch> batches( 2 * _numInserters );
+        _blocks = &blocks;
+        _batches = &batches;
+        _parsersLeft = _numParsers;
 
-            num++;
-            if ( pm.hit( len + 1 ) ){
-                cout << "\t\t\t" << num << "\t" << ( num / ( time(0) - start ) ) << "/second" << endl;
-            }
-        }
+        vector< shared_ptr<DBClientBase> > conns;
+        for ( int i=1; i<_numInserters; i++ )
+            conns.push_back( shared_ptr<DBClientBase>( newConn() ) );
+
+        Timer timer;
+
+        boost::thread_group threads;
+        threads.create_thread( boost::bind( &Import::readLines , this , in , fileSize ) );
+        for ( int i=0; i<_numParsers; i++ )
+            threads.create_thread( boost::bind( &Import::parseBlocks , this ) );
+        for ( unsigned i=0; i<conns.size(); i++ )
+            threads.create_thread( boost::bind( &Import::insertBatches , this , conns[i].get() ) );
+
+        insertBatches( &conn() );
+        threads.join_all();
+
+        _blocks = 0;
+        _batches = 0;
+
+        int millis = timer.millis();
+        int errors = _errors;
+        long long num = _inserted;
 
         cout << "imported " << num << " objects" << endl;
+        if ( millis > 0 )
+            cout << "\t" << ( num * 1000 / millis ) << " objects/second in " << millis << "ms"
+                 << " using " << _numParsers << " parser" << ( _numParsers == 1 ? "" : "s" )
+                 << " and " << _numInserters << " inserter" << ( _numInserters == 1 ? "" : "s" ) << endl;
+        cout << "\tback pressure:"
+               << " reader waited " << blocks.pushWaits() << "x on parsers,"
+               << " parsers waited " << blocks.popWaits() << "x on reader and " << batches.pushWaits() << "x on inserters,"
+               << " inserters waited " << batches.popWaits() << "x on parsers" << endl;
         
         if ( errors == 0 )
             return 0;
@@ -0,0 +1,204 @@
+// opstats.h : request latency and throughput by operation shape, for mongobridge and mongosniff
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../stdafx.h"
+#include "../util/message.h"
+#include "../db/dbmessage.h"
+#include "../db/jsobj.h"
+
+namespace mongo {
+
+    /* requests are grouped by op, namespace and -- for queries, updates and deletes -- the shape
+       of the selector: its field names and operators with the values left out, so that
+       { a : 5 } and { a : 7 } land in the same group.  commands are grouped by command name.
+    */
+    class OpStats : boost::noncopyable {
+    public:
+        enum { Buckets = 24 }; // bucket i counts latencies under 2^i micros; the last one takes the rest
+
+        OpStats() : _since( time(0) ) {}
+
+        static string classify( const Message& m ) {
+            int op = m.data->operation();
+            if ( op == dbMsg )
+                return "msg";
+            if ( op == dbKillCursors )
+                return "killcursors";
+
+            DbMessage d( m );
+            stringstream ss;
+            switch ( op ) {
+            case dbQuery: {
+                QueryMessage q( d );
+                const char *cmd = strstr( q.ns , ".$cmd" );
+                if ( cmd && cmd[5] == 0 ) {
+                    ss << "command " << q.ns << ' ' << q.query.firstElement().fieldName();
+                    break;
+                }
+                BSONObj query = q.query;
+                BSONObj order;
+                BSONElement e = query.getField( "$query" );
+                if ( e.eoo() )
+                    e = query.getField( "query" );
+                if ( e.type() == Object ) {
+                    order = query.getObjectField( "orderby" );
+                    query = e.embeddedObject();
+                }
+                ss << "query " << q.ns << ' ' << shape( query ).toString();
+                if ( ! order.isEmpty() )
+                    ss << " sort " << order.toString();
+                break;
+            }
+            case dbGetMore:
+                ss << "getmore " << d.getns();
+                break;
+            case dbInsert:
+                ss << "insert " << d.getns();
+                break;
+            case dbUpdate: {
+                ss << "update " << d.getns();
+                d.pullInt(); // flags
+                if ( d.moreJSObjs() )
+                    ss << ' ' << shape( d.nextJsObj() ).toString();
+                break;
+            }
+            case dbDelete: {
+                ss << "remove " << d.getns();
+                d.pullInt(); // flags
+                if ( d.moreJSObjs() )
+                    ss << ' ' << shape( d.nextJsObj() ).toString();
+                break;
+            }
+            default:
+                ss << "op " << op;
+            }
+            return ss.str();
+        }
+
+        /* { a : 5 , b : { $gt : 3 , $lt : 9 } } -> { a : 1 , b : { $gt : 1 , $lt : 1 } } */
+        static BSONObj shape( const BSONObj& query ) {
+            BSONObjBuilder b;
+            BSONObjIterator i( query );
+            while ( i.more() ) {
+                BSONElement e = i.next();
+                if ( e.eoo() )
+                    break;
+                if ( e.type() == Object && e.embeddedObject().firstElement().fieldName()[0] == '$' )
+                    b.append( e.fieldName() , shape( e.embeddedObject() ) );
+                else
+                    b.append( e.fieldName() , 1 );
+            }
+            return b.obj();
+        }
+
+        /* micros < 0 for requests that get no reply, which count toward throughput only */
+        void record( const string& key , int micros , int requestBytes , int responseBytes ) {
+            boostlock lk( _m );
+            Stat& s = _stats[ key ];
+            s.n++;
+            s.requestBytes += requestBytes;
+            s.responseBytes += responseBytes;
+            if ( micros < 0 )
+                return;
+            s.timed++;
+            s.totalMicros += micros;
+            if ( micros > s.maxMicros )
+                s.maxMicros = micros;
+            int bucket = 0;
+            while ( bucket < Buckets - 1 && ( 1 << bucket ) <= micros )
+                bucket++;
+            s.histogram[ bucket ]++;
+        }
+
+        /* a plain text table, slowest groups (by total time) first */
+        string report() const {
+            vector< pair< long long , string > > order;
+            map< string , Stat > stats;
+            int secs;
+            {
+                boostlock lk( _m );
+                stats = _stats;
+                secs = (int) ( time(0) - _since );
+            }
+            if ( secs <= 0 )
+                secs = 1;
+
+            for ( map< string , Stat >::const_iterator i = stats.begin(); i != stats.end(); i++ )
+                order.push_back( make_pair( - i->second.totalMicros , i->first ) );
+            sort( order.begin() , order.end() );
+
+            stringstream ss;
+            ss << "over the last " << secs << " seconds.  latencies in micros; percentiles are bucket upper bounds\n\n";
+            ss << setw(10) << "count" << setw(10) << "per sec"
+               << setw(12) << "avg" << setw(12) << "50%" << setw(12) << "90%" << setw(12) << "99%" << setw(12) << "max"
+               << setw(14) << "bytes in" << setw(14) << "bytes out" << "  op\n";
+            for ( unsigned i = 0; i < order.size(); i++ ) {
+                const Stat& s = stats[ order[i].second ];
+                ss << setw(10) << s.n << setw(10) << ( s.n / secs );
+                if ( s.timed ) {
+                    ss << setw(12) << ( s.totalMicros / s.timed )
+                       << setw(12) << s.percentile( 50 ) << setw(12) << s.percentile( 90 ) << setw(12) << s.percentile( 99 )
+                       << setw(12) << s.maxMicros;
+                }
+                else {
+                    for ( int j = 0; j < 5; j++ )
+                        ss << setw(12) << "-";
+                }
+                ss << setw(14) << s.requestBytes << setw(14) << s.responseBytes << "  " << order[i].second << '\n';
+            }
+            return ss.str();
+        }
+
+        void reset() {
+            boostlock lk( _m );
+            _stats.clear();
+            _since = time(0);
+        }
+
+    private:
+        struct Stat {
+            Stat() : n(0) , timed(0) , totalMicros(0) , maxMicros(0) , requestBytes(0) , responseBytes(0) {
+                memset( histogram , 0 , sizeof( histogram ) );
+            }
+            long long percentile( int pct ) const {
+                long long want = ( timed * pct + 99 ) / 100;
+                long long seen = 0;
+                for ( int i = 0; i < Buckets - 1; i++ ) {
+                    seen += histogram[i];
+                    if ( seen >= want )
+                        return 1LL << i;
+                }
+                return maxMicros;
+            }
+            long long n;
+            long long timed;
+            long long totalMicros;
+            long long maxMicros;
+            long long requestBytes;
+            long long responseBytes;
+            long long histogram[ Buckets ];
+        };
+
+        mutable boost::mutex _m;
+        map< string , Stat > _stats;
+        time_t _since;
+    };
+
+} // namespace mongo
@@ -0,0 +1,357 @@
+// replay.cpp
+
+/**
+*    Copyright (C) 2008 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* replays a diaglog (mongod --diaglog / the diagLogging command) against a server.
+
+   requests from one recorded connection always go, in order, down the same replay
+   connection, so a session's writes and getmores stay consistent.  cursor ids in
+   getmore and killcursors messages are swapped for the ids the target server handed out.
+   a request is replayed once its response record has been read; one that never got a
+   response (the server died or the request failed) goes when the next request on that
+   connection turns up, or at the end of the log.
+*/
+
+#include "../stdafx.h"
+#include "../client/dbclient.h"
+#include "../db/dbmessage.h"
+#include "../db/diaglog.h"
+#include "../util/queue.h"
+#include "tool.h"
+
+#include <fstream>
+
+using namespace mongo;
+
+namespace po = boost::program_options;
+
+class Replay : public Tool {
+
+    struct Worker {
+        Worker() : queue( 1000 ) , skipped(0) , errors(0) {}
+        BlockingQueue<DiagLogRecord*> queue;    // 0 means done
+        shared_ptr<DBClientBase> conn;
+        map<long long,long long> cursors;       // recorded id -> id on the target
+        vector<int> latencies;                  // micros, request/response ops only
+        vector<int> recorded;                   // what the same ops took when captured
+        long long skipped;
+        long long errors;
+    };
+
+    vector< shared_ptr<Worker> > _workers;
+
+    int _numThreads;
+    double _speed;
+    long long _num;
+    unsigned long long _firstRecorded;
+    unsigned long long _replayStart;
+
+public:
+    Replay() : Tool( "replay" , "" , "" ){
+        add_options()
+            ("numThreads", po::value<int>(), "connections to replay over. default: 4")
+            ("speed", po::value<double>(), "multiple of the recorded rate; 0 replays as fast as possible. default: 1")
+            ;
+        add_hidden_options()
+            ("file", po::value<string>(), "diaglog file to replay")
+            ;
+        addPositionArg( "file" , 1 );
+        _numThreads = 1;
+        _speed = 1;
+        _num = 0;
+        _firstRecorded = 0;
+        _replayStart = 0;
+    }
+
+    virtual void printExtraHelp(ostream& out) {
+        out << "usage: " << _name << " [options] <diaglog file>" << endl;
+    }
+
+    static long long * getMoreCursorId( MsgData * m ){
+        char * p = m->_data + 4;
+        p += strlen( p ) + 1 + 4; // ns, ntoreturn
+        return (long long *) p;
+    }
+
+    /* @return false if the message refers to a cursor the target never opened */
+    bool mapCursors( Worker& w , MsgData * m ){
+        if ( m->operation() == dbGetMore ){
+            long long * id = getMoreCursorId( m );
+            map<long long,long long>::iterator i = w.cursors.find( *id );
+            if ( i == w.cursors.end() )
+                return false;
+            *id = i->second;
+        }
+        else if ( m->operation() == dbKillCursors ){
+            int * x = (int *) m->_data;
+            int n = x[1];
+            long long * ids = (long long *) ( x + 2 );
+            for ( int i=0; i<n; i++ ){
+                map<long long,long long>::iterator j = w.cursors.find( ids[i] );
+                if ( j == w.cursors.end() )
+                    continue;
+                ids[i] = j->second;
+                w.cursors.erase( j );
+            }
+        }
+        return true;
+    }
+
+    void killCursors( Worker& w , const vector<long long>& ids ){
+        if ( ids.empty() )
+            return;
+        BufBuilder b;
+        b.append( (int) 0 ); // reserved
+        b.append( (int) ids.size() );
+        for ( unsigned i=0; i<ids.size(); i++ )
+            b.append( ids[i] );
+
+        Message m;
+        m.setData( dbKillCursors , b.buf() , b.len() );
+        w.conn->say( m );
+    }
+
+    void replayOne( Worker& w , DiagLogRecord * r ){
+        MsgData * recorded = r->msg();
+        int op = recorded->operation();
+
+        MsgData * copy = (MsgData *) malloc( recorded->len );
+        memcpy( copy , recorded , recorded->len );
+        Message m;
+        m.setData( copy , true );
+
+        if ( ! mapCursors( w , copy ) ){
+            w.skipped++;
+            return;
+        }
+
+        if ( op != dbQuery && op != dbGetMore ){
+            w.conn->say( m );
+            return;
+        }
+
+        Message response;
+        Timer t;
+        if ( ! w.conn->call( m , response , false ) ){
+            w.errors++;
+            return;
+        }
+        if ( r->micros >= 0 ){
+            w.latencies.push_back( (int) t.micros() );
+            w.recorded.push_back( r->micros );
+        }
+
+        long long now = ( (QueryResult *) response.data )->cursorId;
+        if ( op == dbGetMore && ! r->cursorId )
+            w.cursors.erase( *getMoreCursorId( recorded ) ); // the recorded cursor ran out here
+
+        if ( r->cursorId && now )
+            w.cursors[ r->cursorId ] = now;
+        else if ( r->cursorId )
+            w.cursors.erase( r->cursorId );
+        else if ( now ){
+            // the target has more than was recorded, so nothing in the log will ask for the rest
+            killCursors( w , vector<long long>( 1 , now ) );
+        }
+    }
+
+    /* the capture may end with cursors still open, so don't leave ours on the target */
+    void killRemainingCursors( Worker& w ){
+        vector<long long> ids;
+        for ( map<long long,long long>::iterator i=w.cursors.begin(); i!=w.cursors.end(); i++ )
+            ids.push_back( i->second );
+        w.cursors.clear();
+        try {
+            killCursors( w , ids );
+        }
+        catch ( std::exception& e ){
+            cerr << "error killing cursors: " << e.what() << endl;
+        }
+    }
+
+    void work( Worker * w ){
+        while ( 1 ){
+            DiagLogRecord * r = w->queue.blockingPop();
+            if ( ! r )
+                break;
+            try {
+                replayOne( *w , r );
+            }
+            catch ( std::exception& e ){
+                if ( w->errors++ == 0 )
+                    cerr << "error replaying: " << e.what() << endl;
+            }
+            free( r );
+        }
+        killRemainingCursors( *w );
+    }
+
+    /* paces requests to the recorded rate and hands them to their connection's worker */
+    void dispatch( DiagLogRecord * r ){
+        if ( _num++ == 0 )
+            _firstRecorded = r->startMicros;
+
+        if ( _speed > 0 && r->startMicros > _firstRecorded ){
+            unsigned long long due = _replayStart + (unsigned long long) ( ( r->startMicros - _firstRecorded ) / _speed );
+            unsigned long long now = curTimeMicros64();
+            if ( due > now )
+                sleepmicros( (int) min( due - now , 1000000ULL * 60 ) );
+        }
+
+        _workers[ r->connId % _numThreads ]->queue.push( r );
+    }
+
+    static void percentiles( const char * what , vector<int>& v ){
+        if ( v.empty() )
+            return;
+        sort( v.begin() , v.end() );
+        cout << "\t" << what << " micros"
+             << "  50%: " << v[ v.size() / 2 ]
+             << "  90%: " << v[ v.size() * 9 / 10 ]
+             << "  99%: " << v[ v.size() * 99 / 100 ]
+             << "  max: " << v.back() << endl;
+    }
+
+    int run(){
+        string filename = getParam( "file" );
+        if ( filename.empty() ){
+            printHelp( cerr );
+            return -1;
+        }
+        if ( isDirect() ){
+            cerr << "replay needs a server to replay against, not --dbpath" << endl;
+            return -1;
+        }
+
+        ifstream in( filename.c_str() , ios_base::in | ios_base::binary );
+        if ( ! in.is_open() ){
+            cerr << "couldn't open " << filename << endl;
+            return -1;
+        }
+
+        DiagLogHeader h;
+        in.read( (char *) &h , sizeof( h ) );
+        if ( ! in.good() || ! h.valid() ){
+            cerr << filename << " is not a diaglog file" << endl;
+            return -1;
+        }
+
+        int numThreads = max( 1 , getParam( "numThreads" , 4 ) );
+        double speed = getParam( "speed" , 1.0 );
+
+        boost::thread_group threads;
+        for ( int i=0; i<numThreads; i++ ){
+            shared_ptr<Worker> w( new Worker() );
+            w->conn.reset( newConn() );
+            _workers.push_back( w );
+        }
+        for ( int i=0; i<numThreads; i++ )
+            threads.create_thread( boost::bind( &Replay::work , this , _workers[i].get() ) );
+
+        _num = 0;
+        _numThreads = numThreads;
+        _speed = speed;
+        _replayStart = curTimeMicros64();
+        Timer timer;
+
+        map<unsigned,DiagLogRecord*> pending; // connId -> request waiting for its response record
+        while ( 1 ){
+            DiagLogRecord header;
+            in.read( (char *) &header , sizeof( header ) );
+            if ( in.gcount() == 0 )
+                break;
+            if ( ! in.good() ){
+                cerr << "truncated record, stopping" << endl;
+                break;
+            }
+
+            if ( header.type == DiagLogRecord::Response && header.len == (int) sizeof( header ) ){
+                map<unsigned,DiagLogRecord*>::iterator i = pending.find( header.connId );
+                if ( i == pending.end() )
+                    continue; // its request was cut off the front of the log
+                DiagLogRecord * r = i->second;
+                pending.erase( i );
+                r->micros = header.micros;
+                r->responseLen = header.responseLen;
+                r->cursorId = header.cursorId;
+                dispatch( r );
+                continue;
+            }
+
+            if ( header.type != DiagLogRecord::Request ||
+                 header.len < (int) ( sizeof( DiagLogRecord ) + sizeof( MsgData ) ) || header.len > 64 * 1024 * 1024 ){
+                cerr << "bad record at offset " << (long long) in.tellg() << ", stopping" << endl;
+                break;
+            }
+
+            DiagLogRecord * r = (DiagLogRecord *) malloc( header.len );
+            memcpy( r , &header , sizeof( header ) );
+            in.read( (char *) r->msg() , header.len - sizeof( header ) );
+            if ( ! in.good() ){
+                free( r );
+                cerr << "truncated record, stopping" << endl;
+                break;
+            }
+
+            DiagLogRecord *& p = pending[ r->connId ];
+            if ( p )
+                dispatch( p ); // never got a response
+            p = r;
+        }
+        for ( map<unsigned,DiagLogRecord*>::iterator i = pending.begin(); i != pending.end(); i++ )
+            dispatch( i->second );
+        long long num = _num;
+
+        for ( int i=0; i<numThreads; i++ )
+            _workers[i]->queue.push( 0 );
+        threads.join_all();
+
+        int millis = timer.millis();
+
+        vector<int> latencies;
+        vector<int> recorded;
+        long long skipped = 0;
+        long long errors = 0;
+        for ( int i=0; i<numThreads; i++ ){
+            Worker& w = *_workers[i];
+            latencies.insert( latencies.end() , w.latencies.begin() , w.latencies.end() );
+            recorded.insert( recorded.end() , w.recorded.begin() , w.recorded.end() );
+            skipped += w.skipped;
+            errors += w.errors;
+        }
+
+        cout << "replayed " << num << " ops in " << millis << "ms";
+        if ( millis > 0 )
+            cout << " (" << ( num * 1000 / millis ) << "/second)";
+        cout << " over " << numThreads << " connection" << ( numThreads == 1 ? "" : "s" ) << endl;
+        if ( skipped )
+            cout << "\tskipped " << skipped << " getmores for cursors opened before the capture" << endl;
+        percentiles( "replayed" , latencies );
+        percentiles( "recorded" , recorded );
+
+        if ( errors ){
+            cerr << "encountered " << errors << " error" << ( errors == 1 ? "" : "s" ) << endl;
+            return -1;
+        }
+        return 0;
+    }
+};
+
+int main( int argc , char ** argv ) {
+    Replay r;
+    return r.main( argc , argv );
+}
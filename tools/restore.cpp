@@ -19,6 +19,7 @@
 #include "../stdafx.h"
 #include "../client/dbclient.h"
 #include "../util/mmap.h"
+#include "../util/queue.h"
 #include "tool.h"
 
 #include <boost/program_options.hpp>
@@ -30,12 +31,41 @@ using namespace mongo;
 namespace po = boost::program_options;
 
 class Restore : public Tool {
+    /* data files are read on the main thread and handed, a batch at a time, to
+       --numThreads inserters with their own connections.  system.indexes files are
+       held back until all the data is in, so each index is built once over a full
+       collection instead of being maintained through every insert.
+       every batch is followed by getLastError on the connection that sent it, and
+       the first failure stops the restore before any index is built.
+    */
+    struct Batch {
+        string ns;
+        vector<BSONObj> objs;
+    };
+
+    enum { MaxBatchObjects = 1000 , MaxBatchBytes = 8 * 1024 * 1024 };
+
+    typedef pair<path,string> File;
+    vector<File> _dataFiles;
+    vector<File> _indexFiles;
+
+    int _numThreads;
+    BlockingQueue< shared_ptr<Batch> > * _batches;
+
+    boost::mutex _errorMutex;
+    string _error;
+
 public:
     Restore() : Tool( "restore" , "" , "" ){
+        add_options()
+            ("numThreads", po::value<int>(), "number of connections inserting in parallel. default: 4")
+            ;
         add_hidden_options()
             ("dir", po::value<string>()->default_value("dump"), "directory to restore from")
             ;
         addPositionArg("dir", 1);
+        _numThreads = 4;
+        _batches = 0;
     }
 
     virtual void printExtraHelp(ostream& out) {
@@ -56,9 +86,93 @@ public:
          * .bson file, or a single .bson file itself (a collection).
          */
         drillDown(root, _db != "", _coll != "");
+
+        _numThreads = max( 1 , getParam( "numThreads" , _numThreads ) );
+        if ( isDirect() )
+            _numThreads = 0; // only the main thread can touch the data files, it inserts inline
+
+        vector< shared_ptr<DBClientBase> > conns;
+        for ( int i=0; i<_numThreads; i++ )
+            conns.push_back( shared_ptr<DBClientBase>( newConn() ) );
+
+        BlockingQueue< shared_ptr<Batch> > batches( 2 * _numThreads );
+        if ( _numThreads )
+            _batches = &batches;
+
+        boost::thread_group threads;
+        for ( unsigned i=0; i<conns.size(); i++ )
+            threads.create_thread( boost::bind( &Restore::insertBatches , this , conns[i].get() ) );
+
+        try {
+            for ( unsigned i=0; i<_dataFiles.size(); i++ )
+                restoreFile( _dataFiles[i].first , _dataFiles[i].second );
+        }
+        catch ( ... ){
+            // let the inserters drain and exit before their connections go away
+            for ( int i=0; i<_numThreads; i++ )
+                batches.push( shared_ptr<Batch>() );
+            threads.join_all();
+            _batches = 0;
+            throw;
+        }
+
+        for ( int i=0; i<_numThreads; i++ )
+            batches.push( shared_ptr<Batch>() );
+        threads.join_all();
+        _batches = 0;
+        checkErrors();
+
+        // the data is all in, build the indexes over it
+        for ( unsigned i=0; i<_indexFiles.size(); i++ )
+            restoreFile( _indexFiles[i].first , _indexFiles[i].second );
+
         return EXIT_CLEAN;
     }
 
+    void insert( const shared_ptr<Batch>& b ){
+        checkErrors();
+        if ( _batches ){
+            _batches->push( b );
+            return;
+        }
+        conn().insert( b->ns , b->objs );
+        string err = conn().getLastError();
+        uassert( (string)"error inserting into " + b->ns + ": " + err , err.empty() );
+    }
+
+    /* throws the first error an inserter hit */
+    void checkErrors(){
+        boostlock lk( _errorMutex );
+        uassert( _error , _error.empty() );
+    }
+
+    void insertBatches( DBClientBase * c ){
+        while ( true ){
+            shared_ptr<Batch> b = _batches->blockingPop();
+            if ( ! b )
+                break;
+            {
+                // keep draining so the reader doesn't block, but stop writing
+                boostlock lk( _errorMutex );
+                if ( ! _error.empty() )
+                    continue;
+            }
+            string err;
+            try {
+                c->insert( b->ns , b->objs );
+                err = c->getLastError();
+            }
+            catch ( std::exception& e ){
+                err = e.what();
+            }
+            if ( err.empty() )
+                continue;
+            boostlock lk( _errorMutex );
+            if ( _error.empty() )
+                _error = "error inserting into " + b->ns + ": " + err;
+        }
+    }
+
     void drillDown( path root, bool use_db = false, bool use_coll = false ) {
         log(2) << "drillDown: " << root.string() << endl;
 
@@ -98,8 +212,6 @@ public:
             return;
         }
 
-        out() << root.string() << endl;
-
         string ns;
         if (use_db) {
             ns += _db;
@@ -119,6 +231,13 @@ public:
             ns += "." + l;
         }
 
+        if ( endsWith( ns.c_str() , ".system.indexes" ) )
+            _indexFiles.push_back( File( root , ns ) );
+        else
+            _dataFiles.push_back( File( root , ns ) );
+    }
+
+    void restoreFile( path root , const string& ns ){
         long long fileLength = file_size( root );
 
         if ( fileLength == 0 ) {
@@ -126,6 +245,7 @@ public:
             return;
         }
 
+        out() << root.string() << endl;
         out() << "\t going into namespace [" << ns << "]" << endl;
 
         string fileString = root.string();
@@ -145,6 +265,10 @@ public:
 
         ProgressMeter m( fileLength );
 
+        shared_ptr<Batch> batch( new Batch() );
+        batch->ns = ns;
+        int batchBytes = 0;
+
         while ( read < fileLength ) {
             file.read( buf , 4 );
             int size = ((int*)buf)[0];
@@ -155,8 +279,15 @@ public:
 
             file.read( buf + 4 , size - 4 );
 
-            BSONObj o( buf );
-            conn().insert( ns.c_str() , o );
+            BSONObj o = BSONObj( buf ).copy();
+            batch->objs.push_back( o );
+            batchBytes += o.objsize();
+            if ( batch->objs.size() >= MaxBatchObjects || batchBytes >= MaxBatchBytes ){
+                insert( batch );
+                batch.reset( new Batch() );
+                batch->ns = ns;
+                batchBytes = 0;
+            }
 
             read += o.objsize();
             num++;
@@ -164,6 +295,9 @@ public:
             m.hit( o.objsize() );
         }
 
+        if ( batch->objs.size() )
+            insert( batch );
+
         free( buf );
 
         uassert( "counts don't match" , m.done() == fileLength );
@@ -22,6 +22,7 @@
 #include "../util/message.h"
 #include "../db/dbmessage.h"
 #include "../client/dbclient.h"
+#include "opstats.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -50,12 +51,15 @@ using mongo::BSONObj;
 using mongo::BufBuilder;
 using mongo::DBClientConnection;
 using mongo::QueryResult;
+using mongo::OpStats;
 
 #define SNAP_LEN 65535
 
 int captureHeaderSize;
 set<int> serverPorts;
 string forwardAddress;
+bool statsMode = false;
+int statsInterval = 0;
 
 /* IP header */
 struct sniff_ip {
@@ -133,6 +137,115 @@ map< Connection, DBClientConnection* > forwarder;
 map< Connection, long long > lastCursor;
 map< Connection, map< long long, long long > > mapCursor;
 
+/* --stats: requests waiting for their reply, by connection and request id */
+struct Outstanding {
+    string key;
+    int bytes;
+    unsigned long long micros;
+};
+map< Connection, map< int, Outstanding > > outstanding;
+OpStats opStats;
+unsigned long long lastReport = 0;
+
+/* times each request by the capture timestamps of it and its reply, so the latency is what the
+   network saw -- the server's time plus the wire, without the client's own overhead.
+*/
+void recordStats( const Connection& c, Message& m, const struct pcap_pkthdr *header ) {
+    unsigned long long now = (unsigned long long) header->ts.tv_sec * 1000000 + header->ts.tv_usec;
+    int op = m.data->operation();
+    if ( op == mongo::opReply ) {
+        map< int, Outstanding >& o = outstanding[ c.reverse() ];
+        map< int, Outstanding >::iterator i = o.find( m.data->responseTo );
+        if ( i != o.end() ) {
+            opStats.record( i->second.key, (int) ( now - i->second.micros ), i->second.bytes, m.data->len );
+            o.erase( i );
+        }
+    }
+    else if ( op == mongo::dbQuery || op == mongo::dbGetMore || op == mongo::dbMsg ) {
+        Outstanding& o = outstanding[ c ][ m.data->id ];
+        o.key = OpStats::classify( m );
+        o.bytes = m.data->len;
+        o.micros = now;
+    }
+    else {
+        opStats.record( OpStats::classify( m ), -1, m.data->len, 0 );
+    }
+
+    if ( lastReport == 0 )
+        lastReport = now;
+    else if ( now - lastReport >= (unsigned long long) statsInterval * 1000000 ) {
+        cout << opStats.report() << endl;
+        opStats.reset();
+        lastReport = now;
+    }
+}
+
+void printMessage( const struct sniff_ip* ip, const struct sniff_tcp* tcp, Message& m ) {
+    DbMessage d( m );
+
+    cout << inet_ntoa(ip->ip_src) << ":" << ntohs( tcp->th_sport )
+         << ( serverPorts.count( ntohs( tcp->th_dport ) ) ? "  -->> " : "  <<--  " )
+         << inet_ntoa(ip->ip_dst) << ":" << ntohs( tcp->th_dport )
+         << " " << d.getns()
+         << "  " << m.data->len << " bytes "
+         << " id:" << hex << m.data->id << dec << "\t" << m.data->id;
+
+    if ( m.data->operation() == mongo::opReply )
+        cout << " - " << m.data->responseTo;
+    cout << endl;
+
+    switch( m.data->operation() ){
+    case mongo::opReply:{
+        mongo::QueryResult* r = (mongo::QueryResult*)m.data;
+        cout << "\treply" << " n:" << r->nReturned << " cursorId: " << r->cursorId << endl;
+        if ( r->nReturned ){
+            mongo::BSONObj o( r->data() , 0 );
+            cout << "\t" << o << endl;
+        }
+        break;
+    }
+    case mongo::dbQuery:{
+        mongo::QueryMessage q(d);
+        cout << "\tquery: " << q.query << "  ntoreturn: " << q.ntoreturn << " ntoskip: " << q.ntoskip << endl;
+        break;
+    }
+    case mongo::dbUpdate:{
+        int flags = d.pullInt();
+        BSONObj q = d.nextJsObj();
+        BSONObj o = d.nextJsObj();
+        cout << "\tupdate  flags:" << flags << " q:" << q << " o:" << o << endl;
+        break;
+    }
+    case mongo::dbInsert:{
+        cout << "\tinsert: " << d.nextJsObj() << endl;
+        while ( d.moreJSObjs() )
+            cout << "\t\t" << d.nextJsObj() << endl;
+        break;
+    }
+    case mongo::dbGetMore:{
+        int nToReturn = d.pullInt();
+        long long cursorId = d.pullInt64();
+        cout << "\tgetMore nToReturn: " << nToReturn << " cursorId: " << cursorId << endl;
+        break;
+    }
+    case mongo::dbDelete:{
+        int flags = d.pullInt();
+        BSONObj q = d.nextJsObj();
+        cout << "\tdelete flags: " << flags << " q: " << q << endl;
+        break;
+    }
+    case mongo::dbKillCursors:{
+        int *x = (int *) m.data->_data;
+        x++; // reserved
+        int n = *x;
+        cout << "\tkillCursors n: " << n << endl;
+        break;
+    }
+    default:
+        cerr << "*** CANNOT HANDLE TYPE: " << m.data->operation() << endl;
+    }
+}
+
 void got_packet(u_char *args, const struct pcap_pkthdr *header, const u_char *packet){
 
     const struct sniff_ip* ip = (struct sniff_ip*)(packet + captureHeaderSize);
@@ -215,69 +328,10 @@ void got_packet(u_char *args, const struct pcap_pkthdr *header, const u_char *pa
         messageBuilder[ c ].reset();
     }
 
-    DbMessage d( m );
-
-    cout << inet_ntoa(ip->ip_src) << ":" << ntohs( tcp->th_sport )
-         << ( serverPorts.count( ntohs( tcp->th_dport ) ) ? "  -->> " : "  <<--  " )
-         << inet_ntoa(ip->ip_dst) << ":" << ntohs( tcp->th_dport )
-         << " " << d.getns()
-         << "  " << m.data->len << " bytes "
-         << " id:" << hex << m.data->id << dec << "\t" << m.data->id;
-
-    if ( m.data->operation() == mongo::opReply )
-        cout << " - " << m.data->responseTo;
-    cout << endl;
-
-    switch( m.data->operation() ){
-    case mongo::opReply:{
-        mongo::QueryResult* r = (mongo::QueryResult*)m.data;
-        cout << "\treply" << " n:" << r->nReturned << " cursorId: " << r->cursorId << endl;
-        if ( r->nReturned ){
-            mongo::BSONObj o( r->data() , 0 );
-            cout << "\t" << o << endl;
-        }
-        break;
-    }
-    case mongo::dbQuery:{
-        mongo::QueryMessage q(d);
-        cout << "\tquery: " << q.query << "  ntoreturn: " << q.ntoreturn << " ntoskip: " << q.ntoskip << endl;
-        break;
-    }
-    case mongo::dbUpdate:{
-        int flags = d.pullInt();
-        BSONObj q = d.nextJsObj();
-        BSONObj o = d.nextJsObj();
-        cout << "\tupdate  flags:" << flags << " q:" << q << " o:" << o << endl;
-        break;
-    }
-    case mongo::dbInsert:{
-        cout << "\tinsert: " << d.nextJsObj() << endl;
-        while ( d.moreJSObjs() )
-            cout << "\t\t" << d.nextJsObj() << endl;
-        break;
-    }
-    case mongo::dbGetMore:{
-        int nToReturn = d.pullInt();
-        long long cursorId = d.pullInt64();
-        cout << "\tgetMore nToReturn: " << nToReturn << " cursorId: " << cursorId << endl;
-        break;
-    }
-    case mongo::dbDelete:{
-        int flags = d.pullInt();
-        BSONObj q = d.nextJsObj();
-        cout << "\tdelete flags: " << flags << " q: " << q << endl;
-        break;
-    }
-    case mongo::dbKillCursors:{
-        int *x = (int *) m.data->_data;
-        x++; // reserved
-        int n = *x;
-        cout << "\tkillCursors n: " << n << endl;
-        break;
-    }
-    default:
-        cerr << "*** CANNOT HANDLE TYPE: " << m.data->operation() << endl;
-    }
+    if ( statsMode )
+        recordStats( c, m, header );
+    else
+        printMessage( ip, tcp, m );
 
     if ( !forwardAddress.empty() ) {
         if ( m.data->operation() != mongo::opReply ) {
@@ -330,9 +384,12 @@ void got_packet(u_char *args, const struct pcap_pkthdr *header, const u_char *pa
 
 void usage() {
     cout <<
-    "Usage: mongosniff [--help] [--forward host:port] [--source (NET <interface> | FILE <filename>)] [<port0> <port1> ... ]\n"
+    "Usage: mongosniff [--help] [--forward host:port] [--stats secs] [--source (NET <interface> | FILE <filename>)] [<port0> <port1> ... ]\n"
     "--forward       Forward all parsed request messages to mongod instance at \n"
     "                specified host:port\n"
+    "--stats <secs>  Rather than print each message, time requests against their\n"
+    "                replies and print latency and throughput by op, namespace\n"
+    "                and query shape every <secs> seconds, and at the end.\n"
     "--source        Source of traffic to sniff, either a network interface or a\n"
     "                file containing perviously captured packets, in pcap format.\n"
     "                If no source is specified, mongosniff will attempt to sniff\n"
@@ -369,6 +426,11 @@ int main(int argc, char **argv){
                 return 0;
             } else if ( arg == string( "--forward" ) ) {
                 forwardAddress = args[ ++i ];
+            } else if ( arg == string( "--stats" ) ) {
+                uassert( "--stats needs an interval" , args.size() > i + 1 );
+                statsMode = true;
+                statsInterval = atoi( args[ ++i ] );
+                uassert( "--stats interval must be positive" , statsInterval > 0 );
             } else if ( arg == string( "--source" ) ) {
                 uassert( "can't use --source twice" , source == false );
                 uassert( "source needs more args" , args.size() > i + 2);
@@ -437,6 +499,9 @@ int main(int argc, char **argv){
 
     pcap_loop(handle, 0 , got_packet, NULL);
 
+    if ( statsMode )
+        cout << opStats.report() << endl;
+
     pcap_freecode(&fp);
     pcap_close(handle);
 
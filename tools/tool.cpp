@@ -165,6 +165,35 @@ mongo::DBClientBase& mongo::Tool::conn( bool slaveIfPaired ){
     return *_conn;
 }
 
+mongo::DBClientBase * mongo::Tool::newConn(){
+    if ( isDirect() )
+        return 0;
+
+    auto_ptr<DBClientBase> c;
+    if ( _paired ){
+        DBClientPaired * p = new DBClientPaired();
+        c.reset( p );
+        if ( ! p->connect( _host ) )
+            throw UserException( "couldn't connect to paired server: " + _host );
+    }
+    else {
+        DBClientConnection * p = new DBClientConnection();
+        c.reset( p );
+        string errmsg;
+        if ( ! p->connect( _host , errmsg ) )
+            throw UserException( "couldn't connect to [" + _host + "] " + errmsg );
+    }
+
+    if ( _username.size() || _password.size() ){
+        string errmsg;
+        if ( ! c->auth( _db , _username , _password , errmsg ) &&
+             ! c->auth( "admin" , _username , _password , errmsg ) )
+            throw mongo::UserException( (string)"auth failed: " + errmsg );
+    }
+
+    return c.release();
+}
+
 void mongo::Tool::addFieldOptions(){
     add_options()
         ("fields,f" , po::value<string>() , "comma seperated list of field names e.g. -f name,age" )
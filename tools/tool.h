@@ -39,6 +39,16 @@ namespace mongo {
                 return _params[name.c_str()].as<string>();
             return def;
         }
+        int getParam( string name , int def ){
+            if ( _params.count( name ) )
+                return _params[name.c_str()].as<int>();
+            return def;
+        }
+        double getParam( string name , double def ){
+            if ( _params.count( name ) )
+                return _params[name.c_str()].as<double>();
+            return def;
+        }
         bool hasParam( string name ){
             return _params.count( name );
         }
@@ -61,6 +71,14 @@ namespace mongo {
 
         mongo::DBClientBase &conn( bool slaveIfPaired = false );
         void auth( string db = "" );
+
+        /* true when working directly on data files (--dbpath) rather than over the network */
+        bool isDirect() const { return _conn && _host == "DIRECT"; }
+
+        /* a new, authenticated connection to the same server, for worker threads.
+           caller owns it.  not available with --dbpath, returns 0 then.
+        */
+        mongo::DBClientBase * newConn();
         
         string _name;
 
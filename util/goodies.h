@@ -19,6 +19,8 @@
 
 #pragma once
 
+#include <boost/thread/tss.hpp>
+
 #if defined(_WIN32)
 #  include <windows.h>
 #endif
@@ -165,6 +167,19 @@ namespace mongo {
         }
     };
 
+    /* full memory fence.  use before publishing a pointer to an object that lock free
+       readers may pick up, so they never see it partially constructed.
+    */
+    inline void memoryBarrier() {
+#if defined(_WIN32)
+        MemoryBarrier();
+#elif defined(__GNUC__)
+        __sync_synchronize();
+#else
+#  error "unsupported compiler or platform"
+#endif
+    }
+
 } // namespace mongo
 
 #include <ctime>
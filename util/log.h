@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include <boost/thread/tss.hpp>
+
 namespace mongo {
 
     using boost::shared_ptr;
@@ -25,6 +25,9 @@
 #include "../util/background.h"
 #include <fcntl.h>
 #include <errno.h>
+#if !defined(_WIN32)
+#include <poll.h>
+#endif
 #include "../db/cmdline.h"
 
 namespace mongo {
@@ -369,9 +372,22 @@ again:
 
     void MessagingPort::say(Message& toSend, int responseTo) {
         mmm( out() << "*  say() sock:" << this->sock << " thr:" << GetCurrentThreadId() << endl; )
+        if ( toSend._sent ) {
+            // started by sayWithoutBlocking(); the header is already out
+            sendPieces( toSend, true );
+            return;
+        }
+
         toSend.data->id = nextMessageId();
         toSend.data->responseTo = responseTo;
 
+        if ( toSend.hasPieces() ) {
+            if ( piggyBackData )
+                piggyBackData->flush();
+            sendPieces( toSend, true );
+            return;
+        }
+
         int x = -100;
 
         if ( piggyBackData && piggyBackData->len() ) {
@@ -396,6 +412,182 @@ again:
 
     }
 
+    void MessagingPort::sayWithoutBlocking(Message& toSend, int responseTo) {
+        assert( toSend._sent == 0 );
+        toSend.data->id = nextMessageId();
+        toSend.data->responseTo = responseTo;
+        if ( piggyBackData )
+            piggyBackData->flush();
+        sendPieces( toSend, false );
+    }
+
+    void MessagingPort::sendPieces(Message& toSend, bool block) {
+#if defined(_WIN32)
+        // no gathered writes; send it the plain way
+        if ( !block )
+            return;
+        toSend.consolidate();
+        int x = ::send(sock, (char*)toSend.data + toSend._sent, toSend.data->len - toSend._sent, portSendFlags );
+        if ( x <= 0 ) {
+            log() << "MessagingPort say send() error " << errno << ' ' << farEnd.toString() << endl;
+            throw SocketException();
+        }
+        toSend._sent += x;
+#else
+        enum { MaxIov = 512 }; // well under IOV_MAX everywhere
+        struct iovec v[ MaxIov ];
+        while ( toSend._sent < toSend.data->len ) {
+            int n = 0;
+            int off = toSend._sent;
+            int head = toSend.headLen();
+            if ( off < head ) {
+                v[n].iov_base = (char *) toSend.data + off;
+                v[n].iov_len = head - off;
+                n++;
+                off = 0;
+            }
+            else {
+                off -= head;
+            }
+            for ( unsigned i = 0; i < toSend._pieces.size() && n < MaxIov; i++ ) {
+                int len = toSend._pieces[i].second;
+                if ( off >= len ) {
+                    off -= len;
+                    continue;
+                }
+                v[n].iov_base = (char *) toSend._pieces[i].first + off;
+                v[n].iov_len = len - off;
+                n++;
+                off = 0;
+            }
+
+            struct msghdr h;
+            memset( &h, 0, sizeof( h ) );
+            h.msg_iov = v;
+            h.msg_iovlen = n;
+            // pinned, we mustn't sit in send() while a writer waits for the pins to go
+            bool wait = block && !toSend._pinned;
+            int x = ::sendmsg( sock, &h, portSendFlags | ( wait ? 0 : MSG_DONTWAIT ) );
+            if ( x < 0 && !wait && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) {
+                if ( !block )
+                    return;
+                if ( responsePins.wanted() ) {
+                    toSend.copyUnsent();
+                }
+                else {
+                    struct pollfd p;
+                    p.fd = sock;
+                    p.events = POLLOUT;
+                    p.revents = 0;
+                    ::poll( &p, 1, 10 );
+                }
+                continue;
+            }
+            if ( x <= 0 ) {
+                log() << "MessagingPort say sendmsg() error " << errno << ' ' << farEnd.toString() << endl;
+                throw SocketException();
+            }
+            toSend._sent += x;
+        }
+        toSend.unpin();
+#endif
+    }
+
+    ResponsePins responsePins;
+
+    void ResponsePins::pin() {
+        boostlock lk( _m );
+        _n++;
+    }
+
+    void ResponsePins::unpin() {
+        boostlock lk( _m );
+        assert( _n > 0 );
+        if ( --_n == 0 )
+            _c.notify_all();
+    }
+
+    void ResponsePins::waitForNone() {
+        boostlock lk( _m );
+        _waiting++;
+        while ( _n )
+            _c.wait( lk );
+        _waiting--;
+    }
+
+    void Message::pin() {
+        if ( _pinned || _pieces.empty() || _sent == data->len )
+            return;
+        responsePins.pin();
+        _pinned = true;
+    }
+
+    void Message::unpin() {
+        if ( !_pinned )
+            return;
+        _pinned = false;
+        responsePins.unpin();
+    }
+
+    void Message::consolidate() {
+        if ( _pieces.empty() )
+            return;
+        assert( _sent == 0 );
+        int len = data->len;
+        char *buf = (char *) malloc( len );
+        int off = headLen();
+        memcpy( buf, data, off );
+        for ( unsigned i = 0; i < _pieces.size(); i++ ) {
+            memcpy( buf + off, _pieces[i].first, _pieces[i].second );
+            off += _pieces[i].second;
+        }
+        assert( off == len );
+
+        if ( freeIt )
+            free( data );
+        data = (MsgData *) buf;
+        freeIt = true;
+        for ( unsigned i = 0; i < _owned.size(); i++ )
+            free( _owned[i] );
+        _owned.clear();
+        _pieces.clear();
+        _piecesLen = 0;
+        unpin();
+    }
+
+    void Message::copyUnsent() {
+        if ( _pieces.empty() )
+            return;
+        int head = headLen();
+        int skip = _sent > head ? _sent - head : 0; // bytes of the pieces already sent
+        int len = _piecesLen - skip;
+        char *buf = (char *) malloc( len > 0 ? len : 1 );
+        int off = 0;
+        for ( unsigned i = 0; i < _pieces.size(); i++ ) {
+            const char *p = _pieces[i].first;
+            int n = _pieces[i].second;
+            if ( skip >= n ) {
+                skip -= n;
+                continue;
+            }
+            memcpy( buf + off, p + skip, n - skip );
+            off += n - skip;
+            skip = 0;
+        }
+        assert( off == len );
+
+        for ( unsigned i = 0; i < _owned.size(); i++ )
+            free( _owned[i] );
+        _owned.clear();
+        _owned.push_back( buf );
+        _pieces.clear();
+        // what was already sent stays accounted for, so offsets into the message don't change
+        if ( _piecesLen - len )
+            _pieces.push_back( make_pair( (const char *) 0, _piecesLen - len ) );
+        _pieces.push_back( make_pair( (const char *) buf, len ) );
+        unpin();
+    }
+
     void MessagingPort::piggyBack( Message& toSend , int responseTo ) {
 
         if ( toSend.data->len > 1300 ) {
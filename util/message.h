@@ -70,10 +70,18 @@ namespace mongo {
         bool call(Message& toSend, Message& response);
         void say(Message& toSend, int responseTo = -1);
 
+        /* starts sending toSend, but only as much as the socket will take without blocking.
+           a later say() or reply() sends the rest.
+        */
+        void sayWithoutBlocking(Message& toSend, int responseTo = -1);
+
         void piggyBack( Message& toSend , int responseTo = -1 );
 
         virtual unsigned remotePort();
     private:
+        /* sends toSend from wherever an earlier call left off, in gathered writes */
+        void sendPieces(Message& toSend, bool block);
+
         int sock;
         PiggyBackData * piggyBackData;
     public:
@@ -133,15 +141,42 @@ namespace mongo {
 
 #pragma pack()
 
+    /* a response whose pieces point into the datafiles can go on being sent after the db lock
+       is released as long as it's pinned.  a writer taking the lock waits until nothing is
+       pinned; while it waits, senders copy whatever they haven't sent yet and unpin.
+    */
+    class ResponsePins {
+    public:
+        ResponsePins() : _n(0), _waiting(0) { }
+        void pin();
+        void unpin();
+        /* a writer is waiting for the pins to go */
+        bool wanted() const { return _waiting != 0; }
+        void waitForNone();
+    private:
+        boost::mutex _m;
+        boost::condition _c;
+        int _n;
+        volatile int _waiting;
+    };
+
+    extern ResponsePins responsePins;
+
     class Message {
     public:
         Message() {
             data = 0;
             freeIt = false;
+            _piecesLen = 0;
+            _sent = 0;
+            _pinned = false;
         }
         Message( void * _data , bool _freeIt ) {
             data = (MsgData*)_data;
             freeIt = _freeIt;
+            _piecesLen = 0;
+            _sent = 0;
+            _pinned = false;
         };
         ~Message() {
             reset();
@@ -152,6 +187,7 @@ namespace mongo {
 
         Message& operator=(Message& r) {
             assert( data == 0 );
+            assert( r._pieces.empty() );
             data = r.data;
             assert( r.freeIt );
             r.freeIt = false;
@@ -165,6 +201,13 @@ namespace mongo {
                 free(data);
             data = 0;
             freeIt = false;
+            for ( unsigned i = 0; i < _owned.size(); i++ )
+                free( _owned[i] );
+            _owned.clear();
+            _pieces.clear();
+            _piecesLen = 0;
+            _sent = 0;
+            unpin();
         }
 
         void setData(MsgData *d, bool _freeIt) {
@@ -190,8 +233,50 @@ namespace mongo {
             return freeIt;
         }
 
+        /* more of the message, to go out straight after data without first being copied in with
+           it.  data->len counts the pieces too.  the memory isn't ours: it must not change until
+           the message is sent, or until consolidate() or copyUnsent() is called.  pin() says
+           that holds even without the lock that protects it.
+        */
+        void appendPiece( const char *p, int len ) {
+            _pieces.push_back( make_pair( p, len ) );
+            _piecesLen += len;
+        }
+        /* a piece in memory that won't last, so we keep a copy */
+        void appendCopy( const char *p, int len ) {
+            char *c = (char *) malloc( len );
+            memcpy( c, p, len );
+            _owned.push_back( c );
+            appendPiece( c, len );
+        }
+        bool hasPieces() const { return !_pieces.empty(); }
+        int piecesLen() const { return _piecesLen; }
+
+        /* copies the pieces in after data, so the message is one buffer again */
+        void consolidate();
+
+        /* copies whatever part of the pieces hasn't already gone out on a socket, so it no
+           longer refers to memory we don't own.  the message can then still only be sent.
+        */
+        void copyUnsent();
+
+        /* takes a pin (see ResponsePins) for whatever part of the pieces hasn't been sent.  it's
+           dropped once they're sent, copied, or the message is reset.
+        */
+        void pin();
+        bool pinned() const { return _pinned; }
+
     private:
+        friend class MessagingPort;
+        int headLen() const { return data->len - _piecesLen; }
+        void unpin();
+
         bool freeIt;
+        vector< pair< const char *, int > > _pieces;
+        vector< char * > _owned;        // pieces we copied and have to free
+        int _piecesLen;
+        int _sent;                      // bytes already sent by MessagingPort::sayWithoutBlocking()
+        bool _pinned;
     };
 
     class SocketException : public DBException {
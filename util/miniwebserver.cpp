@@ -19,11 +19,13 @@
 #include "miniwebserver.h"
 
 #include <pcrecpp.h>
+#include <boost/bind.hpp>
 
 namespace mongo {
 
     MiniWebServer::MiniWebServer() {
         sock = 0;
+        _threads = 0;
     }
 
     bool MiniWebServer::init(const string &ip, int _port) {
@@ -120,57 +122,125 @@ namespace mongo {
         return ret ? ret + 4 : ret;
     }
 
-    bool MiniWebServer::fullReceive( const char *buf ) {
+    int MiniWebServer::fullReceive( const char *buf ) {
         const char *bod = body( buf );
         if ( !bod )
-            return false;
+            return 0;
+        int headerLen = (int)( bod - buf );
         const char *lenString = "Content-Length:";
         const char *lengthLoc = strstr( buf, lenString );
-        if ( !lengthLoc )
-            return true;
+        if ( !lengthLoc || lengthLoc > bod )
+            return headerLen;
         lengthLoc += strlen( lenString );
         long len = strtol( lengthLoc, 0, 10 );
-        if ( long( strlen( bod ) ) == len )
-            return true;
-        return false;
+        if ( long( strlen( bod ) ) >= len )
+            return headerLen + len;
+        return 0;
+    }
+
+    bool MiniWebServer::keepAlive( const char *rq, bool http11 ) {
+        string connection = getHeader( rq, "Connection" );
+        for ( string::iterator i = connection.begin(); i != connection.end(); ++i )
+            *i = tolower( *i );
+        if ( http11 )
+            return connection != "close";
+        return connection == "keep-alive";
+    }
+
+    static string statusLine( int responseCode ) {
+        stringstream ss;
+        ss << "HTTP/1.1 " << responseCode;
+        if ( responseCode == 200 ) ss << " OK";
+        ss << "\r\n";
+        return ss.str();
     }
 
+    /* keep-alive connections idle longer than this give back their thread */
+    const int KeepAliveIdleSecs = 30;
+
     void MiniWebServer::accepted(int s, const SockAddr &from) {
+        setSockReceiveTimeout( s, KeepAliveIdleSecs );
         char buf[4096];
         int len = 0;
+        buf[ 0 ] = 0;
         while ( 1 ) {
-            int x = ::recv(s, buf + len, sizeof(buf) - 1 - len, 0);
-            if ( x <= 0 ) {
-                return;
+            int rqLen;
+            while ( ( rqLen = fullReceive( buf ) ) == 0 ) {
+                if ( len >= int( sizeof( buf ) ) - 1 )
+                    return;
+                int x = ::recv(s, buf + len, sizeof(buf) - 1 - len, 0);
+                if ( x <= 0 ) {
+                    return;
+                }
+                len += x;
+                buf[ len ] = 0;
+            }
+            // the client may have pipelined its next request behind this one
+            char next = buf[ rqLen ];
+            buf[ rqLen ] = 0;
+
+            const char *eol = strstr( buf, "\r\n" );
+            const char *version = strstr( buf, "HTTP/1.1" );
+            bool http11 = version && ( !eol || version < eol );
+            bool keep = keepAlive( buf, http11 );
+            string url = parseURL( buf );
+
+            HttpResponseStream stream( s, http11, keep );
+            if ( doStreamingRequest( buf, url, stream, from ) ) {
+                stream.finish();
+                keep = stream.reusable();
             }
-            len += x;
+            else {
+                string responseMsg;
+                int responseCode = 599;
+                vector<string> headers;
+                doRequest(buf, url, responseMsg, responseCode, headers, from);
+
+                stringstream ss;
+                ss << statusLine( responseCode );
+                if ( headers.empty() ) {
+                    ss << "Content-Type: text/html\r\n";
+                }
+                else {
+                    for ( vector<string>::iterator i = headers.begin(); i != headers.end(); i++ )
+                        ss << *i << "\r\n";
+                }
+                ss << "Content-Length: " << responseMsg.size() << "\r\n";
+                if ( !keep )
+                    ss << "Connection: close\r\n";
+                ss << "\r\n";
+                ss << responseMsg;
+                string response = ss.str();
+
+                if ( ::send(s, response.c_str(), response.size(), 0) != (int) response.size() )
+                    return;
+            }
+
+            if ( !keep )
+                return;
+            buf[ rqLen ] = next;
+            len -= rqLen;
+            memmove( buf, buf + rqLen, len );
             buf[ len ] = 0;
-            if ( fullReceive( buf ) )
-                break;
         }
-        buf[len] = 0;
-
-        string responseMsg;
-        int responseCode = 599;
-        vector<string> headers;
-        doRequest(buf, parseURL( buf ), responseMsg, responseCode, headers, from);
+    }
 
-        stringstream ss;
-        ss << "HTTP/1.0 " << responseCode;
-        if ( responseCode == 200 ) ss << " OK";
-        ss << "\r\n";
-        if ( headers.empty() ) {
-            ss << "Content-Type: text/html\r\n";
+    void MiniWebServer::threadRun(int s, SockAddr from) {
+        connectionThreadInit();
+        try {
+            accepted( s, from );
         }
-        else {
-            for ( vector<string>::iterator i = headers.begin(); i != headers.end(); i++ )
-                ss << *i << "\r\n";
+        catch ( std::exception& e ) {
+            log() << "MiniWebServer: exception on connection from " << from.toString() << ": " << e.what() << endl;
         }
-        ss << "\r\n";
-        ss << responseMsg;
-        string response = ss.str();
+        catch ( ... ) {
+            log() << "MiniWebServer: unknown exception on connection from " << from.toString() << endl;
+        }
+        closesocket(s);
+        connectionThreadDone();
 
-        ::send(s, response.c_str(), response.size(), 0);
+        boostlock lk( _threadsMutex );
+        _threads--;
     }
     
     string MiniWebServer::getHeader( const char * req , string wanted ){
@@ -204,9 +274,77 @@ namespace mongo {
             }
             disableNagle(s);
             RARELY log() << "MiniWebServer: connection accepted from " << from.toString() << endl;
-            accepted( s, from );
-            closesocket(s);
+            {
+                boostlock lk( _threadsMutex );
+                if ( _threads >= MaxConnectionThreads ) {
+                    lk.unlock();
+                    string busy = statusLine( 503 ) + "Content-Length: 0\r\nConnection: close\r\n\r\n";
+                    ::send( s, busy.c_str(), busy.size(), 0 );
+                    closesocket( s );
+                    continue;
+                }
+                _threads++;
+            }
+            boost::thread thr( boost::bind( &MiniWebServer::threadRun, this, s, from ) );
+        }
+    }
+
+    /* --- HttpResponseStream --- */
+
+    void HttpResponseStream::send( const string& s ) {
+        const char *p = s.c_str();
+        int left = s.size();
+        while ( left > 0 && !_failed ) {
+            int x = ::send( _sock, p, left, 0 );
+            if ( x <= 0 ) {
+                _failed = true;
+                break;
+            }
+            p += x;
+            left -= x;
         }
     }
 
+    void HttpResponseStream::start( int responseCode, const vector<string>& headers ) {
+        assert( !_started );
+        _started = true;
+        stringstream ss;
+        ss << statusLine( responseCode );
+        if ( headers.empty() )
+            ss << "Content-Type: text/html\r\n";
+        for ( vector<string>::const_iterator i = headers.begin(); i != headers.end(); i++ )
+            ss << *i << "\r\n";
+        if ( _chunked )
+            ss << "Transfer-Encoding: chunked\r\n";
+        if ( !_keepAlive )
+            ss << "Connection: close\r\n";
+        ss << "\r\n";
+        send( ss.str() );
+    }
+
+    void HttpResponseStream::flush() {
+        if ( !_started )
+            start( 200, vector<string>() );
+        string data = _buf.str();
+        _buf.str( "" );
+        if ( data.empty() )
+            return;
+        if ( !_chunked ) {
+            send( data );
+            return;
+        }
+        stringstream ss;
+        ss << hex << data.size() << "\r\n" << data << "\r\n";
+        send( ss.str() );
+    }
+
+    void HttpResponseStream::finish() {
+        if ( _finished )
+            return;
+        flush();
+        if ( _chunked )
+            send( "0\r\n\r\n" );
+        _finished = true;
+    }
+
 } // namespace mongo
@@ -21,14 +21,56 @@
 
 namespace mongo {
 
+    /* lets a request handler send its response body a piece at a time rather than
+       building it all in memory first.  HTTP/1.1 clients get chunked transfer encoding
+       and can keep the connection; 1.0 clients get the body delimited by close.
+    */
+    class HttpResponseStream : boost::noncopyable {
+    public:
+        HttpResponseStream( int sock, bool http11, bool keepAlive ) :
+            _sock( sock ), _chunked( http11 ), _keepAlive( keepAlive && http11 ), _started(), _finished(), _failed() { }
+        ~HttpResponseStream() { if ( _started ) finish(); }
+
+        /* sends the status line and headers.  call once, before writing any of the body. */
+        void start( int responseCode, const vector<string>& headers );
+        /* buffered -- goes out in chunks of about ChunkSize */
+        HttpResponseStream& operator<<( const string& s ) { _buf << s; if ( _buf.tellp() >= ChunkSize ) flush(); return *this; }
+        HttpResponseStream& operator<<( const char *s ) { _buf << s; if ( _buf.tellp() >= ChunkSize ) flush(); return *this; }
+        HttpResponseStream& operator<<( long long x ) { _buf << x; return *this; }
+        void flush();
+        /* terminates the body.  after this the connection may be reused, if chunked. */
+        void finish();
+
+        bool started() const { return _started; }
+        /* true if the connection can take another request once finished */
+        bool reusable() const { return _keepAlive && _finished && !_failed; }
+        /* the peer went away; stop producing output */
+        bool failed() const { return _failed; }
+    private:
+        enum { ChunkSize = 16 * 1024 };
+        void send( const string& s );
+        int _sock;
+        bool _chunked;
+        bool _keepAlive;
+        bool _started;
+        bool _finished;
+        bool _failed;
+        stringstream _buf;
+    };
+
     class MiniWebServer {
     public:
         MiniWebServer();
         virtual ~MiniWebServer() {}
 
         bool init(const string &ip, int _port);
+        /* each connection is served on its own thread, and kept open between requests
+           when the client asks for keep-alive (the default for HTTP/1.1).  past
+           MaxConnectionThreads, new connections are turned away with a 503. */
         void run();
 
+        enum { MaxConnectionThreads = 20 };
+
         virtual void doRequest(
             const char *rq, // the full request
             string url,
@@ -39,6 +81,17 @@ namespace mongo {
             const SockAddr &from
         ) = 0;
 
+        /* override to write the response as it is produced.  return false if this
+           request isn't one you stream, and it goes to doRequest() instead.
+        */
+        virtual bool doStreamingRequest( const char *rq, string url, HttpResponseStream& out, const SockAddr &from ) {
+            return false;
+        }
+
+        /* called on each connection thread before the first request, and after the last */
+        virtual void connectionThreadInit() { }
+        virtual void connectionThreadDone() { }
+
         int socket() const { return sock; }
         
     protected:
@@ -50,10 +103,16 @@ namespace mongo {
 
     private:
         void accepted(int s, const SockAddr &from);
-        static bool fullReceive( const char *buf );
+        void threadRun(int s, SockAddr from);
+        /* @return length of the first complete request in buf, or 0 if more is needed */
+        static int fullReceive( const char *buf );
+        bool keepAlive( const char *rq, bool http11 );
 
         int port;
         int sock;
+
+        boost::mutex _threadsMutex;
+        int _threads;                     // connection threads running
     };
 
 } // namespace mongo
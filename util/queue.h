@@ -26,11 +26,23 @@ namespace mongo {
     
     /**
      * simple blocking queue
+     * if maxSize is non zero, push blocks while the queue is full, so a slow consumer
+     * throttles its producers.  pushWaits/popWaits count how often either side had to
+     * block, which is a cheap way to see which end of a pipeline is the bottleneck.
      */
     template<typename T> class BlockingQueue : boost::noncopyable {
     public:
+        BlockingQueue( size_t maxSize = 0 ) 
+            : _maxSize( maxSize ) , _pushWaits(0) , _popWaits(0) {
+        }
+
         void push(T const& t){
             boostlock l( _lock );
+            if ( _maxSize && _queue.size() >= _maxSize ){
+                _pushWaits++;
+                while ( _queue.size() >= _maxSize )
+                    _notFull.wait( l );
+            }
             _queue.push( t );
             _condition.notify_one();
         }
@@ -39,6 +51,11 @@ namespace mongo {
             boostlock l( _lock );
             return _queue.empty();
         }
+
+        size_t size() const {
+            boostlock l( _lock );
+            return _queue.size();
+        }
         
         bool tryPop( T & t ){
             boostlock l( _lock );
@@ -47,6 +64,7 @@ namespace mongo {
             
             t = _queue.front();
             _queue.pop();
+            _notFull.notify_one();
             
             return true;
         }
@@ -54,19 +72,37 @@ namespace mongo {
         T blockingPop(){
 
             boostlock l( _lock );
-            while( _queue.empty() )
-                _condition.wait( l );
+            if ( _queue.empty() ){
+                _popWaits++;
+                while( _queue.empty() )
+                    _condition.wait( l );
+            }
             
             T t = _queue.front();
             _queue.pop();
+            _notFull.notify_one();
             return t;    
         }
+
+        long long pushWaits() const {
+            boostlock l( _lock );
+            return _pushWaits;
+        }
+
+        long long popWaits() const {
+            boostlock l( _lock );
+            return _popWaits;
+        }
         
     private:
         std::queue<T> _queue;
+        size_t _maxSize;
+        long long _pushWaits;
+        long long _popWaits;
         
         mutable boost::mutex _lock;
         boost::condition _condition;
+        boost::condition _notFull;
     };
 
 }
@@ -91,10 +91,13 @@ namespace mongo {
 #endif
 
     inline void setSockReceiveTimeout(int sock, int secs) {
-// todo - finish - works?
+#if defined(_WIN32)
+        DWORD tv = secs * 1000;
+#else
         struct timeval tv;
-        tv.tv_sec = 0;//secs;
-        tv.tv_usec = 1000;
+        tv.tv_sec = secs;
+        tv.tv_usec = 0;
+#endif
         int rc = setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char *) &tv, sizeof(tv));
         if ( rc ) {
             out() << "ERROR: setsockopt RCVTIMEO failed rc:" << rc << " errno:" << getLastError() << " secs:" << secs << " sock:" << sock << endl;